@@ -0,0 +1,92 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "AnnotationIndex.h"
+
+// System headers
+#include <functional>
+
+namespace sedeen {
+namespace algorithm {
+
+size_t AnnotationKeyHash::operator()(const AnnotationKey &key) const {
+    //Combine the hashes of the members as in boost::hash_combine
+    size_t seed = std::hash<std::string>()(key.name);
+    const int values[4] = { key.bounds.x, key.bounds.y, key.bounds.width, key.bounds.height };
+    for (int v : values) {
+        seed ^= std::hash<int>()(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+}//end operator()
+
+const size_t AnnotationIndex::npos = static_cast<size_t>(-1);
+
+AnnotationIndex::AnnotationIndex()
+    : m_positions(),
+    m_spatial(),
+    m_stamp()
+{
+}//end constructor
+
+void AnnotationIndex::clear() {
+    m_positions.clear();
+    m_spatial.clear();
+    m_stamp.clear();
+}//end clear
+
+void AnnotationIndex::insert(const AnnotationKey &key, size_t position) {
+    m_positions.emplace(key, position);
+    m_spatial.insert(key.bounds, position);
+}//end insert
+
+void AnnotationIndex::rebuild(const std::vector<AnnotationKey> &keys) {
+    clear();
+    m_positions.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        m_positions.emplace(keys[i], i);
+        m_spatial.append(keys[i].bounds, i);
+    }
+    //Packing once is O(n log n), where repacking during the inserts would be repeated
+    m_spatial.pack();
+}//end rebuild
+
+void AnnotationIndex::erase(const AnnotationKey &key, size_t position) {
+    auto range = m_positions.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == position) {
+            m_positions.erase(it);
+            m_spatial.erase(key.bounds, position);
+            return;
+        }
+    }
+}//end erase
+
+size_t AnnotationIndex::find(const AnnotationKey &key) const {
+    auto it = m_positions.find(key);
+    return (it != m_positions.end()) ? it->second : npos;
+}//end find
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,107 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_ANNOTATIONINDEX_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_ANNOTATIONINDEX_H
+
+// System headers
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Plugin headers
+#include "BoxPlacement.h"
+#include "SpatialIndex.h"
+
+namespace sedeen {
+namespace algorithm {
+
+///Identifies an annotation by its name and the bounding box of its points
+struct AnnotationKey {
+    std::string name;
+    BoxRect bounds;
+
+    bool operator==(const AnnotationKey &other) const {
+        return (name == other.name)
+            && (bounds.x == other.bounds.x) && (bounds.y == other.bounds.y)
+            && (bounds.width == other.bounds.width) && (bounds.height == other.bounds.height);
+    }
+};
+
+///Hash function for AnnotationKey
+struct AnnotationKeyHash {
+    size_t operator()(const AnnotationKey &key) const;
+};
+
+///Hash index from annotation name and geometry to position in the session's list of graphics.
+///Lookups are O(1) regardless of the number of annotations. The index remembers a stamp
+///identifying the session file it describes, so that it can be kept between runs and only
+///rebuilt when the session was changed by someone else. The bounding boxes are also kept in
+///a spatial index, for overlap and neighbour queries against the existing annotations.
+class AnnotationIndex {
+public:
+    ///Returned by find when there is no matching annotation
+    static const size_t npos;
+
+    AnnotationIndex();
+
+    ///Remove all entries and the stamp
+    void clear();
+
+    ///Record that the annotation with the given key is at position
+    void insert(const AnnotationKey &key, size_t position);
+
+    ///Replace all entries with keys, the key of position i at index i. Removes the stamp.
+    void rebuild(const std::vector<AnnotationKey> &keys);
+
+    ///Remove the record of the annotation with the given key at position
+    void erase(const AnnotationKey &key, size_t position);
+
+    ///Return the position of an annotation with the given key, or npos
+    size_t find(const AnnotationKey &key) const;
+
+    ///Number of annotations indexed
+    size_t size() const { return m_positions.size(); }
+
+    ///Spatial index of the bounding boxes, with positions as ids
+    const SpatialIndex &spatial() const { return m_spatial; }
+
+
+    ///Return true if the index was built from the session file identified by stamp
+    bool matches(const std::string &stamp) const { return !m_stamp.empty() && (m_stamp == stamp); }
+
+    ///Associate the index with the session file identified by stamp
+    void setStamp(const std::string &stamp) { m_stamp = stamp; }
+
+private:
+    std::unordered_multimap<AnnotationKey, size_t, AnnotationKeyHash> m_positions;
+    SpatialIndex m_spatial;
+    std::string m_stamp;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_ANNOTATIONINDEX_H
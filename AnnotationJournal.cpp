@@ -0,0 +1,253 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "AnnotationJournal.h"
+
+// System headers
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+// Plugin headers
+#include "SessionTransaction.h"
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+///First line of every journal file
+const char *JOURNAL_HEADER = "BoxDropJournal 1";
+
+///Escape the characters that separate fields and records
+std::string escapeField(const std::string &text) {
+    std::string out;
+    out.reserve(text.size());
+    for (char c : text) {
+        if (c == '\\') { out += "\\\\"; }
+        else if (c == '\t') { out += "\\t"; }
+        else if (c == '\n') { out += "\\n"; }
+        else if (c == '\r') { out += "\\r"; }
+        else { out += c; }
+    }
+    return out;
+}//end escapeField
+
+std::string unescapeField(const std::string &text) {
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if ((text[i] == '\\') && (i + 1 < text.size())) {
+            const char c = text[++i];
+            out += (c == 't') ? '\t' : (c == 'n') ? '\n' : (c == 'r') ? '\r' : c;
+        }
+        else {
+            out += text[i];
+        }
+    }
+    return out;
+}//end unescapeField
+
+///Parse one record line; returns false if it is malformed
+bool parseRecord(const std::string &line, JournalRecord &record) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, '\t')) { fields.push_back(field); }
+    if (fields.size() != 12) { return false; }
+    try {
+        record.box = BoxRect(std::stoi(fields[0]), std::stoi(fields[1]), std::stoi(fields[2]), std::stoi(fields[3]));
+        record.name = unescapeField(fields[4]);
+        record.description = unescapeField(fields[5]);
+        record.styleSource.name = unescapeField(fields[6]);
+        record.styleSource.bounds = BoxRect(std::stoi(fields[7]), std::stoi(fields[8]),
+            std::stoi(fields[9]), std::stoi(fields[10]));
+        record.replacesSource = (fields[11] == "1");
+    }
+    catch (const std::exception &) {
+        return false;
+    }
+    return true;
+}//end parseRecord
+
+///Return the key under which the session indexes the box of record
+AnnotationKey recordKey(const JournalRecord &record) {
+    AnnotationKey key;
+    key.name = record.name;
+    key.bounds = record.box;
+    return key;
+}//end recordKey
+
+int64_t fileSizeOf(const std::string &path) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : static_cast<int64_t>(size);
+}//end fileSizeOf
+
+///Cut off a last line left without its newline by an interrupted write, so that the next
+///line appended starts on a line of its own. Returns the new size, or -1 if it cannot be cut.
+int64_t trimPartialLine(const std::string &path) {
+    const int64_t size = fileSizeOf(path);
+    if (size == 0) { return 0; }
+    std::ifstream in(path.c_str(), std::ios::binary);
+    char last = 0;
+    in.seekg(size - 1);
+    if (in.get(last) && (last == '\n')) { return size; }
+    in.clear();
+    in.seekg(0);
+    const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    const size_t end = text.rfind('\n');
+    const int64_t kept = (end == std::string::npos) ? 0 : static_cast<int64_t>(end) + 1;
+    std::error_code ec;
+    std::filesystem::resize_file(path, static_cast<uintmax_t>(kept), ec);
+    return ec ? -1 : kept;
+}//end trimPartialLine
+} // namespace
+
+AnnotationJournal::AnnotationJournal()
+    : m_filePath(),
+    m_knownSize(-1),
+    m_count(0),
+    m_keys()
+{
+}//end constructor
+
+void AnnotationJournal::open(const std::string &imagePath) {
+    const std::string path = journalFilePathFor(imagePath);
+    if (path == m_filePath) { return; }
+    m_filePath = path;
+    m_knownSize = -1;
+    m_count = 0;
+    m_keys.clear();
+}//end open
+
+bool AnnotationJournal::append(const std::vector<JournalRecord> &records) {
+    if (records.empty()) { return true; }
+    const int64_t sizeBefore = trimPartialLine(m_filePath);
+    if (sizeBefore < 0) { return false; }
+    std::stringstream ss;
+    if (sizeBefore == 0) { ss << JOURNAL_HEADER << "\n"; }
+    for (auto it = records.begin(); it != records.end(); ++it) {
+        const BoxRect &source = it->styleSource.bounds;
+        ss << it->box.x << "\t" << it->box.y << "\t" << it->box.width << "\t" << it->box.height << "\t"
+            << escapeField(it->name) << "\t" << escapeField(it->description) << "\t"
+            << escapeField(it->styleSource.name) << "\t"
+            << source.x << "\t" << source.y << "\t" << source.width << "\t" << source.height << "\t"
+            << (it->replacesSource ? 1 : 0) << "\n";
+    }
+    const std::string text = ss.str();
+    std::ofstream out(m_filePath.c_str(), std::ios::binary | std::ios::out | std::ios::app);
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    out.flush();
+    if (!out.good()) { return false; }
+    //Keep the counts current without rereading, unless someone else changed the file
+    if (sizeBefore == m_knownSize) {
+        m_knownSize = sizeBefore + static_cast<int64_t>(text.size());
+        m_count += records.size();
+        for (auto it = records.begin(); it != records.end(); ++it) { m_keys[recordKey(*it)] = it->description; }
+    }
+    return true;
+}//end append
+
+bool AnnotationJournal::read(std::vector<JournalRecord> &records) const {
+    records.clear();
+    std::ifstream in(m_filePath.c_str(), std::ios::binary);
+    if (!in) { return false; }
+    std::string line;
+    if (!std::getline(in, line) || (line != JOURNAL_HEADER)) { return false; }
+    while (std::getline(in, line)) {
+        //The last line has no newline only if its write was interrupted
+        if (in.eof()) { break; }
+        JournalRecord record;
+        if (parseRecord(line, record)) { records.push_back(record); }
+    }
+    return true;
+}//end read
+
+void AnnotationJournal::refresh() {
+    const int64_t size = fileSizeOf(m_filePath);
+    if (size == m_knownSize) { return; }
+    std::vector<JournalRecord> records;
+    read(records);
+    m_count = records.size();
+    m_keys.clear();
+    for (auto it = records.begin(); it != records.end(); ++it) { m_keys[recordKey(*it)] = it->description; }
+    m_knownSize = size;
+}//end refresh
+
+size_t AnnotationJournal::recordCount() {
+    refresh();
+    return m_count;
+}//end recordCount
+
+bool AnnotationJournal::contains(const AnnotationKey &key) {
+    refresh();
+    return m_keys.count(key) > 0;
+}//end contains
+
+bool AnnotationJournal::contains(const AnnotationKey &key, const std::string &description) {
+    refresh();
+    auto found = m_keys.find(key);
+    return (found != m_keys.end()) && (found->second == description);
+}//end contains
+
+bool AnnotationJournal::compactInto(SessionTransaction &session, int *applied) {
+    std::vector<JournalRecord> records;
+    read(records);
+    int added = 0;
+    for (auto it = records.begin(); it != records.end(); ++it) {
+        size_t source = AnnotationIndex::npos;
+        if (!it->styleSource.name.empty()) {
+            source = session.findGraphic(it->styleSource.name, it->styleSource.bounds);
+        }
+        const GraphicDescription *templateGraphic =
+            (source != AnnotationIndex::npos) ? &session.graphics()[source] : nullptr;
+        std::vector<GraphicDescription> graphic(1, makeBoxGraphic(it->box, it->name, it->description,
+            templateGraphic ? templateGraphic->getStyle() : GraphicStyle(), templateGraphic));
+        added += session.addBoxGraphics(graphic, it->replacesSource ? source : AnnotationIndex::npos);
+    }
+    if (applied) { *applied = added; }
+    if (!session.commit()) { return false; }
+    //Emptied only after the session is safely written
+    clear();
+    return true;
+}//end compactInto
+
+void AnnotationJournal::clear() {
+    std::error_code ec;
+    std::filesystem::remove(m_filePath, ec);
+    m_knownSize = 0;
+    m_count = 0;
+    m_keys.clear();
+}//end clear
+
+std::string AnnotationJournal::journalFilePathFor(const std::string &imagePath) {
+    //Beside the session file, so the two move together
+    return SessionTransaction::sessionFilePathFor(imagePath) + ".boxdrop-journal";
+}//end journalFilePathFor
+
+} // namespace algorithm
+} // namespace sedeen
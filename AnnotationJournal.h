@@ -0,0 +1,113 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_ANNOTATIONJOURNAL_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_ANNOTATIONJOURNAL_H
+
+// System headers
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Plugin headers
+#include "AnnotationIndex.h"
+#include "BoxPlacement.h"
+
+namespace sedeen {
+namespace algorithm {
+
+class SessionTransaction;
+
+///One box annotation waiting in the journal
+struct JournalRecord {
+    BoxRect box;
+    std::string name;
+    std::string description;
+    ///Name and bounds of the graphic whose style and geometry type the box copies.
+    ///An empty name gives the default style.
+    AnnotationKey styleSource;
+    ///If true, the box takes the place of styleSource in the session when that is a placeholder
+    bool replacesSource = false;
+};
+
+///Append-only sidecar file of the boxes BoxDrop has created on an image but not yet written
+///to its session. Adding boxes appends one line per box, so the cost of a run does not grow
+///with the number of annotations on the slide. compactInto applies the records to the session
+///in one write and empties the journal.
+///The style of a box is recorded as a reference to the graphic it was copied from, and
+///looked up when the journal is compacted: the SDK gives GraphicStyle no text form.
+class AnnotationJournal {
+public:
+    AnnotationJournal();
+
+    ///Use the journal of the image at imagePath. Counts are kept if it is the same image.
+    void open(const std::string &imagePath);
+
+    ///Append records to the file, creating it if needed. A last line cut short by an interrupted
+    ///append is removed first. Returns false if the write failed.
+    bool append(const std::vector<JournalRecord> &records);
+
+    ///Read every complete record; a line cut short by a crash is ignored
+    bool read(std::vector<JournalRecord> &records) const;
+
+    ///Number of records in the journal
+    size_t recordCount();
+
+    ///Return true if the journal holds a box with this name and bounding box
+    bool contains(const AnnotationKey &key);
+
+    ///Return true if the last journalled box with this name and bounding box has this description
+    bool contains(const AnnotationKey &key, const std::string &description);
+
+    ///Add the journalled boxes to session, commit it, and empty the journal. Boxes already in
+    ///the session with the same description are skipped, so compacting again after an interrupted compaction is harmless.
+    ///Returns false (keeping the journal) if the session could not be written.
+    bool compactInto(SessionTransaction &session, int *applied = nullptr);
+
+    ///Delete the journal file
+    void clear();
+
+    const std::string &filePath() const { return m_filePath; }
+
+    ///Return the journal file path used for the given image
+    static std::string journalFilePathFor(const std::string &imagePath);
+
+private:
+    ///Reread the file if its size is not the one last seen
+    void refresh();
+
+private:
+    std::string m_filePath;
+    ///Size of the file when m_count and m_keys were last brought up to date
+    int64_t m_knownSize;
+    size_t m_count;
+    ///Description of the last record of each box
+    std::unordered_map<AnnotationKey, std::string, AnnotationKeyHash> m_keys;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_ANNOTATIONJOURNAL_H
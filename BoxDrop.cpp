@@ -27,11 +27,13 @@
 
 // System headers
 #include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <iomanip>
 #include <filesystem>
 #include <sstream>
 #include <fstream>
+#include <limits>
 
 //DPTK headres
 #include "Algorithm.h"
@@ -58,11 +60,45 @@ BoxDrop::BoxDrop()
     m_text(),
     m_rect(),
     m_intermediate_result(),
+    m_regionSource(),
+    m_regionList(),
+    m_regionNameFilter(),
+    m_placementMode(),
+    m_numberOfBoxes(),
+    m_latticeStride(),
+    m_randomSeed(),
+    m_boxSpacing(),
+    m_minTissueFraction(),
+    m_maxOverlapFraction(),
+    m_sampleWholeImage(),
+    m_snapToTiles(),
+    m_annotationStorage(),
+    m_journalThreshold(),
+    m_compactJournal(),
     m_saveOutputImage(),
+    m_exportScales(),
+    m_saveStatistics(),
+    m_reuseExports(),
+    m_exportThreads(),
+    m_tiffCompression(),
+    m_jpegQuality(),
+    m_tileCacheSize(),
+    m_prefetchTiles(),
     m_saveFileFormat(),
     m_saveFileAs(),
+    m_timingLog(),
     m_output_text(),
-    m_cached_output_factory(nullptr)
+    m_cached_output_factory(nullptr),
+    m_journalCompacted(-1),
+    m_journalPending(0),
+    m_tissueRejections(0),
+    m_overlapRejections(0),
+    m_regionsProcessed(0),
+    m_latticeWorkingSet(0),
+    m_previewLevel(-1),
+    m_previewMilliseconds(0.0),
+    m_boxesKept(0),
+    m_boxesLinked(0)
 {
     //List the extensions that should be included in the save dialog window
     m_saveFileExtensionText.push_back("tif");
@@ -70,6 +106,37 @@ BoxDrop::BoxDrop()
     m_saveFileExtensionText.push_back("bmp");
     m_saveFileExtensionText.push_back("gif");
     m_saveFileExtensionText.push_back("jpg");
+    m_saveFileExtensionText.push_back("bdpatch");
+
+    //List the annotations boxes can be dropped on, in the order of the RegionSource enum
+    m_regionSourceOptions.push_back("Processing ROI");
+    m_regionSourceOptions.push_back("Region List");
+    m_regionSourceOptions.push_back("Name Filter");
+
+    //List the box placement modes, in the order of the PlacementMode enum
+    m_placementModeOptions.push_back("Centre on ROI");
+    m_placementModeOptions.push_back("Random Sampling");
+    m_placementModeOptions.push_back("Lattice Tiling");
+
+    //List where box annotations can be written, in the order of the AnnotationStorage enum
+    m_annotationStorageOptions.push_back("Session File");
+    m_annotationStorageOptions.push_back("Journal");
+
+    //List the sets of scales that can be exported; the index is the number of downsampled levels
+    m_exportScaleOptions.push_back("1x");
+    m_exportScaleOptions.push_back("1x, 0.5x");
+    m_exportScaleOptions.push_back("1x, 0.5x, 0.25x");
+    m_exportScaleOptions.push_back("1x, 0.5x, 0.25x, 0.125x");
+
+    //List the TIF compressions this build can write
+    const TileCodec::Compression compressions[] = { TileCodec::None, TileCodec::PackBits,
+        TileCodec::LZW, TileCodec::Deflate, TileCodec::JPEG };
+    for (auto c : compressions) {
+        if (TileCodec::isAvailable(c)) {
+            m_compressionOptions.push_back(TileCodec::name(c));
+            m_compressionValues.push_back(c);
+        }
+    }
 }//end constructor
 
 BoxDrop::~BoxDrop() {
@@ -101,144 +168,402 @@ void BoxDrop::init(const image::ImageHandle& image) {
 		"Region to operate on.",
 		true);								// Widget tooltip
 
+    //Allow the user to convert many regions in one run, loading and saving the session once
+    m_regionSource = createOptionParameter(*this, "Regions to Process",
+        "Drop boxes on the Processing ROI, on every region in the Region List, or on every annotation whose name matches the Region Name Filter",
+        ProcessingRegion, m_regionSourceOptions, false);
+
+    m_regionList = createRegionListParameter(*this, "Region List",
+        "Regions to drop boxes on when Regions to Process is Region List",
+        true);
+
+    m_regionNameFilter = createTextFieldParameter(*this, "Region Name Filter",
+        "Name of the annotations to drop boxes on when Regions to Process is Name Filter. * matches any text and ? any one character, e.g. Tumour*",
+        "*", true);
+
+    //Allow the user to drop randomly placed boxes instead of a single centred box
+    m_placementMode = createOptionParameter(*this, "Placement Mode",
+        "Centre one box on the Processing ROI, drop randomly placed, non-overlapping boxes, or cover the ROI with a lattice of boxes",
+        CentreOnRegion, m_placementModeOptions, false);
+
+    m_numberOfBoxes = createIntegerParameter(*this, "Number of Boxes",
+        "Number of boxes to place in Random Sampling mode. Fewer are placed if they do not fit.",
+        10, 1, 10000, false);
+
+    m_latticeStride = createIntegerParameter(*this, "Lattice Stride",
+        "Distance in pixels between neighbouring boxes in Lattice Tiling mode. Below the ROI Size the boxes overlap; 0 places them edge to edge.",
+        0, 0, min_dim, false);
+
+    m_randomSeed = createIntegerParameter(*this, "Random Seed",
+        "The same seed always reproduces the same random box positions",
+        1, 0, std::numeric_limits<int>::max(), false);
+
+    m_boxSpacing = createIntegerParameter(*this, "Minimum Box Spacing",
+        "Minimum gap in pixels between randomly placed boxes",
+        0, 0, min_dim, false);
+
+    m_minTissueFraction = createDoubleParameter(*this, "Minimum Tissue Fraction",
+        "Randomly placed boxes with less tissue than this fraction of their area are rejected. Tissue is found on a thumbnail of the image. 0 accepts every box.",
+        0.0, 0.0, 1.0, false);
+
+    m_maxOverlapFraction = createDoubleParameter(*this, "Maximum Overlap Fraction",
+        "Boxes covered by any existing annotation (other than the Processing ROI) over more than this fraction of their area are not placed. 0 forbids any overlap; 1 allows boxes anywhere.",
+        1.0, 0.0, 1.0, false);
+
+    m_sampleWholeImage = createBoolParameter(*this, "Sample Whole Image",
+        "If checked, random boxes are placed anywhere in the image instead of inside the Processing ROI",
+        false, false);
+
+    m_snapToTiles = createBoolParameter(*this, "Snap to Tile Grid",
+        "If checked, boxes are moved to the nearest 512-pixel tile boundary and their size is rounded up to whole tiles, so TIF images are encoded straight from the cached tiles without compositing",
+        false, false);
+
+    m_annotationStorage = createOptionParameter(*this, "Annotation Storage",
+        "Session File rewrites the session on every run. Journal appends each new box to a small file beside the session instead, and writes them all to the session when the journal is compacted.",
+        SessionFileStorage, m_annotationStorageOptions, false);
+
+    m_journalThreshold = createIntegerParameter(*this, "Journal Compaction Threshold",
+        "In Journal mode, the journalled boxes are written to the session once there are this many",
+        500, 1, 1000000, false);
+
+    m_compactJournal = createBoolParameter(*this, "Compact Journal Now",
+        "If checked, the journalled boxes are written to the session on this run",
+        false, false);
+
     //Allow the user to write separated images to file
     m_saveOutputImage = createBoolParameter(*this, "Save Image",
         "If checked, the final image will be saved to a flat image file.",
         true, false);
 
+    m_exportScales = createOptionParameter(*this, "Export Scales",
+        "Also save TIF images of the box downsampled by 2, 4 or 8 (e.g. roi_0.5x.tif), filtered from the full-resolution pixels in a single pass",
+        0, m_exportScaleOptions, false);
+
+    m_saveStatistics = createBoolParameter(*this, "Save Box Statistics",
+        "If checked, the colour histograms, mean and standard deviation of each channel, sharpness (Laplacian variance) and background fraction of every saved box are computed while it is encoded and written to a CSV table next to the images (e.g. roi.stats.csv)",
+        true, false);
+
+    m_reuseExports = createBoolParameter(*this, "Reuse Unchanged Exports",
+        "If checked, a box already saved from this image with the same position, size, format and compression is not saved again: the file is kept, or linked to the new file name, as long as it is unchanged. Exports are recorded in boxdrop.manifest next to the images, so an interrupted export resumes where it stopped.",
+        true, false);
+
+    m_exportThreads = createIntegerParameter(*this, "Export Threads",
+        "Number of images composed and saved at the same time when several boxes are exported",
+        ExportEngine::defaultThreadCount(), 1, 64, false);
+
+    m_tiffCompression = createOptionParameter(*this, "TIFF Compression",
+        "Compression of TIF images. None is fastest to write; LZW and Deflate are lossless and smaller; JPEG is smallest but lossy. Tiles are compressed on the export threads.",
+        0, m_compressionOptions, false);
+
+    m_jpegQuality = createIntegerParameter(*this, "JPEG Quality",
+        "Quality (1-100) of JPG images and of JPEG-compressed TIF images",
+        90, 1, 100, false);
+
+    m_tileCacheSize = createIntegerParameter(*this, "Tile Cache (MB)",
+        "Memory used to keep decoded image tiles between runs, so boxes dropped on the same image are saved faster",
+        512, 16, 16384, false);
+
+    m_prefetchTiles = createIntegerParameter(*this, "Prefetch Tiles",
+        "Number of tiles read into the tile cache ahead of the export on a background thread, so that reading the slide overlaps compositing and encoding. 0 turns prefetching off.",
+        TilePrefetcher::DefaultLookAhead, 0, 1024, false);
+
     //Allow the user to choose where to save the image files
     sedeen::file::FileDialogOptions saveFileDialogOptions = defineSaveFileDialogOptions();
     m_saveFileAs = createSaveFileDialogParameter(*this, "Save As...",
-        "The output image will be saved to this file name. If the file name includes an extension of type TIF/PNG/BMP/GIF/JPG, it will be saved as that type (.tif is the default).",
+        "The output image will be saved to this file name. If the file name includes an extension of type TIF/PNG/BMP/GIF/JPG, it will be saved as that type (.tif is the default). With the extension .bdpatch, every box is appended to a sharded patch dataset for training loaders instead.",
         saveFileDialogOptions, true);
 
+    //Allow the user to collect the timings of every run in one file
+    sedeen::file::FileDialogOptions timingLogDialogOptions = defineTimingLogDialogOptions();
+    m_timingLog = createSaveFileDialogParameter(*this, "Timing Log",
+        "Optional. The time spent in each stage of every run is appended to this file, as CSV, or as one JSON object per line if the extension is .json.",
+        timingLogDialogOptions, true);
+
 	m_output_text = createTextResult(*this, "text Result");
-	// Default number of regions to place along the narrowest dimension.
-	//const auto DEFAULT_NUM_REGIONS = 8;
-	//const auto DEFAULT_SPACING = min_dim / DEFAULT_NUM_REGIONS;
+
+	m_intermediate_result = createImageResult(*this, "Box Preview");
 
 	m_results = createOverlayResult(*this);
 }
 
-bool BoxDrop::buildPipeline()
+bool BoxDrop::buildPipeline(SessionTransaction &session)
 {
 	using namespace image::tile;
 	bool pipelineChanged = false;
-	std::string path_to_image = 
-	    image()->getMetaData()->get(image::StringTags::SOURCE_DESCRIPTION,0);
-	Session s(path_to_image);
-		auto b = s.loadFromFile();
-		auto p = s.imagePath();
-	if (m_region_toProcess.isUserDefined())
+    const bool randomSampling = (m_placementMode == RandomSampling);
+    const bool wholeImage = randomSampling && (m_sampleWholeImage == true);
+    const int regionSource = m_regionSource;
+	m_boxes.clear();
+	m_neighbours.clear();
+	m_regionsProcessed = 0;
+	m_latticeWorkingSet = 0;
+	const auto &graphics = session.graphics();
+	std::vector<BoxRegion> regions;
+	if ((regionSource == ProcessingRegion) || wholeImage)
 	{
-		std::shared_ptr<GraphicItemBase> region = m_region_toProcess;
-		auto rect = containingRect(region->graphic());
-		auto xmin = rect.x();
-		auto ymin = rect.y();
-		auto xmax = xMax(rect);
-		auto ymax = yMax(rect);
-		xCenter = (xmin+xmax)/2;
-		yCenter = (ymin+ymax)/2;
-		auto xTopLeft = xCenter-m_size/2;
-		auto yTopLeft = yCenter-m_size/2;
-
-		auto graphics = s.getGraphics();
-		auto numberOfOverlays = graphics.size();
-		auto points = graphics[numberOfOverlays-1].getPoints();
-		m_style = graphics[numberOfOverlays-1].getStyle();
-		m_name = graphics[numberOfOverlays-1].getName();
-		point = static_cast<int>(points[0][0].getX());
-		m_rect = Rectangle(xTopLeft,yTopLeft,m_size,m_size,0,Center);
-		GraphicDescription graph;
-		std::string text = m_text;
-        //This was originally "Cellularity: ", and was a prefix 
-        //to all descriptions created by this plugin
-		//text = "BoxDrop: "+text;
-
-		graph.setDescription(text.c_str());
-		graph.setName(m_name.c_str());
-		graph.setStyle(m_style);
-		graph.setGeometry(graphics[numberOfOverlays-1].getGeometry());
-		std::vector<std::vector<PointF>> newPoints;
-		PointF p;
-		std::vector<PointF> vectorP;
-		p.setX(xTopLeft);
-		p.setY(yTopLeft);
-		vectorP.push_back(p);
-		p.setX(xTopLeft+m_size);
-		p.setY(yTopLeft);
-		vectorP.push_back(p);
-		p.setX(xTopLeft+m_size);
-		p.setY(yTopLeft+m_size);
-		vectorP.push_back(p);
-		p.setX(xTopLeft);
-		p.setY(yTopLeft+m_size);
-		vectorP.push_back(p);
-
-		newPoints.push_back(vectorP);
-		graph.setPoints(newPoints);
-		graphics.push_back(graph);
-
-		s.setGraphics(graphics);
+		if (m_region_toProcess.isUserDefined() || wholeImage)
+		{
+			//The most recently drawn graphic is the processing ROI; the boxes copy its name and style
+			BoxRegion region{ BoxRect(), AnnotationIndex::npos, "Random Box" };
+			if (m_region_toProcess.isUserDefined() && !graphics.empty())
+			{
+				auto points = graphics.back().getPoints();
+				point = static_cast<int>(points[0][0].getX());
+				region.position = graphics.size() - 1;
+				region.name = graphics.back().getName();
+
+				std::shared_ptr<GraphicItemBase> roi = m_region_toProcess;
+				auto rect = containingRect(roi->graphic());
+				region.bounds = BoxRect(rect.x(), rect.y(), rect.width(), rect.height());
+			}
+			if (wholeImage)
+			{
+				auto dims = getDimensions(image(), 0);
+				region.bounds = BoxRect(0, 0, dims.width(), dims.height());
+			}
+			regions.push_back(region);
+		}
+	}
+	else if (regionSource == RegionListSource)
+	{
+		//Each selected region is matched to its annotation, whose name and style the boxes take
+		std::vector<std::shared_ptr<GraphicItemBase>> items = m_regionList;
+		for (size_t i = 0; i < items.size(); ++i)
+		{
+			if (!items[i]) { continue; }
+			auto rect = containingRect(items[i]->graphic());
+			regions.push_back(regionWithBounds(session, BoxRect(rect.x(), rect.y(), rect.width(), rect.height()),
+				"Region " + std::to_string(i + 1)));
+		}
+	}
+	else
+	{
+		std::string filter = m_regionNameFilter;
+		regions = regionsMatching(session, filter);
+	}
+	if (regions.empty())
+	{
+		return false;
+	}
+	m_regionsProcessed = regions.size();
+	m_name = regions.back().name;
+	m_style = (regions.back().position < graphics.size()) ? graphics[regions.back().position].getStyle() : GraphicStyle();
+
+	//A centred box takes the place of the graphic it was made from, if that is a placeholder.
+	//That graphic is also left out of the overlap checks, since the boxes lie inside it.
+	const BoxSpec spec = boxSpec();
+	const bool screensTissue = (spec.randomSampling || spec.lattice) && (spec.minTissueFraction > 0.0);
+	const TissueMask *mask = screensTissue ? &tissueMask() : nullptr;
+	m_tissueRejections = 0;
+	m_overlapRejections = 0;
+	AnnotationJournal *journal = (m_annotationStorage == JournalStorage) ? &m_journal : nullptr;
+	m_boxes = dropBoxesOnRegions(session, spec, regions, mask, journal, m_journalRecords,
+		&m_tissueRejections, &m_overlapRejections);
+	//A lattice is exported in row-major order; the cache must hold a band of tiles across it
+	std::vector<BoxRect> rects;
+	for (auto it = m_boxes.begin(); it != m_boxes.end(); ++it) { rects.push_back(it->rect); }
+	m_latticeWorkingSet = spec.lattice ? latticeWorkingSetBytes(rects, TileSource::DefaultCellSize) : 0;
+	if (!m_boxes.empty())
+	{
+		const BoxRect &last = m_boxes.back().rect;
+		xCenter = last.x + last.width / 2;
+		yCenter = last.y + last.height / 2;
+		m_rect = Rectangle(last.x, last.y, last.width, last.height, 0, Center);
 		pipelineChanged = true;
+
+		//Report the annotations closest to the last box, other than the box itself and its region
+		const int NeighbourCount = 3;
+		auto nearest = session.spatialIndex().nearest(last, NeighbourCount + 1, regions.back().position);
+		for (auto it = nearest.begin(); (it != nearest.end()) && (m_neighbours.size() < static_cast<size_t>(NeighbourCount)); ++it)
+		{
+			const bool isLastBox = (it->box.x == last.x) && (it->box.y == last.y)
+				&& (it->box.width == last.width) && (it->box.height == last.height);
+			if (!isLastBox)
+			{
+				m_neighbours.push_back(std::make_pair(graphics[it->id].getName(), it->distance));
+			}
+		}
 	}
-	s.saveToFile();
 	return pipelineChanged;
 }
 
+BoxSpec BoxDrop::boxSpec() const
+{
+    BoxSpec spec;
+    spec.randomSampling = (m_placementMode == RandomSampling);
+    spec.lattice = (m_placementMode == LatticeTiling);
+    spec.latticeStride = m_latticeStride;
+    spec.boxSize = m_size;
+    spec.count = m_numberOfBoxes;
+    int seed = m_randomSeed;
+    spec.seed = static_cast<uint64_t>(seed);
+    spec.spacing = m_boxSpacing;
+    spec.minTissueFraction = m_minTissueFraction;
+    spec.maxOverlapFraction = m_maxOverlapFraction;
+    //This was originally "Cellularity: ", and was a prefix 
+    //to all descriptions created by this plugin
+    //text = "BoxDrop: "+text;
+    std::string text = m_text;
+    spec.description = text;
+    //The grid of the tile cache, which is also the tile size of exported TIF images
+    spec.snapGrid = (m_snapToTiles == true) ? TileSource::DefaultCellSize : 0;
+    return spec;
+}//end boxSpec
+
+ExportProfile BoxDrop::exportProfile(int boxesInFlight) const
+{
+    ExportProfile profile;
+    int compressionIndex = m_tiffCompression;
+    if ((compressionIndex >= 0) && (compressionIndex < static_cast<int>(m_compressionValues.size()))) {
+        profile.compression = m_compressionValues[compressionIndex];
+    }
+    profile.jpegQuality = m_jpegQuality;
+    //Threads left over when there are fewer boxes than export threads compress the tiles of each box
+    int threads = m_exportThreads;
+    profile.encodeThreads = std::max(1, threads / std::max(1, std::min(threads, boxesInFlight)));
+    return profile;
+}//end exportProfile
+
 void BoxDrop::run()
 {
 	using namespace image::tile;
-    auto source_factory = image()->getFactory();
     //assemble the final report that will go to the output window
     std::string final_report_text("");
+    const auto runStart = std::chrono::steady_clock::now();
+    m_profile.reset();
+    m_exportProfileName.clear();
+    m_journalRecords.clear();
+    m_journalCompacted = -1;
+    m_previewLevel = -1;
+    m_boxStatistics.clear();
+    m_statisticsTablePath.clear();
+    m_boxesKept = 0;
+    m_boxesLinked = 0;
+    m_exportStatistics = ExportEngine::Statistics();
+    m_tileCacheStatistics = TileCache::Statistics();
 
     //Check whether any of the GUI controls changed
     bool guiControlsChanged(false);
     guiControlsChanged = (m_text.isChanged()
         || m_region_toProcess.isChanged()
+        || m_regionSource.isChanged()
+        || m_regionList.isChanged()
+        || m_regionNameFilter.isChanged()
+        || m_size.isChanged()
+        || m_placementMode.isChanged()
+        || m_numberOfBoxes.isChanged()
+        || m_latticeStride.isChanged()
+        || m_randomSeed.isChanged()
+        || m_boxSpacing.isChanged()
+        || m_minTissueFraction.isChanged()
+        || m_maxOverlapFraction.isChanged()
+        || m_sampleWholeImage.isChanged()
+        || m_snapToTiles.isChanged()
+        || m_annotationStorage.isChanged()
         || m_saveOutputImage.isChanged()
+        || m_exportScales.isChanged()
+        || m_saveStatistics.isChanged()
+        || m_reuseExports.isChanged()
+        || m_exportThreads.isChanged()
+        || m_tiffCompression.isChanged()
+        || m_jpegQuality.isChanged()
         || m_saveFileAs.isChanged()
         || (nullptr == m_cached_output_factory) );
 
+    std::string path_to_image = 
+	    image()->getMetaData()->get(image::StringTags::SOURCE_DESCRIPTION,0);
+    updateImageCaches(path_to_image);
+    m_journal.open(path_to_image);
+
+    //Load the session once. The new boxes replace the graphics they were made from
+    //in memory, and the session file is written at most once.
+    SessionTransaction session(path_to_image, m_annotationIndex);
+    {
+        ScopedStageTimer timer(&m_profile, RunProfile::SessionLoad);
+        session.load();
+    }
+
     //The pipeline uses the center of the m_region_toProcess to define a rectangle
-	auto pipeline_changed = buildPipeline();
+    bool pipeline_changed = false;
+    {
+        ScopedStageTimer timer(&m_profile, RunProfile::BoxPlacement);
+        pipeline_changed = buildPipeline(session);
+    }
+    //Preview the boxes before the session is saved and the images are exported
+    if (pipeline_changed && guiControlsChanged) {
+        updateIntermediateResult();
+    }
+
+	xCenter = static_cast<int>(session.graphics().size());
+
+    //Save the new annotations to the session file, skipped if nothing changed, or append them
+    //to the journal. The journal is written to the session when asked, when it reaches the
+    //threshold, or when the storage is switched back to the session file.
+    bool sessionSaved = true;
+    bool journalSaved = true;
+    {
+        ScopedStageTimer timer(&m_profile, RunProfile::SessionSave);
+        const bool journalMode = (m_annotationStorage == JournalStorage);
+        if (journalMode) {
+            journalSaved = m_journal.append(m_journalRecords);
+        }
+        int threshold = m_journalThreshold;
+        const size_t journalled = m_journal.recordCount();
+        if ((journalled > 0) && (!journalMode || (m_compactJournal == true)
+            || (journalled >= static_cast<size_t>(threshold)))) {
+            int applied = 0;
+            sessionSaved = m_journal.compactInto(session, &applied);
+            if (sessionSaved) { m_journalCompacted = applied; }
+        }
+        else {
+            sessionSaved = session.commit();
+        }
+        m_journalPending = m_journal.recordCount();
+    }
+    if (!sessionSaved) {
+        final_report_text.append("The session file could not be saved. Please check the permissions of the image directory.\n");
+    }
+    if (!journalSaved) {
+        final_report_text.append("The annotation journal " + m_journal.filePath() + " could not be written.\n");
+    }
+
 	if (pipeline_changed && guiControlsChanged)
 	{
         std::string text = m_text;
         //This was originally "Cellularity: ", and was a prefix 
         //to all descriptions created by this plugin
         //text = "BoxDrop: "+text;
-        m_results.drawRectangle(m_rect, m_style, m_name, text);
+        for (auto it = m_boxes.begin(); it != m_boxes.end(); ++it) {
+            const BoxRect &box = it->rect;
+            m_results.drawRectangle(Rectangle(box.x, box.y, box.width, box.height, 0, Center),
+                m_style, it->name, text);
+        }
         m_results.setVisible(true);
-        //updateIntermediateResult();
 
-        //Put the source_factory into a cache and set the output factory
-        SetOutputFactory(std::make_shared<Cache>(source_factory, RecentCachePolicy(30)));
-        
+
         //Check whether the user wants to write to image files, that the field is not blank,
-        //and that the file can be created or written to
+        //and that the file can be created or written to. The annotations are already saved,
+        //so a problem with the file is reported with the rest of the run instead of ending it.
         std::string outputFilePath;
+        std::string saveError;
+        const int numberOfBoxes = static_cast<int>(m_boxes.size());
+        //Every box of a patch dataset is appended to the one file chosen, instead of its own file
+        bool datasetOutput = false;
         if (m_saveOutputImage == true) {
             //Get the full path file name from the file dialog parameter
             sedeen::algorithm::parameter::SaveFileDialog::DataType fileDialogDataType = this->m_saveFileAs;
             outputFilePath = fileDialogDataType.getFilename();
             //Is the file field blank?
             if (outputFilePath.empty()) {
-                m_output_text.sendText("The filename is blank. Please choose a file to save the image to, or uncheck Save Image.");
-                return;
+                saveError = "The filename is blank. Please choose a file to save the image to, or uncheck Save Image.\n";
             }
             //Does it exist or can it be created, and can it be written to?
-            bool validFileCheck = checkFile(outputFilePath, "w");
-            if (!validFileCheck) {
-                m_output_text.sendText("The file name selected cannot be written to. Please choose another, or check the permissions of the directory.");
-                return;
+            else if (!checkFile(outputFilePath, "w")) {
+                saveError = "The file name selected cannot be written to. Please choose another, or check the permissions of the directory.\n";
             }
             //Does it have a valid extension? RawImage.save relies on the extension to determine save format
-            std::string theExt = getExtension(outputFilePath);
-            int extensionIndex = findExtensionIndex(theExt);
             //findExtensionIndex returns -1 if not found
-            if (extensionIndex == -1) {
+            else if (findExtensionIndex(getExtension(outputFilePath)) == -1) {
                 std::stringstream ss;
                 ss << "The extension of the file is not a valid type. The file extension must be: ";
                 auto vec = m_saveFileExtensionText;
@@ -247,75 +572,238 @@ void BoxDrop::run()
                 }
                 std::string last = vec.back();
                 ss << "or " << last << ". Choose a correct file type and try again." << std::endl;
-                m_output_text.sendText(ss.str());
-                return;
+                saveError = ss.str();
             }
-
+            else {
+                m_exportProfile = exportProfile(numberOfBoxes);
+                m_exportProfileName = exportProfileName(m_exportProfile, outputFilePath);
+                datasetOutput = PatchDataset::isDatasetPath(outputFilePath);
+            }
+            if (saveError.empty() && datasetOutput) {
+                //Deflate is the only TIF compression light enough for training loaders; others store raw pixels
+                const PatchDataset::Encoding encoding = (m_exportProfile.compression == TileCodec::Deflate)
+                    ? PatchDataset::Deflate : PatchDataset::Raw;
+                m_exportProfileName = std::string("Patch dataset, ") + PatchDataset::name(encoding);
+                if (!m_patchDataset.open(outputFilePath, encoding)) {
+                    saveError = "The patch dataset " + outputFilePath + " could not be opened. Please check the permissions of the directory.\n";
+                }
+            }
+        }
+        if (!saveError.empty()) {
+            //Nothing was exported, so the report has no export profile to show
+            m_exportProfileName.clear();
+            final_report_text.append(saveError + "\n");
+        }
+        else if (m_saveOutputImage == true) {
             std::stringstream fileSaveUpdate;
-            fileSaveUpdate << "Image saving in progress." << std::endl;
-            fileSaveUpdate << "Saving image as " << outputFilePath << std::endl;
-            m_output_text.sendText(fileSaveUpdate.str());
-    
-            //Save the image within the new rectangle
-            bool saveResult = SaveFlatImageToFile(outputFilePath);
+            std::vector<std::string> boxFilePaths;
+            std::vector<BoxRect> boxRects;
+            ExportMonitor monitor;
+            const bool saveStatistics = (m_saveStatistics == true);
+            std::vector<StatisticsRecord> statistics(saveStatistics ? numberOfBoxes : 0);
+            for (int i = 0; i < numberOfBoxes; ++i) {
+                boxFilePaths.push_back(datasetOutput ? outputFilePath : numberedFilePath(outputFilePath, i, numberOfBoxes));
+                if (saveStatistics) {
+                    statistics[i].file = boxFilePaths.back();
+                    statistics[i].name = m_boxes[i].name;
+                    statistics[i].box = m_boxes[i].rect;
+                }
+            }
+
+            //A box whose pixels are in a file of an earlier export that is unchanged since, under
+            //its own name or another in the same directory, is kept or linked instead of saved again.
+            //The description is not part of the key: a new one only rewrote the annotation above.
+            namespace fs = std::filesystem; //an alias
+            const bool reuseExports = !datasetOutput && (m_reuseExports == true);
+            if (reuseExports) { m_exportManifest.open(outputFilePath); }
+            int extraLevels = m_exportScales;
+            std::vector<std::string> exportKeys(numberOfBoxes);
+            std::vector<std::string> reusedFrom(numberOfBoxes);
+            std::vector<size_t> pending;
+            std::vector<std::string> pendingPaths;
+            for (int i = 0; i < numberOfBoxes; ++i) {
+                ExportManifest::Entry entry;
+                if (reuseExports) {
+                    exportKeys[i] = exportKey(path_to_image, m_boxes[i].rect, extraLevels, boxFilePaths[i], m_exportProfile);
+                }
+                //A file saved without statistics is not reused when they are asked for
+                if (reuseExports && m_exportManifest.find(exportKeys[i], boxFilePaths[i], entry)
+                    && (!saveStatistics || !entry.statistics.empty())) {
+                    const bool kept = fs::path(entry.path).filename() == fs::path(boxFilePaths[i]).filename();
+                    if (kept || (ExportManifest::linkFile(entry, boxFilePaths[i])
+                        && m_exportManifest.record(exportKeys[i], boxFilePaths[i], entry.statistics))) {
+                        reusedFrom[i] = entry.path;
+                        if (saveStatistics) { statistics[i].values = entry.statistics; }
+                        ++(kept ? m_boxesKept : m_boxesLinked);
+                        continue;
+                    }
+                }
+                pending.push_back(i);
+                pendingPaths.push_back(boxFilePaths[i]);
+                monitor.addPlanned(exportChunkCount(m_boxes[i].rect, boxFilePaths[i]));
+                boxRects.push_back(m_boxes[i].rect);
+            }
+            m_profile.add(RunProfile::BoxesReused, m_boxesKept + m_boxesLinked);
+
+            //The annotations are already saved and drawn: tell the user before the pixels are written
+            std::stringstream startUpdate;
+            startUpdate << final_report_text << m_boxes.size() << " box(es) added to the session." << std::endl;
+            startUpdate << "Saving " << pending.size() << " image(s) as " << outputFilePath << "..." << std::endl;
+            if (m_boxesKept + m_boxesLinked > 0) {
+                startUpdate << (m_boxesKept + m_boxesLinked) << " image(s) saved by an earlier run are reused." << std::endl;
+            }
+            m_output_text.sendText(startUpdate.str());
+
+            //Compose and encode the boxes on a pool of background workers sharing the cached
+            //output factory. This thread only reports progress and watches for an abort, which
+            //stops the workers at their next tile; unfinished files are removed.
+            ExportEngine engine(m_exportThreads);
+            engine.setMonitor(&monitor);
+            engine.setWaitClock(&TileSource::threadWaitSeconds);
+            const std::string description = m_text;
+            auto saveBox = [&](size_t task) {
+                const size_t i = pending[task];
+                BoxStatistics *boxStatistics = saveStatistics ? &statistics[i].statistics : nullptr;
+                if (datasetOutput) {
+                    const PatchDataset::Record record{ path_to_image, m_boxes[i].rect, m_boxes[i].name, description };
+                    return m_patchDataset.append(*m_tile_source, record, &monitor, boxStatistics);
+                }
+                return SaveFlatImageToFile(boxFilePaths[i], m_boxes[i].rect, &monitor, boxStatistics);
+            };
+            auto reportProgress = [&](size_t done, size_t total) {
+                std::stringstream progressUpdate;
+                progressUpdate << "Image saving in progress." << std::endl;
+                progressUpdate << "Saved " << done << " of " << total << " images as " << outputFilePath << std::endl;
+                progressUpdate << "Tiles written: " << monitor.chunksDone() << " of " << monitor.chunksPlanned()
+                    << " (" << std::fixed << std::setprecision(0) << 100.0 * monitor.fractionDone() << "%)" << std::endl;
+                m_output_text.sendText(progressUpdate.str());
+                return !askedToStop();
+            };
+            //Read the tiles the boxes need, in the order the workers use them, on a background
+            //thread a bounded distance ahead of them, so that decoding overlaps compositing and encoding
+            int prefetchTiles = m_prefetchTiles;
+            TilePrefetcher prefetcher(m_tile_source, prefetchTiles);
+            if (prefetchTiles > 0) {
+                m_tile_source->setPrefetcher(&prefetcher);
+                prefetcher.start(exportCellPlan(*m_tile_source, boxRects, pendingPaths));
+            }
+            std::vector<int> saveResults(numberOfBoxes, ExportEngine::NotRun);
+            {
+                ScopedStageTimer timer(&m_profile, RunProfile::Export);
+                const std::vector<int> taskResults = engine.run(pending.size(), saveBox, reportProgress);
+                for (size_t task = 0; task < pending.size(); ++task) { saveResults[pending[task]] = taskResults[task]; }
+            }
+            prefetcher.stop();
+            m_tile_source->setPrefetcher(nullptr);
+            m_profile.add(RunProfile::TilesPrefetched, prefetcher.cellsPrefetched());
+            m_exportStatistics = engine.statistics();
+            m_tileCacheStatistics = m_tile_cache->statistics();
+            m_profile.add(RunProfile::BoxesExported, m_exportStatistics.succeeded);
+            m_profile.add(RunProfile::CacheHits, static_cast<int64_t>(m_tileCacheStatistics.hits));
+            m_profile.add(RunProfile::CacheMisses, static_cast<int64_t>(m_tileCacheStatistics.misses));
+
             //Check whether saving was successful
-            std::stringstream ss;
-            if (saveResult) {
-                fileSaveUpdate << std::endl << "Image saved as " << outputFilePath << std::endl;
+            if (monitor.isCancelled()) {
+                fileSaveUpdate << "Saving was stopped. Images that were not complete have been removed." << std::endl;
             }
-            else {
-                fileSaveUpdate << std::endl << "Saving the image failed. Please check the file name and directory permissions." << std::endl;
+            bool manifestSaved = true;
+            for (int i = 0; i < numberOfBoxes; ++i) {
+                if (!reusedFrom[i].empty() && (fs::path(reusedFrom[i]).filename() == fs::path(boxFilePaths[i]).filename())) {
+                    fileSaveUpdate << "Image unchanged: " << boxFilePaths[i] << std::endl;
+                }
+                else if (!reusedFrom[i].empty()) {
+                    fileSaveUpdate << "Image linked to " << reusedFrom[i] << ": " << boxFilePaths[i] << std::endl;
+                }
+                else if ((saveResults[i] == ExportEngine::Succeeded) && datasetOutput) {
+                    fileSaveUpdate << m_boxes[i].name << " appended to " << outputFilePath << std::endl;
+                }
+                else if (saveResults[i] == ExportEngine::Succeeded) {
+                    fileSaveUpdate << "Image saved as " << boxFilePaths[i] << std::endl;
+                    //Recorded only once complete, so that an interrupted export is resumed
+                    if (reuseExports) {
+                        manifestSaved = m_exportManifest.record(exportKeys[i], boxFilePaths[i],
+                            saveStatistics ? statistics[i].statistics.csvValues() : std::string()) && manifestSaved;
+                    }
+                }
+                else if ((saveResults[i] == ExportEngine::Failed) && !monitor.isCancelled()) {
+                    fileSaveUpdate << "Saving " << boxFilePaths[i] << " failed. Please check the file name and directory permissions." << std::endl;
+                }
+            }
+            if (!manifestSaved) {
+                fileSaveUpdate << "The export manifest " << m_exportManifest.filePath() << " could not be written." << std::endl;
             }
+            //The statistics of the saved boxes replace the table of the last export, or are added to
+            //the table of a dataset, which keeps the boxes of earlier runs. Kept and linked boxes
+            //bring the statistics recorded when they were first saved.
+            for (int i = 0; saveStatistics && (i < numberOfBoxes); ++i) {
+                if ((saveResults[i] == ExportEngine::Succeeded) || !reusedFrom[i].empty()) {
+                    m_boxStatistics.push_back(statistics[i]);
+                }
+            }
+            if (!m_boxStatistics.empty()) {
+                const std::string tablePath = statisticsTablePath(outputFilePath);
+                if (saveStatisticsTable(tablePath, m_boxStatistics, datasetOutput)) {
+                    m_statisticsTablePath = tablePath;
+                }
+                else {
+                    fileSaveUpdate << "The box statistics could not be written to " << tablePath << "." << std::endl;
+                }
+            }
+            fileSaveUpdate << std::endl;
             final_report_text.append(fileSaveUpdate.str());
         }    
     }
 
-    //Save the new annotation to the session file
-    std::string path_to_image = 
-	    image()->getMetaData()->get(image::StringTags::SOURCE_DESCRIPTION,0);
-	Session s(path_to_image);
-	auto b = s.loadFromFile();
-	auto p = s.imagePath();	
-	auto graphics = s.getGraphics();
-	auto numberOfOverlays =graphics.size();
-	std::vector<sedeen::GraphicDescription> newGraphics;
-	int i = 0;
-	while(i<numberOfOverlays)
-	{
-		if(i<numberOfOverlays-1)
-		{
-			if((std::string(graphics[i].getDescription()).empty()) &&
-				std::strcmp(graphics[i].getName(),graphics[i+1].getName())==0)
-                //This was originally "Cellularity: ", and was a prefix 
-                //to all descriptions created by this plugin
-                //&& std::string(graphics[i+1].getDescription()).find("BoxDrop:")!=std::string::npos)
-			{
-				i++;
-			}
-		}
-		newGraphics.push_back(graphics[i]);
-		i++;
-	}
-	xCenter = static_cast<int>(numberOfOverlays);
-	s.setGraphics(newGraphics);
-	s.saveToFile();
+    m_profile.addTime(RunProfile::Total, std::chrono::steady_clock::now() - runStart);
 	auto report = generateReport();
     final_report_text.append(report);
 
-	m_output_text.sendText(final_report_text);
-
-	//updateIntermediateResult();
+    //Append the timings to the log file, if one was chosen
+    sedeen::algorithm::parameter::SaveFileDialog::DataType timingLogDataType = this->m_timingLog;
+    const std::string timingLogPath = timingLogDataType.getFilename();
+    if (!timingLogPath.empty() && !m_profile.appendToLog(timingLogPath, path_to_image)) {
+        final_report_text.append("The timing log could not be written to " + timingLogPath
+            + ". A CSV log must be new or have the columns of this version of the plugin.\n");
+    }
 
-    //kludge. Trying it.
-    Session reload_s(path_to_image);
-    reload_s.loadFromFile();
+	m_output_text.sendText(final_report_text);
 
     //Ensure that the plugin can run again after user Abort
     if (askedToStop()) {
         m_cached_output_factory.reset();
+        m_tile_source.reset();
     }
 }//end run
 
+void BoxDrop::updateImageCaches(const std::string &path_to_image)
+{
+    using namespace image::tile;
+    //Keep one cached factory, one tile cache and one tissue mask per image for as long as
+    //the image is open, so that repeated box drops reuse what earlier runs decoded
+    const size_t cacheBytes = static_cast<size_t>(static_cast<int>(m_tileCacheSize)) << 20;
+    if (!m_tile_cache || (m_tile_cache_image != path_to_image)) {
+        m_tile_cache = std::make_shared<TileCache>(cacheBytes);
+        m_tile_cache_image = path_to_image;
+        m_cached_output_factory.reset();
+        m_tissue_mask.reset();
+    }
+    m_tile_cache->setCapacity(cacheBytes);
+    m_tile_cache->resetCounters();
+    if (nullptr == m_cached_output_factory) {
+        //Put the source_factory into a cache and set the output factory
+        auto source_factory = image()->getFactory();
+        SetOutputFactory(std::make_shared<Cache>(source_factory, RecentCachePolicy(30)));
+    }
+}//end updateImageCaches
+
+const TissueMask &BoxDrop::tissueMask()
+{
+    if (!m_tissue_mask) {
+        m_tissue_mask = buildTissueMask(*m_tile_source, getDimensions(image(), 0));
+    }
+    return *m_tissue_mask;
+}//end tissueMask
+
 std::string BoxDrop::generateReport() const
 {
 	std::ostringstream ss;
@@ -324,31 +812,193 @@ std::string BoxDrop::generateReport() const
 	ss<<std::left<<std::setfill(' ')<<std::setw(20);
 	ss<<"Processed Box:"<<std::fixed<<std::setprecision(1)<<m_name<<xCenter;
 	ss<<std::endl;
+    if (m_exportStatistics.tasks > 0) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Export Throughput:" << std::setprecision(2) << m_exportStatistics.tasksPerSecond()
+            << " boxes/s" << std::endl;
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Parallel Speedup:" << std::setprecision(2) << m_exportStatistics.speedup()
+            << "x on " << m_exportStatistics.threads << " threads" << std::endl;
+    }
+    if (m_tileCacheStatistics.hits + m_tileCacheStatistics.misses > 0) {
+        const double MB = 1024.0 * 1024.0;
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Tile Cache:" << m_tileCacheStatistics.hits << " hits, "
+            << m_tileCacheStatistics.misses << " misses, "
+            << m_tileCacheStatistics.evictions << " evictions ("
+            << std::setprecision(1) << 100.0 * m_tileCacheStatistics.hitRate() << "% hit rate)" << std::endl;
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Tile Cache Size:" << std::setprecision(1) << m_tileCacheStatistics.bytes / MB << " of "
+            << m_tileCacheStatistics.capacityBytes / MB << " MB in "
+            << m_tileCacheStatistics.entries << " tiles" << std::endl;
+    }
+    //Time spent in each stage. Compositing and encoding add up the time of all export workers.
+    const RunProfile::Stage stages[] = { RunProfile::SessionLoad, RunProfile::BoxPlacement,
+        RunProfile::SessionSave, RunProfile::Export, RunProfile::Compositing, RunProfile::Encoding,
+        RunProfile::Total };
+    const char *stageLabels[] = { "Session Load:", "Box Placement:", "Session Save:", "Export:",
+        "  Compositing:", "  Encoding:", "Total Time:" };
+    for (size_t s = 0; s < sizeof(stages) / sizeof(stages[0]); ++s) {
+        if ((m_profile.calls(stages[s]) == 0) && (stages[s] != RunProfile::Total)) { continue; }
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << stageLabels[s] << std::setprecision(3) << m_profile.seconds(stages[s]) << " s" << std::endl;
+    }
+    if (m_profile.count(RunProfile::TilesFetched) > 0) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Tiles Fetched:" << m_profile.count(RunProfile::TilesFetched) << std::endl;
+    }
+    if (m_profile.count(RunProfile::TilesPrefetched) > 0) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Tiles Prefetched:" << m_profile.count(RunProfile::TilesPrefetched) << std::endl;
+    }
+    if (m_profile.count(RunProfile::BoxesReused) > 0) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Boxes Reused:" << m_boxesKept << " unchanged, " << m_boxesLinked << " linked" << std::endl;
+    }
+    if (m_profile.count(RunProfile::AlignedTiles) > 0) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Aligned Tiles:" << m_profile.count(RunProfile::AlignedTiles)
+            << " encoded from cached tiles without compositing" << std::endl;
+    }
+    if (m_profile.count(RunProfile::BytesWritten) > 0) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Bytes Written:" << std::setprecision(1)
+            << m_profile.count(RunProfile::BytesWritten) / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+    if (!m_exportProfileName.empty()) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Export Profile:" << m_exportProfileName << ", "
+            << m_exportProfile.encodeThreads << " encode thread(s) per box" << std::endl;
+    }
+    //Pixels compressed per second of export, and how much smaller the files are than the pixels
+    const int64_t bytesEncoded = m_profile.count(RunProfile::BytesEncoded);
+    if ((bytesEncoded > 0) && (m_profile.seconds(RunProfile::Export) > 0.0)) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Encode Throughput:" << std::setprecision(1)
+            << bytesEncoded / (1024.0 * 1024.0) / m_profile.seconds(RunProfile::Export) << " MB/s of pixels, "
+            << std::setprecision(2) << static_cast<double>(bytesEncoded) / std::max<int64_t>(1, m_profile.count(RunProfile::BytesWritten))
+            << ":1 compression" << std::endl;
+    }
+    if (m_journalCompacted >= 0) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Journal Compacted:" << m_journalCompacted << " box(es) written to the session" << std::endl;
+    }
+    else if (m_annotationStorage == JournalStorage) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Journal:" << m_journalRecords.size() << " box(es) appended, "
+            << m_journalPending << " waiting for compaction" << std::endl;
+    }
+    if (m_regionSource != ProcessingRegion) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Regions Processed:" << m_regionsProcessed << std::endl;
+    }
+    if (m_placementMode == RandomSampling) {
+        int seed = m_randomSeed;
+        int requested = m_numberOfBoxes;
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Boxes Placed:" << m_boxes.size() << " of " << requested << std::endl;
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Random Seed:" << seed << std::endl;
+        if (m_tissueRejections > 0) {
+            ss << std::left << std::setfill(' ') << std::setw(20);
+            ss << "Glass Rejections:" << m_tissueRejections << std::endl;
+        }
+    }
+    if (m_placementMode == LatticeTiling) {
+        int stride = m_latticeStride;
+        int size = m_size;
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Lattice Boxes:" << m_boxes.size() << ", stride " << ((stride > 0) ? stride : size) << " px" << std::endl;
+        if (m_tissueRejections > 0) {
+            ss << std::left << std::setfill(' ') << std::setw(20);
+            ss << "Glass Rejections:" << m_tissueRejections << std::endl;
+        }
+        //Below the working set, tiles shared by neighbouring boxes may be decoded more than once
+        const double MB = 1024.0 * 1024.0;
+        int cacheMegabytes = m_tileCacheSize;
+        if (m_latticeWorkingSet > static_cast<int64_t>(cacheMegabytes) * (1 << 20)) {
+            ss << std::left << std::setfill(' ') << std::setw(20);
+            ss << "Lattice Cache:" << std::setprecision(0) << m_latticeWorkingSet / MB
+                << " MB needed to decode each tile once; raise Tile Cache (MB)" << std::endl;
+        }
+    }
+    if (m_overlapRejections > 0) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Overlap Rejections:" << m_overlapRejections << std::endl;
+    }
+    for (size_t i = 0; i < m_neighbours.size(); ++i) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << ((i == 0) ? "Nearest Annotations:" : "") << m_neighbours[i].first << " ("
+            << std::setprecision(0) << m_neighbours[i].second << " px away)" << std::endl;
+    }
+    //Pooled over the boxes saved by this run, with the least sharp box singled out for review.
+    //Reused boxes only have the columns of the table.
+    BoxStatistics pooled;
+    auto leastSharp = m_boxStatistics.end();
+    for (auto it = m_boxStatistics.begin(); it != m_boxStatistics.end(); ++it) {
+        if (!it->values.empty()) { continue; }
+        pooled.merge(it->statistics);
+        if ((leastSharp == m_boxStatistics.end())
+            || (it->statistics.laplacianVariance() < leastSharp->statistics.laplacianVariance())) { leastSharp = it; }
+    }
+    if (leastSharp != m_boxStatistics.end()) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Mean RGB:" << std::setprecision(1) << pooled.mean(0) << ", " << pooled.mean(1) << ", "
+            << pooled.mean(2) << " (std " << pooled.standardDeviation(0) << ", " << pooled.standardDeviation(1)
+            << ", " << pooled.standardDeviation(2) << ")" << std::endl;
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Background:" << std::setprecision(1) << 100.0 * pooled.backgroundFraction() << "%" << std::endl;
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Least Sharp Box:" << leastSharp->name << " (Laplacian variance " << std::setprecision(1)
+            << leastSharp->statistics.laplacianVariance() << ")" << std::endl;
+    }
+    if (!m_statisticsTablePath.empty()) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Box Statistics:" << m_statisticsTablePath << std::endl;
+    }
+    if (m_previewLevel >= 0) {
+        ss << std::left << std::setfill(' ') << std::setw(20);
+        ss << "Preview:" << std::setprecision(1) << m_previewMilliseconds << " ms from level "
+            << m_previewLevel << std::endl;
+    }
 
 	return ss.str();
 }
 
 void BoxDrop::updateIntermediateResult()
 {
-	auto update_result = [&](const std::shared_ptr<image::tile::Factory> &factory) 
-	{
-		// Create a compositor
-		auto compositor = std::unique_ptr<image::tile::Compositor>
-			(new image::tile::Compositor(factory));
-		Size size;
-		size.setWidth(m_size);
-		size.setHeight(m_size);
-		Point point;
-		point.setX((int)(m_rect.topLeft().getX()));
-		point.setY((int)(m_rect.topLeft().getY()));
-	    DisplayRegion region = DisplayRegion(Rect(point,size),size);
-		auto outputImage = 
-			compositor->getImage(region.source_region, region.output_size);
-
-		// Update UI
-		m_intermediate_result.update(outputImage, region.source_region);
-	};
-}
+    //Show the footprint of the boxes as soon as they are placed. The preview is read from the
+    //coarsest pyramid level that still fills PreviewSide pixels, through the cached factory,
+    //so it costs about the same whatever the size of the boxes.
+    const int PreviewSide = 512;
+    m_previewLevel = -1;
+    m_previewMilliseconds = 0.0;
+    if (m_boxes.empty() || !m_tile_source) { return; }
+    const auto start = std::chrono::steady_clock::now();
+    int x0 = m_boxes.front().rect.x, y0 = m_boxes.front().rect.y;
+    int x1 = m_boxes.front().rect.right(), y1 = m_boxes.front().rect.bottom();
+    for (auto it = m_boxes.begin(); it != m_boxes.end(); ++it) {
+        x0 = std::min(x0, it->rect.x);
+        y0 = std::min(y0, it->rect.y);
+        x1 = std::max(x1, it->rect.right());
+        y1 = std::max(y1, it->rect.bottom());
+    }
+    const BoxRect footprint(x0, y0, x1 - x0, y1 - y0);
+    auto preview = m_tile_source->getPreview(footprint, PreviewSide);
+    if ((preview.width() <= 0) || (preview.height() <= 0)) { return; }
+
+    // Update UI
+    Size size;
+    size.setWidth(footprint.width);
+    size.setHeight(footprint.height);
+    Point point;
+    point.setX(footprint.x);
+    point.setY(footprint.y);
+    m_intermediate_result.update(preview, Rect(point, size));
+    m_previewLevel = TileSource::previewLevel(footprint, PreviewSide);
+    m_previewMilliseconds = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}//end updateIntermediateResult
 
 ///Define the save file dialog options outside of init
 sedeen::file::FileDialogOptions BoxDrop::defineSaveFileDialogOptions() {
@@ -368,33 +1018,28 @@ sedeen::file::FileDialogOptions BoxDrop::defineSaveFileDialogOptions() {
     return theOptions;
 }//end defineSaveFileDialogOptions
 
-bool BoxDrop::SaveFlatImageToFile(const std::string &p) {
+///Define the timing log file dialog options
+sedeen::file::FileDialogOptions BoxDrop::defineTimingLogDialogOptions() {
+    sedeen::file::FileDialogOptions theOptions;
+    theOptions.caption = "Append timings to...";
+    sedeen::file::FileDialogFilter theDialogFilter;
+    theDialogFilter.name = "Log type";
+    theDialogFilter.extensions.push_back("csv");
+    theDialogFilter.extensions.push_back("json");
+    theOptions.filters.push_back(theDialogFilter);
+    return theOptions;
+}//end defineTimingLogDialogOptions
+
+bool BoxDrop::SaveFlatImageToFile(const std::string &p, const BoxRect &box, ExportMonitor *monitor,
+    BoxStatistics *statistics) {
     //It is assumed that error checks have already been performed, and that the type is valid
     //In RawImage::save, the used file format is defined by the file extension.
     //Supported extensions are : .tif, .png, .bmp, .gif, .jpg
-    std::string outFilePath = p;
-    bool imageSaved = false;
-    //Access the output factory (set in run() method)
-    auto outputFactory = GetOutputFactory();
-
-    //Create a compositor
-    auto compositor = std::make_unique<image::tile::Compositor>(outputFactory);
-    //Get the new rectangle
-    Size size;
-    size.setWidth(m_size);
-    size.setHeight(m_size);
-    Point point;
-    point.setX((int)(m_rect.topLeft().getX()));
-    point.setY((int)(m_rect.topLeft().getY()));
-    DisplayRegion region = DisplayRegion(Rect(point, size), size);
-    //Get the output image defined by the new rectangle
-    sedeen::image::RawImage outputImage = 
-        compositor->getImage(region.source_region, region.output_size);
-
-    //Save the outputImage to a file at the given location
-    imageSaved = outputImage.save(outFilePath);
-    //true on successful save, false otherwise
-    return imageSaved;
+    //This may be called from several export workers at once. They share the thread-safe
+    //tile source wrapping the output factory (set in run() method).
+    //The option index is the number of downsampled levels written with a TIF image
+    int extraLevels = m_exportScales;
+    return exportBoxImage(m_tile_source, box, p, extraLevels, monitor, m_exportProfile, statistics);
 }//end SaveFlatImageToFile
 
 const std::string BoxDrop::getExtension(const std::string &p) {
@@ -415,7 +1060,9 @@ const int BoxDrop::findExtensionIndex(const std::string &x) const {
     //This method works if the extension has a leading . or not
     std::string theExt(x);
     auto range = std::find(theExt.begin(), theExt.end(), '.');
-    theExt.erase(range);
+    if (range != theExt.end()) {
+        theExt.erase(range);
+    }
     //Find the extension in the m_saveFileExtensionText vector
     auto vec = m_saveFileExtensionText;
     auto vecIt = std::find(vec.begin(), vec.end(), theExt);
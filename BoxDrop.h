@@ -38,6 +38,20 @@
 #include "archive/Session.h"
 #include "geometry/graphic/Rectangle.h"
 
+// Plugin headers
+#include "BoxPipeline.h"
+#include "BoxPlacement.h"
+#include "BoxStatistics.h"
+#include "ExportEngine.h"
+#include "ExportManifest.h"
+#include "PatchDataset.h"
+#include "RunProfile.h"
+#include "SessionTransaction.h"
+#include "TileCodec.h"
+#include "TilePrefetcher.h"
+#include "TileSource.h"
+#include "TissueMask.h"
+
 namespace sedeen {
 namespace image {
 class RawImage;
@@ -53,15 +67,36 @@ private:
 	virtual void init(const image::ImageHandle& image);
 
 	std::string generateReport() const;
+	///Show a low-resolution image of the area covered by the boxes in m_intermediate_result
 	void updateIntermediateResult();
-	bool buildPipeline();
+	bool buildPipeline(SessionTransaction &session);
+
+    ///Create the cached factory, tile cache and tile source for the image, or keep them if it has not changed
+    void updateImageCaches(const std::string &path_to_image);
+
+    ///Return the tissue mask of the image, building it from a thumbnail on first use
+    const TissueMask &tissueMask();
+
+    ///Return the placement settings chosen in the parameters
+    BoxSpec boxSpec() const;
+
+    ///Return the encoding settings chosen in the parameters, sharing the export threads
+    ///between boxesInFlight boxes saved at the same time
+    ExportProfile exportProfile(int boxesInFlight) const;
 
 private:
     ///Define the save file dialog options outside of init
     sedeen::file::FileDialogOptions defineSaveFileDialogOptions();
 
-    ///Save the separated image to a TIF/PNG/BMP/GIF/JPG flat format file
-    bool SaveFlatImageToFile(const std::string &p);
+    ///Define the timing log file dialog options
+    sedeen::file::FileDialogOptions defineTimingLogDialogOptions();
+
+    ///Save the image within box to a TIF/PNG/BMP/GIF/JPG flat format file.
+    ///TIF files are written tile by tile; the other formats are composed in one piece.
+    ///Progress goes to monitor, and the save stops without leaving a file if it is cancelled.
+    ///The statistics of the pixels are added to statistics, if given, as they are encoded.
+    bool SaveFlatImageToFile(const std::string &p, const BoxRect &box, ExportMonitor *monitor = nullptr,
+        BoxStatistics *statistics = nullptr);
 
     ///Given a full file path as a string, identify if there is an extension and return it
     const std::string getExtension(const std::string &p);
@@ -72,6 +107,27 @@ private:
     ///Check if the file exists and accessible for reading or writing, or that the directory to write to exists
     static bool checkFile(const std::string &, const std::string &);
 
+private:
+    ///The ways boxes can be placed, in the order of m_placementModeOptions
+    enum PlacementMode {
+        CentreOnRegion = 0,
+        RandomSampling,
+        LatticeTiling
+    };
+
+    ///Which annotations boxes are dropped on, in the order of m_regionSourceOptions
+    enum RegionSource {
+        ProcessingRegion = 0,
+        RegionListSource,
+        NameFilterSource
+    };
+
+    ///Where new box annotations are written, in the order of m_annotationStorageOptions
+    enum AnnotationStorage {
+        SessionFileStorage = 0,
+        JournalStorage
+    };
+
 private:
     algorithm::GraphicItemParameter m_region_toProcess;
     IntegerParameter m_size;
@@ -81,18 +137,125 @@ private:
     Rectangle m_rect;
     GraphicStyle m_style;
 
+    ///User choice of dropping boxes on the Processing ROI, the selected regions, or matching annotations
+    OptionParameter m_regionSource;
+    ///Regions to drop boxes on in Region List mode
+    RegionListParameter m_regionList;
+    ///Names of the annotations to drop boxes on in Name Filter mode, with * and ? wildcards
+    TextFieldParameter m_regionNameFilter;
+    ///User choice of how to place boxes
+    OptionParameter m_placementMode;
+    ///Number of boxes to drop in random sampling mode
+    IntegerParameter m_numberOfBoxes;
+    ///Distance in pixels between the corners of neighbouring boxes in lattice mode; 0 for the box size
+    IntegerParameter m_latticeStride;
+    ///Seed of the random sampler, so that a placement can be audited and repeated
+    IntegerParameter m_randomSeed;
+    ///Minimum gap in pixels between randomly placed boxes
+    IntegerParameter m_boxSpacing;
+    ///Random boxes with a smaller fraction of tissue are rejected
+    DoubleParameter m_minTissueFraction;
+    ///Boxes covered by an existing annotation over more than this fraction are rejected
+    DoubleParameter m_maxOverlapFraction;
+    ///If true, sample across the whole level-0 image instead of inside the processing ROI
+    BoolParameter m_sampleWholeImage;
+    ///If true, boxes are aligned to the tile grid so that they export from whole cached tiles
+    BoolParameter m_snapToTiles;
+    ///User choice of writing the session on every run, or appending to the journal
+    OptionParameter m_annotationStorage;
+    ///Number of journalled boxes at which the journal is compacted into the session
+    IntegerParameter m_journalThreshold;
+    ///If true, the journal is compacted into the session on this run
+    BoolParameter m_compactJournal;
+    ///The boxes placed by the most recent call to buildPipeline
+    std::vector<PlacedBox> m_boxes;
+    ///Index of the session's annotations by name and geometry, kept between runs
+    AnnotationIndex m_annotationIndex;
+    ///Boxes added but not yet written to the session of the current image
+    AnnotationJournal m_journal;
+    ///Records of the boxes placed by the most recent call to buildPipeline, in journal mode
+    std::vector<JournalRecord> m_journalRecords;
+    ///Number of boxes written to the session by the last compaction of the journal, or -1
+    int m_journalCompacted;
+    ///Number of boxes left in the journal after the last run
+    size_t m_journalPending;
+    ///Timing of the most recent export batch
+    ExportEngine::Statistics m_exportStatistics;
+    ///Tile cache counters of the most recent export batch
+    TileCache::Statistics m_tileCacheStatistics;
+    ///Tissue mask of the image in m_tile_cache_image, built on first use
+    std::shared_ptr<TissueMask> m_tissue_mask;
+    ///Number of random candidates rejected by the tissue mask in the last placement
+    int64_t m_tissueRejections;
+    ///Number of candidates rejected for overlapping existing annotations in the last placement
+    int64_t m_overlapRejections;
+    ///Names and gap distances in pixels of the annotations nearest to the last box placed
+    std::vector<std::pair<std::string, double>> m_neighbours;
+    ///Number of regions boxes were dropped on by the most recent call to buildPipeline
+    size_t m_regionsProcessed;
+    ///Cache needed to decode each tile once when the last lattice is exported, in bytes
+    int64_t m_latticeWorkingSet;
+    ///Pyramid level and time of the preview of the last run, or -1 if none was shown
+    int m_previewLevel;
+    double m_previewMilliseconds;
+    ///Stage timings and counters of the most recent run
+    RunProfile m_profile;
+    ///Dataset that boxes are appended to when the output file is a .bdpatch index
+    PatchDataset m_patchDataset;
+    ///Statistics of the boxes saved by the most recent export, and the table they were written to
+    std::vector<StatisticsRecord> m_boxStatistics;
+    std::string m_statisticsTablePath;
+    ///Exports recorded in the directory of the output images, and the boxes of the last run
+    ///kept or linked from them instead of being exported again
+    ExportManifest m_exportManifest;
+    int m_boxesKept;
+    int m_boxesLinked;
+    ///Encoding settings of the most recent export, and their description for the report
+    ExportProfile m_exportProfile;
+    std::string m_exportProfileName;
+
     ///User choice whether to save the image within the box as output
     BoolParameter m_saveOutputImage;
+    ///User choice of downsampled versions to save with each TIF image
+    OptionParameter m_exportScales;
+    ///If true, the statistics of each saved box are written to a CSV table next to the images
+    BoolParameter m_saveStatistics;
+    ///If true, boxes whose pixels an unchanged file of an earlier export holds are not exported again
+    BoolParameter m_reuseExports;
+    ///Number of boxes exported at the same time
+    IntegerParameter m_exportThreads;
+    ///Compression of TIF images, in the order of m_compressionValues
+    OptionParameter m_tiffCompression;
+    ///Quality of JPG images and JPEG-compressed TIF images
+    IntegerParameter m_jpegQuality;
+    ///Byte budget of the tile cache, in MB
+    IntegerParameter m_tileCacheSize;
+    ///Number of tiles read into the cache ahead of the export on a background thread; 0 for none
+    IntegerParameter m_prefetchTiles;
     ///Choose what format to write the separated images in
     OptionParameter m_saveFileFormat;
     ///User choice of file name stem and type
     SaveFileDialogParameter m_saveFileAs;
+    ///Optional file to which the timings of each run are appended (CSV or JSON lines)
+    SaveFileDialogParameter m_timingLog;
 
     ///Create a cached factory for faster image saving
     std::shared_ptr<image::tile::Factory> m_cached_output_factory;
-    ///Set the output factory
+    ///Thread-safe wrapper of the output factory, shared by the export workers
+    std::shared_ptr<TileSource> m_tile_source;
+    ///Decoded tiles of the image in m_tile_cache_image, kept between runs
+    std::shared_ptr<TileCache> m_tile_cache;
+    std::string m_tile_cache_image;
+    ///Set the output factory, read through the tile cache
     void SetOutputFactory(std::shared_ptr<image::tile::Factory> fac) {
         m_cached_output_factory = fac;
+        if (m_tile_cache) {
+            m_tile_source = std::make_shared<TileSource>(fac, getDimensions(image(), 0), m_tile_cache);
+        }
+        else {
+            m_tile_source = std::make_shared<TileSource>(fac);
+        }
+        m_tile_source->setProfile(&m_profile);
     }
     ///Get the output factory
     std::shared_ptr<image::tile::Factory> GetOutputFactory() const {
@@ -107,6 +270,12 @@ private:
 	std::string m_type;
 
     std::vector<std::string> m_saveFileExtensionText;
+    std::vector<std::string> m_regionSourceOptions;
+    std::vector<std::string> m_placementModeOptions;
+    std::vector<std::string> m_annotationStorageOptions;
+    std::vector<std::string> m_exportScaleOptions;
+    std::vector<std::string> m_compressionOptions;
+    std::vector<TileCodec::Compression> m_compressionValues;
 };
 } //namespace algorithm
 } //namespace sedeen
@@ -0,0 +1,370 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "BoxExporter.h"
+
+// System headers
+#include <algorithm>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// Plugin headers
+#include "Downsample.h"
+#include "JpegEncoder.h"
+#include "TiffWriter.h"
+
+namespace sedeen {
+namespace algorithm {
+
+BoxExporter::BoxExporter(std::shared_ptr<TileSource> source, int tileSize)
+    : m_source(source),
+    m_tileSize(std::max(16, tileSize - tileSize % 16)),
+    m_bytesWritten(0),
+    m_monitor(nullptr),
+    m_statistics(nullptr),
+    m_codec(),
+    m_encodeThreads(1)
+{
+}//end constructor
+
+bool BoxExporter::exportTiff(const BoxRect &box, const std::string &path, int extraLevels) {
+    if (box.isEmpty()) { return false; }
+    const int levels = 1 + std::max(0, std::min(extraLevels, maxExtraLevels()));
+    //One writer per level. Level k has tiles of m_tileSize >> k pixels, so every full-resolution
+    //tile maps onto exactly one tile of each level.
+    std::vector<std::unique_ptr<TiffWriter>> writers;
+    auto abortAll = [&writers]() {
+        for (auto it = writers.begin(); it != writers.end(); ++it) { (*it)->abort(); }
+    };
+    int levelWidth = box.width;
+    int levelHeight = box.height;
+    for (int k = 0; k < levels; ++k) {
+        writers.push_back(std::make_unique<TiffWriter>());
+        if (!writers.back()->open(partialFilePath(levelFilePath(path, k)), levelWidth, levelHeight,
+            m_tileSize >> k, 3, m_codec)) {
+            abortAll();
+            return false;
+        }
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+
+    //Each slot has a pixel buffer and a compressed tile per level, reused for the whole
+    //box. Edge tiles are padded by replicating the last row and column, so that filtering does not
+    //darken the edges of the smaller levels.
+    const size_t slots = static_cast<size_t>(m_encodeThreads) * 2;
+    std::vector<std::vector<std::vector<uint8_t>>> tiles(slots, std::vector<std::vector<uint8_t>>(levels));
+    std::vector<std::vector<std::vector<uint8_t>>> encoded(slots, std::vector<std::vector<uint8_t>>(levels));
+    for (size_t slot = 0; slot < slots; ++slot) {
+        for (int k = 1; k < levels; ++k) {
+            tiles[slot][k].resize(static_cast<size_t>(m_tileSize >> k) * (m_tileSize >> k) * 3);
+        }
+    }
+    //Each slot gathers the statistics of its own tiles; they are added together at the end
+    std::vector<BoxStatistics> statistics(m_statistics ? slots : 0);
+    const int tilesAcross = writers.front()->tilesAcross();
+    const int64_t count = static_cast<int64_t>(tilesAcross) * writers.front()->tilesDown();
+    uint64_t bytesEncoded = 0;
+    auto encode = [&](size_t slot, int64_t index) {
+        const int x = static_cast<int>(index % tilesAcross) * m_tileSize;
+        const int y = static_cast<int>(index / tilesAcross) * m_tileSize;
+        BoxRect region(box.x + x, box.y + y,
+            std::min(m_tileSize, box.width - x), std::min(m_tileSize, box.height - y));
+        std::vector<std::vector<uint8_t>> &levelTiles = tiles[slot];
+        //A whole tile of the cache grid is encoded from the cached pixels, without compositing or copying
+        std::shared_ptr<const TileBuffer> cell;
+        if ((m_tileSize == m_source->cellSize()) && (region.width == m_tileSize) && (region.height == m_tileSize)) {
+            cell = m_source->alignedCell(region);
+        }
+        if (cell) {
+            if (m_source->profile()) { m_source->profile()->add(RunProfile::AlignedTiles, 1); }
+        }
+        else if (!m_source->readRegion(region, levelTiles[0], m_tileSize, m_tileSize)) {
+            return false;
+        }
+        //Filtering and compression are recorded as encoding, reading as compositing (by the source)
+        ScopedStageTimer timer(m_source->profile(), RunProfile::Encoding);
+        int validWidth = region.width;
+        int validHeight = region.height;
+        const uint8_t *pixels = cell ? cell->pixels.data() : levelTiles[0].data();
+        if (m_statistics) { statistics[slot].add(pixels, region.width, region.height, m_tileSize); }
+        for (int k = 0; k < levels; ++k) {
+            const int size = m_tileSize >> k;
+            if (k > 0) {
+                downsampleRGB2x2(pixels, 2 * size, 2 * size, 2 * size, levelTiles[k].data(), size);
+                pixels = levelTiles[k].data();
+                validWidth = (validWidth + 1) / 2;
+                validHeight = (validHeight + 1) / 2;
+            }
+            if ((k + 1 < levels) && ((validWidth < size) || (validHeight < size))) {
+                replicateEdgesRGB(levelTiles[k].data(), validWidth, validHeight, size);
+            }
+            if (!m_codec.encode(pixels, size, size, 3, encoded[slot][k])) { return false; }
+        }
+        return true;
+    };
+    auto write = [&](size_t slot, int64_t index) {
+        const int column = static_cast<int>(index % tilesAcross);
+        const int row = static_cast<int>(index / tilesAcross);
+        for (int k = 0; k < levels; ++k) {
+            const std::vector<uint8_t> &tile = encoded[slot][k];
+            if (!writers[k]->writeEncodedTile(column, row, tile.data(), tile.size())) { return false; }
+            bytesEncoded += static_cast<uint64_t>(m_tileSize >> k) * (m_tileSize >> k) * 3;
+        }
+        return true;
+    };
+    const bool complete = encodePipelined(count, slots, encode, write);
+    for (auto it = statistics.begin(); it != statistics.end(); ++it) { m_statistics->merge(*it); }
+    if (!complete) {
+        abortAll();
+        return false;
+    }
+
+    bool closed = true;
+    uint64_t bytesWritten = 0;
+    {
+        ScopedStageTimer timer(m_source->profile(), RunProfile::Encoding);
+        for (auto it = writers.begin(); it != writers.end(); ++it) {
+            closed = (*it)->close() && closed;
+            bytesWritten += (*it)->bytesWritten();
+        }
+    }
+    recordBytes(bytesWritten, bytesEncoded);
+    if (!closed) {
+        abortAll();
+        return false;
+    }
+    //Move the complete files into place, replacing any earlier export
+    namespace fs = std::filesystem; //an alias
+    for (int k = 0; k < levels; ++k) {
+        std::error_code ec;
+        fs::rename(partialFilePath(levelFilePath(path, k)), levelFilePath(path, k), ec);
+        if (ec) {
+            for (int j = k; j < levels; ++j) { fs::remove(partialFilePath(levelFilePath(path, j)), ec); }
+            return false;
+        }
+    }
+    return true;
+}//end exportTiff
+
+bool BoxExporter::exportJpeg(const BoxRect &box, const std::string &path) {
+    namespace fs = std::filesystem; //an alias
+    if (box.isEmpty() || (box.width > JpegEncoder::MaxDimension) || (box.height > JpegEncoder::MaxDimension)) {
+        return false;
+    }
+    const std::string partialPath = partialFilePath(path);
+    std::ofstream file(partialPath.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!file.good()) { return false; }
+    auto abort = [&]() {
+        file.close();
+        std::error_code ec;
+        fs::remove(partialPath, ec);
+        return false;
+    };
+
+    //Each strip is a restart interval, so strips are compressed independently and simply concatenated
+    const JpegEncoder encoder(m_codec.jpegQuality(), 3);
+    const int stripRows = jpegStripRows(box.width);
+    const int64_t count = stripCount(box);
+    std::vector<uint8_t> bytes;
+    encoder.writeHeader(box.width, box.height,
+        ((box.width + encoder.mcuSize() - 1) / encoder.mcuSize()) * (stripRows / encoder.mcuSize()), bytes);
+    file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    uint64_t bytesWritten = bytes.size();
+
+    //Keep the strips in flight below about 256 MB
+    const size_t stripBytes = static_cast<size_t>(box.width) * stripRows * 3;
+    const size_t slots = std::max<size_t>(1, std::min<size_t>(m_encodeThreads * 2, (size_t(256) << 20) / stripBytes));
+    std::vector<std::vector<uint8_t>> strips(slots);
+    std::vector<std::vector<uint8_t>> encoded(slots);
+    std::vector<BoxStatistics> statistics(m_statistics ? slots : 0);
+    auto encode = [&](size_t slot, int64_t index) {
+        const int y = static_cast<int>(index) * stripRows;
+        BoxRect region(box.x, box.y + y, box.width, std::min(stripRows, box.height - y));
+        if (!m_source->readRegion(region, strips[slot], box.width, region.height)) { return false; }
+        ScopedStageTimer timer(m_source->profile(), RunProfile::Encoding);
+        if (m_statistics) { statistics[slot].add(strips[slot].data(), region.width, region.height, box.width); }
+        encoded[slot].clear();
+        if (index > 0) { JpegEncoder::writeRestartMarker(static_cast<int>(index - 1), encoded[slot]); }
+        encoder.encodeSegment(strips[slot].data(), region.width, region.height, box.width, encoded[slot]);
+        return true;
+    };
+    auto write = [&](size_t slot, int64_t) {
+        file.write(reinterpret_cast<const char *>(encoded[slot].data()), encoded[slot].size());
+        bytesWritten += encoded[slot].size();
+        return file.good();
+    };
+    const bool complete = encodePipelined(count, slots, encode, write);
+    for (auto it = statistics.begin(); it != statistics.end(); ++it) { m_statistics->merge(*it); }
+    if (!complete) { return abort(); }
+
+    bytes.clear();
+    JpegEncoder::writeEnd(bytes);
+    file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    bytesWritten += bytes.size();
+    file.close();
+    recordBytes(bytesWritten, static_cast<uint64_t>(box.width) * box.height * 3);
+    if (!file.good()) { return abort(); }
+    std::error_code ec;
+    fs::rename(partialPath, path, ec);
+    if (ec) {
+        fs::remove(partialPath, ec);
+        return false;
+    }
+    return true;
+}//end exportJpeg
+
+bool BoxExporter::encodePipelined(int64_t count, size_t slots, const EncodeFunction &encode, const WriteFunction &write) {
+    const int threads = static_cast<int>(std::min<size_t>(m_encodeThreads, slots));
+    auto cancelled = [this]() { return m_monitor && m_monitor->isCancelled(); };
+    //On one thread each chunk is encoded just before it is written, and cancellation is checked between chunks
+    if (threads <= 1) {
+        for (int64_t index = 0; index < count; ++index) {
+            if (cancelled()) { return false; }
+            if (!encode(0, index) || !write(0, index)) { return false; }
+            if (m_monitor) { m_monitor->chunkDone(); }
+        }
+        return true;
+    }
+
+    //Chunk i is encoded into slot i % slots once chunk i - slots has been written, so the
+    //workers keep encoding up to slots chunks ahead while this thread writes them in order
+    std::mutex mutex;
+    std::condition_variable slotFree;
+    std::condition_variable chunkEncoded;
+    int64_t next = 0;
+    int64_t written = 0;
+    bool failed = false;
+    //Index of the chunk each slot holds once it is encoded, or -1
+    std::vector<int64_t> encodedIndex(slots, -1);
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            slotFree.wait(lock, [&]() { return failed || (next >= count) || (next < written + static_cast<int64_t>(slots)); });
+            if (failed || (next >= count)) { return; }
+            const int64_t index = next++;
+            const size_t slot = static_cast<size_t>(index % static_cast<int64_t>(slots));
+            lock.unlock();
+            bool ok = false;
+            try {
+                ok = !cancelled() && encode(slot, index);
+            }
+            catch (...) {
+                ok = false;
+            }
+            lock.lock();
+            if (ok) { encodedIndex[slot] = index; }
+            else { failed = true; }
+            chunkEncoded.notify_one();
+            if (!ok) { slotFree.notify_all(); }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+
+    for (int64_t index = 0; index < count; ++index) {
+        const size_t slot = static_cast<size_t>(index % static_cast<int64_t>(slots));
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            chunkEncoded.wait(lock, [&]() { return failed || (encodedIndex[slot] == index); });
+            if (failed) { break; }
+        }
+        //The slot is not reused until written is advanced, so it is written outside the lock
+        const bool ok = !cancelled() && write(slot, index);
+        if (ok && m_monitor) { m_monitor->chunkDone(); }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ok) { ++written; }
+            else { failed = true; }
+        }
+        slotFree.notify_all();
+        if (!ok) { break; }
+    }
+    for (auto it = pool.begin(); it != pool.end(); ++it) {
+        it->join();
+    }
+    return !failed && (written == count);
+}//end encodePipelined
+
+void BoxExporter::recordBytes(uint64_t written, uint64_t encoded) {
+    m_bytesWritten += written;
+    if (m_source->profile()) {
+        m_source->profile()->add(RunProfile::BytesWritten, static_cast<int64_t>(written));
+        m_source->profile()->add(RunProfile::BytesEncoded, static_cast<int64_t>(encoded));
+    }
+}//end recordBytes
+
+int64_t BoxExporter::tileCount(const BoxRect &box, int tileSize) {
+    if (box.isEmpty() || (tileSize <= 0)) { return 0; }
+    const int64_t across = (box.width + tileSize - 1) / tileSize;
+    const int64_t down = (box.height + tileSize - 1) / tileSize;
+    return across * down;
+}//end tileCount
+
+int BoxExporter::jpegStripRows(int width) {
+    const int mcusAcross = std::max(1, (width + 15) / 16);
+    return 16 * std::max(1, std::min(16, 65535 / mcusAcross));
+}//end jpegStripRows
+
+int64_t BoxExporter::stripCount(const BoxRect &box) {
+    if (box.isEmpty()) { return 0; }
+    const int rows = jpegStripRows(box.width);
+    return (box.height + rows - 1) / rows;
+}//end stripCount
+
+std::string BoxExporter::partialFilePath(const std::string &path) {
+    namespace fs = std::filesystem; //an alias
+    //Keep the extension last: RawImage::save chooses the format from it
+    fs::path filePath(path);
+    return filePath.replace_filename(filePath.stem().string() + ".partial"
+        + filePath.extension().string()).string();
+}//end partialFilePath
+
+int BoxExporter::maxExtraLevels() const {
+    //TIFF tiles must be a multiple of 16 pixels
+    int levels = 0;
+    while (((m_tileSize >> (levels + 1)) >= 16) && ((m_tileSize >> (levels + 1)) % 16 == 0)) {
+        ++levels;
+    }
+    return levels;
+}//end maxExtraLevels
+
+std::string BoxExporter::levelFilePath(const std::string &path, int level) {
+    namespace fs = std::filesystem; //an alias
+    if (level <= 0) { return path; }
+    std::stringstream ss;
+    fs::path filePath(path);
+    ss << filePath.stem().string() << "_" << 1.0 / (1 << level) << "x" << filePath.extension().string();
+    return filePath.replace_filename(ss.str()).string();
+}//end levelFilePath
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,137 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_BOXEXPORTER_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_BOXEXPORTER_H
+
+// System headers
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Plugin headers
+#include "BoxPlacement.h"
+#include "BoxStatistics.h"
+#include "ExportMonitor.h"
+#include "TileCodec.h"
+#include "TileSource.h"
+
+namespace sedeen {
+namespace algorithm {
+
+///Streams the full-resolution pixels of a box from a tile source to a tiled TIFF file,
+///or to a baseline JPEG file in strips. The box is requested one output tile (or strip) at
+///a time, so peak memory depends on the tile size and not on the size of the box. Tiles
+///can be read and compressed by several threads at once; they are written in order.
+///Each export worker uses its own BoxExporter; they may share one TileSource.
+class BoxExporter {
+public:
+    ///Edge length in pixels of the output tiles, unless another is given
+    static const int DefaultTileSize = 512;
+
+    explicit BoxExporter(std::shared_ptr<TileSource> source, int tileSize = DefaultTileSize);
+
+    ///Write the pixels of box to path as a tiled TIFF (BigTIFF if needed). The file is written
+    ///under partialFilePath(path) and renamed when complete, so a failed or cancelled export
+    ///leaves no file behind and never replaces an earlier complete file with a partial one.
+    ///If extraLevels > 0, versions downsampled by 2, 4, ... are written in the same pass to
+    ///the files named by levelFilePath. They are filtered from the full-resolution tiles,
+    ///which are read only once.
+    bool exportTiff(const BoxRect &box, const std::string &path, int extraLevels = 0);
+
+    ///Write the pixels of box to path as a baseline JPEG with the quality of the codec. The strips
+    ///are compressed independently, separated by restart markers. Returns false (writing nothing)
+    ///if the box is wider or taller than JpegEncoder::MaxDimension.
+    bool exportJpeg(const BoxRect &box, const std::string &path);
+
+    ///Largest number of extra levels supported by the tile size
+    int maxExtraLevels() const;
+
+    ///Report each output tile to monitor, and stop between tiles if it is cancelled
+    void setMonitor(ExportMonitor *monitor) { m_monitor = monitor; }
+
+    ///Add the statistics of the pixels of each box exported to statistics, computed from the tiles
+    ///or strips as they are encoded; nullptr stops it. Statistics of a failed export are partial.
+    void setStatistics(BoxStatistics *statistics) { m_statistics = statistics; }
+
+    ///Compression of TIFF tiles, and the quality of JPEG files
+    void setCodec(const TileCodec &codec) { m_codec = codec; }
+    const TileCodec &codec() const { return m_codec; }
+
+    ///Number of threads reading and compressing tiles (1 does everything on the calling thread)
+    void setEncodeThreads(int threads) { m_encodeThreads = std::max(1, threads); }
+    int encodeThreads() const { return m_encodeThreads; }
+
+    ///Number of output tiles (progress chunks) exportTiff writes for box with tiles of tileSize
+    static int64_t tileCount(const BoxRect &box, int tileSize = DefaultTileSize);
+
+    ///Rows in each strip of a JPEG file of the given width: 256, or fewer for very wide images so
+    ///that the restart interval fits in 16 bits
+    static int jpegStripRows(int width);
+
+    ///Number of strips (progress chunks) exportJpeg writes for box
+    static int64_t stripCount(const BoxRect &box);
+
+    ///Name under which a file is written until it is complete: roi.tif becomes roi.partial.tif
+    static std::string partialFilePath(const std::string &path);
+
+    ///File name of a downsampled level: roi.tif becomes roi_0.5x.tif, roi_0.25x.tif, ...
+    static std::string levelFilePath(const std::string &path, int level);
+
+    ///Total bytes written by this exporter
+    uint64_t bytesWritten() const { return m_bytesWritten; }
+
+    int tileSize() const { return m_tileSize; }
+
+private:
+    ///Produces chunk index into the buffers of slot; called concurrently for different slots
+    typedef std::function<bool(size_t slot, int64_t index)> EncodeFunction;
+    ///Writes the chunk encoded in slot; called in order of index on the calling thread
+    typedef std::function<bool(size_t slot, int64_t index)> WriteFunction;
+
+    ///Encode and write count chunks through slots buffers: a pool of encode threads, started
+    ///once, encodes up to slots chunks ahead while the calling thread writes them in order.
+    ///Stops with false on failure or cancellation.
+    bool encodePipelined(int64_t count, size_t slots, const EncodeFunction &encode, const WriteFunction &write);
+
+    ///Add bytes to the totals of this exporter and of the profile of the source
+    void recordBytes(uint64_t written, uint64_t encoded);
+
+private:
+    std::shared_ptr<TileSource> m_source;
+    int m_tileSize;
+    uint64_t m_bytesWritten;
+    ExportMonitor *m_monitor;
+    BoxStatistics *m_statistics;
+    TileCodec m_codec;
+    int m_encodeThreads;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_BOXEXPORTER_H
@@ -0,0 +1,491 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#include "BoxPipeline.h"
+
+// System headers
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_set>
+
+// Plugin headers
+#include "BoxExporter.h"
+#include "ExportManifest.h"
+#include "JpegEncoder.h"
+
+namespace sedeen {
+namespace algorithm {
+
+std::vector<BoxRect> placeBoxes(const BoxSpec &spec, const BoxRect &region,
+    const TissueMask *mask, int64_t *rejections, const SpatialIndex *existing,
+    size_t ignoreId, int64_t *overlapRejections) {
+    std::vector<BoxRect> boxes;
+    const int grid = std::max(1, spec.snapGrid);
+    //Boxes covering too much of an existing annotation are rejected through the spatial index
+    const bool checkOverlap = (nullptr != existing) && (spec.maxOverlapFraction < 1.0);
+    auto overlapsTooMuch = [&](const BoxRect &box) {
+        const double overlap = existing->maxOverlapFraction(box, ignoreId);
+        //With a limit of 0 any shared area counts, however small
+        const bool rejected = (spec.maxOverlapFraction <= 0.0) ? (overlap > 0.0) : (overlap > spec.maxOverlapFraction);
+        if (rejected && overlapRejections) { ++(*overlapRejections); }
+        return rejected;
+    };
+    if (spec.randomSampling) {
+        //Aligned boxes are sampled in units of grid cells, among the cells wholly inside the region
+        const int boxCells = (spec.boxSize + grid - 1) / grid;
+        const int spacingCells = (spec.spacing + grid - 1) / grid;
+        const BoxRect cells = gridCellsInside(region, grid);
+        auto toPixels = [grid](const BoxRect &box) {
+            return BoxRect(box.x * grid, box.y * grid, box.width * grid, box.height * grid);
+        };
+        PoissonBoxSampler sampler(cells, boxCells, spacingCells, spec.seed);
+        //Candidates mostly on glass are rejected from the thumbnail mask before any pixels are read
+        PoissonBoxSampler::AcceptFunction accept;
+        const bool checkTissue = (spec.minTissueFraction > 0.0) && (nullptr != mask);
+        if (checkTissue || checkOverlap) {
+            const double minTissue = spec.minTissueFraction;
+            accept = [=, &overlapsTooMuch](const BoxRect &candidate) {
+                const BoxRect box = toPixels(candidate);
+                if (checkTissue && (mask->tissueFraction(box) < minTissue)) {
+                    if (rejections) { ++(*rejections); }
+                    return false;
+                }
+                return !checkOverlap || !overlapsTooMuch(box);
+            };
+        }
+        boxes = sampler.sample(spec.count, accept);
+        std::transform(boxes.begin(), boxes.end(), boxes.begin(), toPixels);
+    }
+    else if (spec.lattice) {
+        //Boxes are kept in row-major order, so the export reads neighbouring boxes in turn
+        const bool checkTissue = (spec.minTissueFraction > 0.0) && (nullptr != mask);
+        for (const BoxRect &box : latticeBoxes(region, spec.boxSize, spec.latticeStride, spec.snapGrid)) {
+            if (checkTissue && (mask->tissueFraction(box) < spec.minTissueFraction)) {
+                if (rejections) { ++(*rejections); }
+                continue;
+            }
+            if (!checkOverlap || !overlapsTooMuch(box)) {
+                boxes.push_back(box);
+            }
+        }
+    }
+    else {
+        const BoxRect box = snapToGrid(centredBox(region, spec.boxSize), grid);
+        if (!checkOverlap || !overlapsTooMuch(box)) {
+            boxes.push_back(box);
+        }
+    }
+    return boxes;
+}//end placeBoxes
+
+namespace {
+///Return true if spec places one box centred on the region, which replaces the region
+bool isCentred(const BoxSpec &spec) {
+    return !spec.randomSampling && !spec.lattice;
+}//end isCentred
+
+///A centred box keeps the ROI's name so that it replaces the ROI in the session.
+///Random and lattice boxes are numbered, and the ROI they were placed in is kept.
+std::string numberedBoxName(const BoxSpec &spec, const std::string &name, size_t index) {
+    return isCentred(spec) ? name : (name + " " + std::to_string(index + 1));
+}//end numberedBoxName
+} // namespace
+
+std::vector<PlacedBox> addBoxAnnotations(SessionTransaction &session, const BoxSpec &spec,
+    const std::vector<BoxRect> &boxes, const std::string &name, const GraphicStyle &style,
+    size_t templatePosition) {
+    //Copy the template: adding annotations may move the session's graphics
+    std::unique_ptr<GraphicDescription> templateGraphic;
+    if (templatePosition < session.graphics().size()) {
+        templateGraphic = std::make_unique<GraphicDescription>(session.graphics()[templatePosition]);
+    }
+    else {
+        templatePosition = AnnotationIndex::npos;
+    }
+    std::vector<PlacedBox> placed;
+    std::vector<GraphicDescription> newGraphics;
+    newGraphics.reserve(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        const std::string boxName = numberedBoxName(spec, name, i);
+        newGraphics.push_back(makeBoxGraphic(boxes[i], boxName, spec.description, style, templateGraphic.get()));
+        placed.push_back(PlacedBox{ boxes[i], boxName });
+    }
+    if (!newGraphics.empty()) {
+        session.addBoxGraphics(newGraphics, templatePosition);
+    }
+    return placed;
+}//end addBoxAnnotations
+
+std::vector<PlacedBox> journalBoxAnnotations(const SessionTransaction &session, AnnotationJournal &journal,
+    const BoxSpec &spec, const std::vector<BoxRect> &boxes, const std::string &name,
+    size_t templatePosition, std::vector<JournalRecord> &records) {
+    AnnotationKey source;
+    if (templatePosition < session.graphics().size()) {
+        source = SessionTransaction::keyOf(session.graphics()[templatePosition]);
+    }
+    std::vector<PlacedBox> placed;
+    records.clear();
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        const std::string boxName = numberedBoxName(spec, name, i);
+        placed.push_back(PlacedBox{ boxes[i], boxName });
+        JournalRecord record;
+        record.box = boxes[i];
+        record.name = boxName;
+        record.description = spec.description;
+        record.styleSource = source;
+        record.replacesSource = isCentred(spec) && !source.name.empty();
+        AnnotationKey key;
+        key.name = boxName;
+        key.bounds = boxes[i];
+        //The journal's last record of a box overrides the session; either may hold an old description
+        const size_t existing = session.findGraphic(key.name, key.bounds);
+        const bool upToDate = journal.contains(key) ? journal.contains(key, spec.description)
+            : ((existing != AnnotationIndex::npos)
+                && (spec.description == session.graphics()[existing].getDescription()));
+        if (!upToDate) {
+            records.push_back(record);
+        }
+    }
+    return placed;
+}//end journalBoxAnnotations
+
+bool nameMatches(const std::string &pattern, const std::string &name) {
+    //Greedy wildcard matching that backtracks only to the most recent *, so it is linear in practice
+    size_t p = 0, n = 0;
+    size_t star = std::string::npos, resume = 0;
+    while (n < name.size()) {
+        if ((p < pattern.size()) && ((pattern[p] == '?') || (pattern[p] == name[n]))) {
+            ++p;
+            ++n;
+        }
+        else if ((p < pattern.size()) && (pattern[p] == '*')) {
+            star = p++;
+            resume = n;
+        }
+        else if (star != std::string::npos) {
+            p = star + 1;
+            n = ++resume;
+        }
+        else {
+            return false;
+        }
+    }
+    while ((p < pattern.size()) && (pattern[p] == '*')) { ++p; }
+    return p == pattern.size();
+}//end nameMatches
+
+std::vector<BoxRegion> regionsMatching(const SessionTransaction &session, const std::string &pattern) {
+    std::vector<BoxRegion> regions;
+    const auto &graphics = session.graphics();
+    for (size_t i = 0; i < graphics.size(); ++i) {
+        const AnnotationKey key = SessionTransaction::keyOf(graphics[i]);
+        if (!key.bounds.isEmpty() && nameMatches(pattern, key.name)) {
+            regions.push_back(BoxRegion{ key.bounds, i, key.name });
+        }
+    }
+    return regions;
+}//end regionsMatching
+
+BoxRegion regionWithBounds(const SessionTransaction &session, const BoxRect &bounds, const std::string &name) {
+    BoxRegion region{ bounds, AnnotationIndex::npos, name };
+    //The annotations with exactly these bounds are among those inside them
+    std::vector<size_t> inside;
+    session.spatialIndex().within(bounds, inside);
+    for (size_t position : inside) {
+        const AnnotationKey key = SessionTransaction::keyOf(session.graphics()[position]);
+        if ((key.bounds.x == bounds.x) && (key.bounds.y == bounds.y) && (key.bounds.width == bounds.width)
+            && (key.bounds.height == bounds.height)
+            && ((region.position == AnnotationIndex::npos) || (position > region.position))) {
+            region.position = position;
+            region.name = key.name;
+        }
+    }
+    return region;
+}//end regionWithBounds
+
+std::vector<PlacedBox> dropBoxesOnRegions(SessionTransaction &session, const BoxSpec &spec,
+    const std::vector<BoxRegion> &regions, const TissueMask *mask, AnnotationJournal *journal,
+    std::vector<JournalRecord> &records, int64_t *rejections, int64_t *overlapRejections) {
+    std::vector<PlacedBox> placed;
+    std::vector<JournalRecord> regionRecords;
+    records.clear();
+    for (size_t r = 0; r < regions.size(); ++r) {
+        const BoxRegion &region = regions[r];
+        BoxSpec regionSpec = spec;
+        regionSpec.seed = spec.seed + r;
+        //Positions stay valid as boxes are added: placeholders are replaced in place, boxes appended
+        const std::vector<BoxRect> boxes = placeBoxes(regionSpec, region.bounds, mask, rejections,
+            &session.spatialIndex(), region.position, overlapRejections);
+        std::vector<PlacedBox> regionBoxes;
+        if (nullptr != journal) {
+            regionBoxes = journalBoxAnnotations(session, *journal, regionSpec, boxes, region.name,
+                region.position, regionRecords);
+            records.insert(records.end(), regionRecords.begin(), regionRecords.end());
+        }
+        else {
+            const GraphicStyle style = (region.position < session.graphics().size())
+                ? session.graphics()[region.position].getStyle() : GraphicStyle();
+            regionBoxes = addBoxAnnotations(session, regionSpec, boxes, region.name, style, region.position);
+        }
+        placed.insert(placed.end(), regionBoxes.begin(), regionBoxes.end());
+    }
+    return placed;
+}//end dropBoxesOnRegions
+
+int64_t latticeWorkingSetBytes(const std::vector<BoxRect> &boxes, int cellSize) {
+    if (boxes.empty() || (cellSize <= 0)) { return 0; }
+    int left = boxes.front().x, right = boxes.front().right(), tallest = 0;
+    for (const BoxRect &box : boxes) {
+        left = std::min(left, box.x);
+        right = std::max(right, box.right());
+        tallest = std::max(tallest, box.height);
+    }
+    //An unaligned span touches one more cell than it covers
+    const int64_t cellsAcross = (right - left + cellSize - 1) / cellSize + 1;
+    const int64_t cellsDown = (tallest + cellSize - 1) / cellSize + 1;
+    return cellsAcross * cellsDown * cellSize * cellSize * 3;
+}//end latticeWorkingSetBytes
+
+std::shared_ptr<TissueMask> buildTissueMask(TileSource &source, const Size &imageSize) {
+    auto mask = std::make_shared<TissueMask>();
+    if ((imageSize.width() <= 0) || (imageSize.height() <= 0)) { return mask; }
+    //Ask for a thumbnail of the whole image; the compositor reads it from a coarse pyramid level
+    const int THUMBNAIL_SIZE = 1024;
+    const double scale = std::min(1.0,
+        static_cast<double>(THUMBNAIL_SIZE) / std::max(imageSize.width(), imageSize.height()));
+    Size thumbnailSize;
+    thumbnailSize.setWidth(std::max(1, static_cast<int>(imageSize.width() * scale)));
+    thumbnailSize.setHeight(std::max(1, static_cast<int>(imageSize.height() * scale)));
+    image::RawImage thumbnail =
+        source.getImage(BoxRect(0, 0, imageSize.width(), imageSize.height()), thumbnailSize);
+    std::vector<uint8_t> rgb(static_cast<size_t>(thumbnail.width()) * thumbnail.height() * 3);
+    TileSource::copyToRGB(thumbnail, thumbnail.width(), thumbnail.height(), rgb.data(), thumbnail.width());
+    mask->build(rgb.data(), thumbnail.width(), thumbnail.height(), imageSize.width(), imageSize.height());
+    return mask;
+}//end buildTissueMask
+
+namespace {
+///Return the extension of path in lower case, including the dot
+std::string lowerCaseExtension(const std::string &path) {
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension;
+}//end lowerCaseExtension
+
+///Return true if path has a TIF extension (any case)
+bool isTiffPath(const std::string &path) {
+    const std::string extension = lowerCaseExtension(path);
+    return (extension == ".tif") || (extension == ".tiff");
+}//end isTiffPath
+
+///Return true if path has a JPG extension (any case)
+bool isJpegPath(const std::string &path) {
+    const std::string extension = lowerCaseExtension(path);
+    return (extension == ".jpg") || (extension == ".jpeg");
+}//end isJpegPath
+
+///Return true if box fits in a file written by BoxExporter::exportJpeg
+bool fitsJpeg(const BoxRect &box) {
+    return (box.width <= JpegEncoder::MaxDimension) && (box.height <= JpegEncoder::MaxDimension);
+}//end fitsJpeg
+} // namespace
+
+std::string exportProfileName(const ExportProfile &profile, const std::string &path) {
+    std::stringstream ss;
+    if (isTiffPath(path)) {
+        ss << "TIFF, " << TileCodec::name(profile.compression);
+        if (profile.compression == TileCodec::JPEG) { ss << " quality " << profile.jpegQuality; }
+    }
+    else if (isJpegPath(path)) {
+        ss << "JPEG, quality " << profile.jpegQuality;
+    }
+    else {
+        //Other formats, and JPG files too large for our encoder, are written by RawImage::save
+        const std::string extension = lowerCaseExtension(path);
+        ss << (extension.empty() ? extension : extension.substr(1)) << ", default encoder";
+    }
+    return ss.str();
+}//end exportProfileName
+
+std::string exportKey(const std::string &slidePath, const BoxRect &box, int extraLevels,
+    const std::string &path, const ExportProfile &profile) {
+    namespace fs = std::filesystem; //an alias
+    //The slide is identified as its session file is: by path, size and modification time
+    std::error_code ec;
+    const auto slideSize = fs::file_size(slidePath, ec);
+    const int64_t size = ec ? -1 : static_cast<int64_t>(slideSize);
+    const auto writeTime = fs::last_write_time(slidePath, ec);
+    const int64_t modified = ec ? -1 : static_cast<int64_t>(writeTime.time_since_epoch().count());
+    std::stringstream ss;
+    ss << slidePath << "|" << size << "|" << modified << "|" << box.x << "," << box.y << ","
+        << box.width << "," << box.height << "|" << lowerCaseExtension(path) << "|"
+        << exportProfileName(profile, path);
+    if (isTiffPath(path)) { ss << "|levels " << extraLevels; }
+    return ExportManifest::digest(ss.str());
+}//end exportKey
+
+bool exportBoxImage(std::shared_ptr<TileSource> source, const BoxRect &box, const std::string &path,
+    int extraLevels, ExportMonitor *monitor, const ExportProfile &profile, BoxStatistics *statistics) {
+    namespace fs = std::filesystem; //an alias
+    //TIF and JPG files are streamed to disk a tile or strip at a time, so memory use does not grow with the box
+    const bool jpeg = isJpegPath(path) && fitsJpeg(box);
+    if (isTiffPath(path) || jpeg) {
+        BoxExporter exporter(source);
+        exporter.setMonitor(monitor);
+        exporter.setCodec(TileCodec(profile.compression, profile.jpegQuality));
+        exporter.setEncodeThreads(profile.encodeThreads);
+        exporter.setStatistics(statistics);
+        return jpeg ? exporter.exportJpeg(box, path) : exporter.exportTiff(box, path, extraLevels);
+    }
+
+    //Other formats are composed in one piece and encoded by RawImage::save,
+    //which chooses the format from the file extension
+    if (monitor && monitor->isCancelled()) { return false; }
+    Size size;
+    size.setWidth(box.width);
+    size.setHeight(box.height);
+    image::RawImage outputImage = source->getImage(box, size);
+    if (monitor && monitor->isCancelled()) { return false; }
+    RunProfile *runProfile = source->profile();
+    const std::string partialPath = BoxExporter::partialFilePath(path);
+    bool imageSaved = false;
+    {
+        ScopedStageTimer timer(runProfile, RunProfile::Encoding);
+        imageSaved = outputImage.save(partialPath);
+    }
+    if (imageSaved && statistics && (outputImage.width() >= box.width) && (outputImage.height() >= box.height)) {
+        //The image is already in memory; only its pixel layout is converted
+        ScopedStageTimer timer(runProfile, RunProfile::Encoding);
+        std::vector<uint8_t> pixels(static_cast<size_t>(box.width) * box.height * 3);
+        TileSource::copyToRGB(outputImage, box.width, box.height, pixels.data(), box.width);
+        statistics->add(pixels.data(), box.width, box.height, box.width);
+    }
+    std::error_code ec;
+    if (imageSaved) {
+        fs::rename(partialPath, path, ec);
+        imageSaved = !ec;
+    }
+    if (!imageSaved) {
+        fs::remove(partialPath, ec);
+        return false;
+    }
+    if (monitor) { monitor->chunkDone(); }
+    if (runProfile) {
+        auto fileSize = fs::file_size(path, ec);
+        if (!ec) { runProfile->add(RunProfile::BytesWritten, static_cast<int64_t>(fileSize)); }
+        runProfile->add(RunProfile::BytesEncoded, static_cast<int64_t>(box.width) * box.height * 3);
+    }
+    return true;
+}//end exportBoxImage
+
+std::vector<TileKey> exportCellPlan(const TileSource &source, const std::vector<BoxRect> &boxes,
+    const std::vector<std::string> &paths) {
+    std::vector<TileKey> plan;
+    std::unordered_set<TileKey, TileKeyHash> listed;
+    std::vector<TileKey> cells;
+    auto addRegion = [&](const BoxRect &region) {
+        cells.clear();
+        source.appendCells(region, cells);
+        for (auto it = cells.begin(); it != cells.end(); ++it) {
+            if (listed.insert(*it).second) { plan.push_back(*it); }
+        }
+    };
+    //Follow the chunks each writer reads: bands, tiles in row-major order, or strips
+    for (size_t i = 0; (i < boxes.size()) && (i < paths.size()); ++i) {
+        const BoxRect &box = boxes[i];
+        int rows = 0;
+        if (PatchDataset::isDatasetPath(paths[i])) {
+            rows = PatchDataset::BandRows;
+        }
+        else if (isTiffPath(paths[i])) {
+            const int tileSize = BoxExporter::DefaultTileSize;
+            for (int y = 0; y < box.height; y += tileSize) {
+                for (int x = 0; x < box.width; x += tileSize) {
+                    addRegion(BoxRect(box.x + x, box.y + y,
+                        std::min(tileSize, box.width - x), std::min(tileSize, box.height - y)));
+                }
+            }
+        }
+        else if (isJpegPath(paths[i]) && fitsJpeg(box)) {
+            rows = BoxExporter::jpegStripRows(box.width);
+        }
+        for (int y = 0; (rows > 0) && (y < box.height); y += rows) {
+            addRegion(BoxRect(box.x, box.y + y, box.width, std::min(rows, box.height - y)));
+        }
+    }
+    return plan;
+}//end exportCellPlan
+
+int64_t exportChunkCount(const BoxRect &box, const std::string &path) {
+    if (PatchDataset::isDatasetPath(path)) {
+        return PatchDataset::bandCount(box);
+    }
+    if (isTiffPath(path)) {
+        return BoxExporter::tileCount(box);
+    }
+    if (isJpegPath(path) && fitsJpeg(box)) {
+        return BoxExporter::stripCount(box);
+    }
+    return 1;
+}//end exportChunkCount
+
+std::string statisticsTablePath(const std::string &path) {
+    namespace fs = std::filesystem; //an alias
+    fs::path filePath(path);
+    return filePath.replace_filename(filePath.stem().string() + ".stats.csv").string();
+}//end statisticsTablePath
+
+bool saveStatisticsTable(const std::string &path, const std::vector<StatisticsRecord> &records, bool append) {
+    namespace fs = std::filesystem; //an alias
+    std::error_code ec;
+    const bool isNew = !append || !fs::exists(path, ec) || (fs::file_size(path, ec) == 0);
+    std::ofstream out(path, append ? std::ios::app : std::ios::trunc);
+    if (!out) { return false; }
+    if (isNew) { BoxStatistics::writeCsvHeader(out); }
+    for (auto it = records.begin(); it != records.end(); ++it) {
+        if (it->values.empty()) { it->statistics.writeCsvRow(out, it->file, it->name, it->box); }
+        else { BoxStatistics::writeCsvRow(out, it->file, it->name, it->box, it->values); }
+    }
+    return static_cast<bool>(out);
+}//end saveStatisticsTable
+
+std::string numberedFilePath(const std::string &path, int index, int count) {
+    namespace fs = std::filesystem; //an alias
+    if (count <= 1) { return path; }
+    //Pad the box number to the width of the largest number, so the files sort in order
+    const int width = static_cast<int>(std::to_string(count).size());
+    std::stringstream ss;
+    fs::path filePath(path);
+    ss << filePath.stem().string() << "_" << std::setfill('0') << std::setw(width) << (index + 1)
+        << filePath.extension().string();
+    return filePath.replace_filename(ss.str()).string();
+}//end numberedFilePath
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,204 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_BOXPIPELINE_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_BOXPIPELINE_H
+
+// System headers
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Plugin headers
+#include "AnnotationJournal.h"
+#include "BoxPlacement.h"
+#include "BoxStatistics.h"
+#include "ExportMonitor.h"
+#include "PatchDataset.h"
+#include "SessionTransaction.h"
+#include "SpatialIndex.h"
+#include "TileCodec.h"
+#include "TileSource.h"
+#include "TissueMask.h"
+
+namespace sedeen {
+namespace algorithm {
+
+///The steps of a box drop that do not depend on the viewer: placing boxes, adding them
+///to the session, and saving their pixels. The plugin and the batch driver both use them.
+
+///How boxes are placed and described
+struct BoxSpec {
+    ///Drop count random boxes instead of one box centred on the region
+    bool randomSampling = false;
+    ///Cover the region with a lattice of boxes instead (randomSampling must be false)
+    bool lattice = false;
+    ///Distance between the corners of neighbouring lattice boxes; boxSize if 0
+    int latticeStride = 0;
+    int boxSize = 512;
+    int count = 1;
+    uint64_t seed = 1;
+    ///Minimum gap in pixels between random boxes
+    int spacing = 0;
+    ///Random and lattice boxes with less tissue than this are rejected; 0 accepts every box
+    double minTissueFraction = 0.0;
+    ///Description given to the box annotations
+    std::string description;
+    ///If above 1, boxes are aligned to a grid of this many pixels and cover whole cells of it,
+    ///so that they can be exported from whole cached tiles
+    int snapGrid = 0;
+    ///Boxes covered by an existing annotation over more than this fraction of their area are
+    ///rejected; 0 forbids any overlap and 1 disables the check
+    double maxOverlapFraction = 1.0;
+};
+
+///A placed box and the annotation name given to it
+struct PlacedBox {
+    BoxRect rect;
+    std::string name;
+};
+
+///Choose the boxes to drop inside region (or covering it, for a lattice). mask is only used (and must be given) if
+///spec.minTissueFraction > 0; the number of candidates it rejected is added to *rejections.
+///If spec.maxOverlapFraction < 1, boxes overlapping the annotations in existing (other than
+///ignoreId, the region's own annotation) by more than that are rejected, and counted in
+///*overlapRejections. A centred box that breaks the rule is not placed at all.
+std::vector<BoxRect> placeBoxes(const BoxSpec &spec, const BoxRect &region,
+    const TissueMask *mask, int64_t *rejections = nullptr, const SpatialIndex *existing = nullptr,
+    size_t ignoreId = SpatialIndex::npos, int64_t *overlapRejections = nullptr);
+
+///Add the annotations of boxes to session. A centred box keeps name, so that it replaces
+///the placeholder graphic at templatePosition; random and lattice boxes are numbered "name 1", "name 2", ...
+///The boxes copy the geometry of the template graphic if templatePosition is valid.
+std::vector<PlacedBox> addBoxAnnotations(SessionTransaction &session, const BoxSpec &spec,
+    const std::vector<BoxRect> &boxes, const std::string &name, const GraphicStyle &style,
+    size_t templatePosition);
+
+///Describe the boxes as journal records instead of adding them to session, named as
+///addBoxAnnotations names them. When the journal is compacted they copy the style of the graphic
+///at templatePosition, and a centred box replaces it. Boxes already in the session or the journal
+///with the same description are returned but not recorded.
+std::vector<PlacedBox> journalBoxAnnotations(const SessionTransaction &session, AnnotationJournal &journal,
+    const BoxSpec &spec, const std::vector<BoxRect> &boxes, const std::string &name,
+    size_t templatePosition, std::vector<JournalRecord> &records);
+
+///A region to drop boxes on: its bounds, the position of its annotation in the session
+///(or AnnotationIndex::npos if it has none) and the name given to its boxes
+struct BoxRegion {
+    BoxRect bounds;
+    size_t position;
+    std::string name;
+};
+
+///Return true if name matches pattern, in which * matches any run of characters and ? any one
+bool nameMatches(const std::string &pattern, const std::string &name);
+
+///Return a region for each annotation of session whose name matches pattern, in session order
+std::vector<BoxRegion> regionsMatching(const SessionTransaction &session, const std::string &pattern);
+
+///Return the region of the most recent annotation of session with these bounds. If there is
+///none, the region has no position and is named name.
+BoxRegion regionWithBounds(const SessionTransaction &session, const BoxRect &bounds, const std::string &name);
+
+///Place boxes on every region in turn, and add them to session, or describe them in records if
+///journal is given. Random boxes of the n-th region use the seed spec.seed + n. Later regions
+///avoid the boxes of earlier ones when spec.maxOverlapFraction < 1. Rejected candidates are
+///counted as by placeBoxes.
+std::vector<PlacedBox> dropBoxesOnRegions(SessionTransaction &session, const BoxSpec &spec,
+    const std::vector<BoxRegion> &regions, const TissueMask *mask, AnnotationJournal *journal,
+    std::vector<JournalRecord> &records, int64_t *rejections = nullptr, int64_t *overlapRejections = nullptr);
+
+///Bytes of cache cells of cellSize pixels needed to read every cell once when boxes, a lattice in
+///row-major order, are read one after another: a band of cells across the lattice as tall as
+///one box, plus a row of cells
+int64_t latticeWorkingSetBytes(const std::vector<BoxRect> &boxes, int cellSize);
+
+///Build the tissue mask of an image of level-0 size imageSize from a thumbnail read through source
+std::shared_ptr<TissueMask> buildTissueMask(TileSource &source, const Size &imageSize);
+
+///How box images are encoded
+struct ExportProfile {
+    ///Compression of TIF files
+    TileCodec::Compression compression = TileCodec::None;
+    ///Quality of JPG files and of JPEG-compressed TIF tiles
+    int jpegQuality = 90;
+    ///Threads reading and compressing the tiles or strips of one box
+    int encodeThreads = 1;
+};
+
+///Describe the profile used to write path, e.g. "TIFF, LZW" or "JPEG, quality 90"
+std::string exportProfileName(const ExportProfile &profile, const std::string &path);
+
+///Key of the export of box from the slide at slidePath to path, for ExportManifest: a digest of
+///the slide file's path, size and modification time, the box, the format of path, the parts of
+///profile that change the bytes written and, for TIF files, extraLevels. The description and
+///name of the box are not part of it, since they only reach the session.
+std::string exportKey(const std::string &slidePath, const BoxRect &box, int extraLevels,
+    const std::string &path, const ExportProfile &profile);
+
+///Save the pixels of box to path. TIF files are streamed tile by tile, with extraLevels
+///downsampled versions, and JPG files strip by strip; the tiles or strips are compressed as
+///profile asks, on its encode threads. Other formats are composed in one piece and encoded by
+///RawImage::save. Files are written under a temporary name and renamed when complete. If monitor
+///is given, progress is reported to it and the export stops early (returning false) when it is cancelled.
+///If statistics is given, the statistics of the pixels are added to it from the buffers being encoded.
+bool exportBoxImage(std::shared_ptr<TileSource> source, const BoxRect &box, const std::string &path,
+    int extraLevels = 0, ExportMonitor *monitor = nullptr, const ExportProfile &profile = ExportProfile(),
+    BoxStatistics *statistics = nullptr);
+
+///Cells of the tile cache grid of source that exportBoxImage (or PatchDataset::append, for a
+///.bdpatch path) reads to save each box to the path beside it, in the order they are read.
+///Each cell is listed once. Formats composed in one piece read no cells and add nothing.
+std::vector<TileKey> exportCellPlan(const TileSource &source, const std::vector<BoxRect> &boxes,
+    const std::vector<std::string> &paths);
+
+///Number of progress chunks exportBoxImage reports for box: output tiles for TIF, strips for JPG,
+///otherwise 1. For a patch dataset (.bdpatch), the bands PatchDataset::append reports.
+int64_t exportChunkCount(const BoxRect &box, const std::string &path);
+
+///One row of the statistics table: a saved box, the file it went to and the statistics of its pixels
+struct StatisticsRecord {
+    std::string file;
+    std::string name;
+    BoxRect box;
+    BoxStatistics statistics;
+    ///Statistics columns kept from an earlier export of the same pixels; written instead of statistics if set
+    std::string values;
+};
+
+///File the statistics of the boxes saved to path are written to: roi.tif becomes roi.stats.csv
+std::string statisticsTablePath(const std::string &path);
+
+///Write records to the CSV table at path, replacing it, or appending to it if append is true
+///(with a header if it is new)
+bool saveStatisticsTable(const std::string &path, const std::vector<StatisticsRecord> &records, bool append);
+
+///When several boxes are saved, append a zero-padded box number to the file name stem
+std::string numberedFilePath(const std::string &path, int index, int count);
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_BOXPIPELINE_H
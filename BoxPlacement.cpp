@@ -0,0 +1,231 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "BoxPlacement.h"
+
+// System headers
+#include <algorithm>
+#include <cstdlib>
+
+namespace sedeen {
+namespace algorithm {
+
+bool boxesIntersect(const BoxRect &a, const BoxRect &b) {
+    return (a.x < b.right()) && (b.x < a.right())
+        && (a.y < b.bottom()) && (b.y < a.bottom());
+}//end boxesIntersect
+
+int64_t intersectionArea(const BoxRect &a, const BoxRect &b) {
+    const int64_t w = std::min(a.right(), b.right()) - std::max(a.x, b.x);
+    const int64_t h = std::min(a.bottom(), b.bottom()) - std::max(a.y, b.y);
+    return ((w > 0) && (h > 0)) ? w * h : 0;
+}//end intersectionArea
+
+BoxRect centredBox(const BoxRect &region, int boxSize) {
+    //Same arithmetic as the original single-box placement in buildPipeline
+    const int xCenter = (region.x + region.right()) / 2;
+    const int yCenter = (region.y + region.bottom()) / 2;
+    return BoxRect(xCenter - boxSize / 2, yCenter - boxSize / 2, boxSize, boxSize);
+}//end centredBox
+
+namespace {
+///Integer division rounding towards negative infinity
+int floorDiv(int a, int b) {
+    return (a >= 0) ? (a / b) : -((-a + b - 1) / b);
+}
+} // namespace
+
+BoxRect snapToGrid(const BoxRect &box, int grid) {
+    if (grid <= 1) { return box; }
+    const int width = std::max(1, (box.width + grid - 1) / grid) * grid;
+    const int height = std::max(1, (box.height + grid - 1) / grid) * grid;
+    //Keep the centre where it was, as nearly as the grid allows
+    const int x = floorDiv(box.x + (box.width - width) / 2 + grid / 2, grid) * grid;
+    const int y = floorDiv(box.y + (box.height - height) / 2 + grid / 2, grid) * grid;
+    return BoxRect(x, y, width, height);
+}//end snapToGrid
+
+BoxRect gridCellsInside(const BoxRect &region, int grid) {
+    if (grid <= 1) { return region; }
+    const int x0 = -floorDiv(-region.x, grid);
+    const int y0 = -floorDiv(-region.y, grid);
+    const int x1 = floorDiv(region.right(), grid);
+    const int y1 = floorDiv(region.bottom(), grid);
+    return BoxRect(x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0));
+}//end gridCellsInside
+
+std::vector<BoxRect> latticeBoxes(const BoxRect &region, int boxSize, int stride, int grid) {
+    std::vector<BoxRect> boxes;
+    if (region.isEmpty() || (boxSize <= 0)) { return boxes; }
+    stride = (stride > 0) ? stride : boxSize;
+    if (grid > 1) {
+        boxSize = (boxSize + grid - 1) / grid * grid;
+        stride = (stride + grid - 1) / grid * grid;
+    }
+    //Corners along one axis of the region starting at start, length long
+    auto corners = [&](int start, int length) {
+        std::vector<int> positions;
+        if (grid > 1) {
+            for (int64_t p = static_cast<int64_t>(floorDiv(start, grid)) * grid; p < start + length; p += stride) {
+                positions.push_back(static_cast<int>(p));
+            }
+        }
+        else if (length <= boxSize) {
+            positions.push_back(start + (length - boxSize) / 2);
+        }
+        else {
+            for (int64_t offset = 0; offset + boxSize < length; offset += stride) {
+                positions.push_back(static_cast<int>(start + offset));
+            }
+            positions.push_back(start + length - boxSize);
+        }
+        return positions;
+    };
+    const std::vector<int> columns = corners(region.x, region.width);
+    const std::vector<int> rows = corners(region.y, region.height);
+    boxes.reserve(columns.size() * rows.size());
+    for (int y : rows) {
+        for (int x : columns) {
+            boxes.push_back(BoxRect(x, y, boxSize, boxSize));
+        }
+    }
+    return boxes;
+}//end latticeBoxes
+
+PoissonBoxSampler::PoissonBoxSampler(const BoxRect &bounds, int boxSize, int minGap, uint64_t seed)
+    : m_bounds(bounds),
+    m_boxSize(std::max(1, boxSize)),
+    m_spacing(m_boxSize + std::max(0, minGap)),
+    m_xRange(bounds.width - m_boxSize),
+    m_yRange(bounds.height - m_boxSize),
+    m_gridColumns(0),
+    m_gridRows(0),
+    m_grid(),
+    m_rng(seed),
+    m_candidates(0)
+{
+    //One top-left corner per cell: two corners in the same cell would be closer than m_spacing
+    if ((m_xRange >= 0) && (m_yRange >= 0)) {
+        m_gridColumns = m_xRange / m_spacing + 1;
+        m_gridRows = m_yRange / m_spacing + 1;
+    }
+}//end constructor
+
+std::vector<BoxRect> PoissonBoxSampler::sample(int count, const AcceptFunction &accept) {
+    std::vector<BoxRect> placed;
+    m_grid.clear();
+    m_candidates = 0;
+    if ((count <= 0) || (m_gridColumns == 0) || (m_gridRows == 0)) {
+        return placed;
+    }
+    placed.reserve(count);
+    const size_t target = static_cast<size_t>(count);
+    //Number of rejected candidates tolerated per requested box in each phase
+    const int attemptsPerBox = 30;
+
+    //Phase 1: dart throwing spreads the boxes uniformly over the whole bounds
+    const int64_t maxFailures = static_cast<int64_t>(attemptsPerBox) * count;
+    int64_t failures = 0;
+    while ((placed.size() < target) && (failures < maxFailures)) {
+        const int x = m_bounds.x + uniformInt(0, m_xRange);
+        const int y = m_bounds.y + uniformInt(0, m_yRange);
+        if (!tryPlace(x, y, accept, placed)) {
+            ++failures;
+        }
+    }
+
+    //Phase 2: once darts stop landing, grow from the placed boxes (Bridson's active list)
+    //to pack the remaining gaps
+    std::vector<int> active(placed.size());
+    for (size_t i = 0; i < active.size(); ++i) {
+        active[i] = static_cast<int>(i);
+    }
+    while (!active.empty() && (placed.size() < target)) {
+        const int pick = uniformInt(0, static_cast<int>(active.size()) - 1);
+        const BoxRect origin = placed[active[pick]];
+        bool found = false;
+        for (int k = 0; (k < attemptsPerBox) && !found; ++k) {
+            //Candidate in the square annulus between one and two spacings from the origin
+            const int dx = uniformInt(-2 * m_spacing, 2 * m_spacing);
+            const int dy = uniformInt(-2 * m_spacing, 2 * m_spacing);
+            if (std::max(std::abs(dx), std::abs(dy)) < m_spacing) { continue; }
+            if (tryPlace(origin.x + dx, origin.y + dy, accept, placed)) {
+                active.push_back(static_cast<int>(placed.size()) - 1);
+                found = true;
+            }
+        }
+        if (!found) {
+            //The neighbourhood of this box is full; retire it
+            active[pick] = active.back();
+            active.pop_back();
+        }
+    }
+    return placed;
+}//end sample
+
+int PoissonBoxSampler::uniformInt(int lo, int hi) {
+    //std::uniform_int_distribution differs between standard libraries, so map the raw
+    //engine output directly. The modulo bias is negligible for 64-bit output.
+    const uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(hi) - lo) + 1;
+    return static_cast<int>(lo + static_cast<int64_t>(m_rng() % range));
+}//end uniformInt
+
+bool PoissonBoxSampler::tryPlace(int x, int y, const AcceptFunction &accept, std::vector<BoxRect> &placed) {
+    //Reject corners that would put the box outside the bounds
+    if ((x < m_bounds.x) || (y < m_bounds.y)
+        || (x > m_bounds.x + m_xRange) || (y > m_bounds.y + m_yRange)) {
+        return false;
+    }
+    ++m_candidates;
+    if (!isFree(x, y, placed)) { return false; }
+    BoxRect candidate(x, y, m_boxSize, m_boxSize);
+    if (accept && !accept(candidate)) { return false; }
+
+    const int cx = (x - m_bounds.x) / m_spacing;
+    const int cy = (y - m_bounds.y) / m_spacing;
+    m_grid[cellKey(cx, cy)] = static_cast<int>(placed.size());
+    placed.push_back(candidate);
+    return true;
+}//end tryPlace
+
+bool PoissonBoxSampler::isFree(int x, int y, const std::vector<BoxRect> &placed) const {
+    const int cx = (x - m_bounds.x) / m_spacing;
+    const int cy = (y - m_bounds.y) / m_spacing;
+    //Any conflicting corner is within one spacing, so it lies in one of the 3x3 neighbouring cells
+    for (int ny = std::max(0, cy - 1); ny <= std::min(m_gridRows - 1, cy + 1); ++ny) {
+        for (int nx = std::max(0, cx - 1); nx <= std::min(m_gridColumns - 1, cx + 1); ++nx) {
+            auto it = m_grid.find(cellKey(nx, ny));
+            if (it == m_grid.end()) { continue; }
+            const BoxRect &other = placed[it->second];
+            if ((std::abs(other.x - x) < m_spacing) && (std::abs(other.y - y) < m_spacing)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}//end isFree
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,126 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_BOXPLACEMENT_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_BOXPLACEMENT_H
+
+// System headers
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+///An axis-aligned box in level-0 pixel coordinates, anchored at its top-left corner
+struct BoxRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    BoxRect() = default;
+    BoxRect(int x_, int y_, int w_, int h_) : x(x_), y(y_), width(w_), height(h_) {}
+
+    int right() const { return x + width; }
+    int bottom() const { return y + height; }
+    int64_t area() const { return static_cast<int64_t>(width) * height; }
+    bool isEmpty() const { return (width <= 0) || (height <= 0); }
+};
+
+///Return true if the two boxes share any area
+bool boxesIntersect(const BoxRect &a, const BoxRect &b);
+
+///Return the overlapping area of two boxes (0 if they do not intersect)
+int64_t intersectionArea(const BoxRect &a, const BoxRect &b);
+
+///Return a box of the given size centred on the centre of the region
+BoxRect centredBox(const BoxRect &region, int boxSize);
+
+///Return box with its origin moved to the nearest multiple of grid and its size rounded up to
+///whole cells, so that it covers whole tiles of a grid of that size anchored at the image origin
+BoxRect snapToGrid(const BoxRect &box, int grid);
+
+///Return the largest box of whole grid cells inside region, in units of cells
+BoxRect gridCellsInside(const BoxRect &region, int grid);
+
+///Return boxes of boxSize covering region in a lattice, their corners stride pixels apart
+///(boxSize if stride <= 0; boxes overlap if it is smaller), in row-major order so that neighbouring
+///boxes are read one after the other. The last row and column are moved back to end at the edge
+///of the region. If grid is above 1, the lattice starts on the grid and the size and stride are
+///rounded up to whole cells, so the last boxes may reach past the region instead.
+std::vector<BoxRect> latticeBoxes(const BoxRect &region, int boxSize, int stride, int grid = 0);
+
+///Places non-overlapping square boxes with blue-noise (Poisson-disk) spacing.
+///A uniform grid with one box per cell makes each conflict check constant time,
+///so placing N boxes costs O(N) rather than the O(N^2) of checking every pair.
+///The random sequence comes only from std::mt19937_64, whose output is fixed by
+///the standard, so the same seed reproduces the same boxes on every platform.
+class PoissonBoxSampler {
+public:
+    ///Boxes of boxSize x boxSize are placed fully inside bounds, separated by at least minGap pixels
+    PoissonBoxSampler(const BoxRect &bounds, int boxSize, int minGap, uint64_t seed);
+
+    ///Predicate used to veto candidate boxes (e.g. on glass, or over an existing annotation)
+    typedef std::function<bool(const BoxRect &)> AcceptFunction;
+
+    ///Place up to count boxes. Fewer are returned if the bounds are saturated.
+    std::vector<BoxRect> sample(int count, const AcceptFunction &accept = AcceptFunction());
+
+    ///Number of candidate positions examined by the last call to sample
+    int64_t candidatesTested() const { return m_candidates; }
+
+private:
+    ///Uniform integer in [lo, hi], computed the same way on every compiler
+    int uniformInt(int lo, int hi);
+
+    ///Try to add the box with top-left corner (x,y); return true if it was placed
+    bool tryPlace(int x, int y, const AcceptFunction &accept, std::vector<BoxRect> &placed);
+
+    ///Return true if no placed box lies within the exclusion distance of (x,y)
+    bool isFree(int x, int y, const std::vector<BoxRect> &placed) const;
+
+    int64_t cellKey(int cx, int cy) const { return static_cast<int64_t>(cy) * m_gridColumns + cx; }
+
+private:
+    BoxRect m_bounds;
+    int m_boxSize;
+    ///Minimum Chebyshev distance between two top-left corners (box size plus gap)
+    int m_spacing;
+    ///Largest valid top-left offsets within m_bounds
+    int m_xRange, m_yRange;
+    int m_gridColumns, m_gridRows;
+    ///Index into the placed vector of the box occupying each occupied cell.
+    ///Hashed so memory follows the number of boxes, not the area of the bounds.
+    std::unordered_map<int64_t, int> m_grid;
+    std::mt19937_64 m_rng;
+    int64_t m_candidates;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_BOXPLACEMENT_H
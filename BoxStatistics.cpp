@@ -0,0 +1,326 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "BoxStatistics.h"
+
+// System headers
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+// Plugin headers
+#include "TissueMask.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define BOXDROP_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+///Pixels darker than this are padding around the scanned area, as in TissueMask
+const int BlackThreshold = 25;
+
+///Weights of the channels in the luma, in 256ths (ITU-R BT.601)
+const int RedWeight = 77;
+const int GreenWeight = 150;
+const int BlueWeight = 29;
+
+///Quote a CSV field if it holds a separator, a quote or a line break
+std::string csvField(const std::string &text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) { return text; }
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"') { out += '"'; }
+        out += c;
+    }
+    return out + "\"";
+}//end csvField
+
+///Write the luma of a row of planar pixels to luma and return the number of background pixels.
+///The mean of the channels is compared through their sum: mean > t exactly when sum > 3t + 2.
+int64_t lumaAndBackground(const uint8_t *red, const uint8_t *green, const uint8_t *blue, int width,
+    int16_t *luma) {
+    const int saturationThreshold = TissueMask::DefaultSaturationThreshold;
+    const int brightSum = 3 * TissueMask::DefaultBrightnessThreshold + 2;
+    const int blackSum = 3 * BlackThreshold + 2;
+    int64_t background = 0;
+    int x = 0;
+#ifdef BOXDROP_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i maxUnsaturated = _mm_set1_epi8(static_cast<char>(saturationThreshold - 1));
+    const __m128i bright = _mm_set1_epi16(static_cast<short>(brightSum));
+    const __m128i black = _mm_set1_epi16(static_cast<short>(blackSum));
+    const __m128i redWeight = _mm_set1_epi16(RedWeight);
+    const __m128i greenWeight = _mm_set1_epi16(GreenWeight);
+    const __m128i blueWeight = _mm_set1_epi16(BlueWeight);
+    const __m128i half = _mm_set1_epi16(128);
+    for (; x + 16 <= width; x += 16) {
+        const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(red + x));
+        const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(green + x));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(blue + x));
+        //Saturation (max - min) below the threshold, on 16 bytes
+        const __m128i saturation = _mm_subs_epu8(_mm_max_epu8(r, _mm_max_epu8(g, b)),
+            _mm_min_epu8(r, _mm_min_epu8(g, b)));
+        const __m128i unsaturated = _mm_cmpeq_epi8(_mm_min_epu8(saturation, maxUnsaturated), saturation);
+        //Channel sums and luma on two halves of 8 16-bit values
+        const __m128i rl = _mm_unpacklo_epi8(r, zero), rh = _mm_unpackhi_epi8(r, zero);
+        const __m128i gl = _mm_unpacklo_epi8(g, zero), gh = _mm_unpackhi_epi8(g, zero);
+        const __m128i bl = _mm_unpacklo_epi8(b, zero), bh = _mm_unpackhi_epi8(b, zero);
+        const __m128i sumLo = _mm_add_epi16(_mm_add_epi16(rl, gl), bl);
+        const __m128i sumHi = _mm_add_epi16(_mm_add_epi16(rh, gh), bh);
+        const __m128i isBright = _mm_packs_epi16(_mm_cmpgt_epi16(sumLo, bright), _mm_cmpgt_epi16(sumHi, bright));
+        const __m128i notBlack = _mm_packs_epi16(_mm_cmpgt_epi16(sumLo, black), _mm_cmpgt_epi16(sumHi, black));
+        const __m128i isBackground = _mm_or_si128(_mm_and_si128(unsaturated, isBright),
+            _mm_cmpeq_epi8(notBlack, zero));
+        background += std::bitset<16>(static_cast<unsigned>(_mm_movemask_epi8(isBackground))).count();
+        //The weighted sum stays below 65536, so it is exact in unsigned 16-bit arithmetic
+        const __m128i lumaLo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(rl, redWeight),
+            _mm_mullo_epi16(gl, greenWeight)), _mm_add_epi16(_mm_mullo_epi16(bl, blueWeight), half)), 8);
+        const __m128i lumaHi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(rh, redWeight),
+            _mm_mullo_epi16(gh, greenWeight)), _mm_add_epi16(_mm_mullo_epi16(bh, blueWeight), half)), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(luma + x), lumaLo);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(luma + x + 8), lumaHi);
+    }
+#endif
+    for (; x < width; ++x) {
+        const int r = red[x], g = green[x], b = blue[x];
+        const int saturation = std::max(r, std::max(g, b)) - std::min(r, std::min(g, b));
+        const int sum = r + g + b;
+        if ((sum <= blackSum) || ((saturation < saturationThreshold) && (sum > brightSum))) { ++background; }
+        luma[x] = static_cast<int16_t>((RedWeight * r + GreenWeight * g + BlueWeight * b + 128) >> 8);
+    }
+    return background;
+}//end lumaAndBackground
+
+///Add the 4-neighbour Laplacian of the inside columns of row, between the rows above and below,
+///to sum and squares
+void addLaplacian(const int16_t *above, const int16_t *row, const int16_t *below, int width,
+    int64_t &sum, int64_t &squares) {
+    int x = 1;
+#ifdef BOXDROP_USE_SSE2
+    const __m128i ones = _mm_set1_epi16(1);
+    while (x + 8 <= width - 1) {
+        //Each 32-bit lane of squared gains at most 2 x 1020^2 per step, so it is emptied every 256 steps
+        __m128i summed = _mm_setzero_si128();
+        __m128i squared = _mm_setzero_si128();
+        for (int step = 0; (step < 256) && (x + 8 <= width - 1); ++step, x += 8) {
+            const __m128i centre = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+            const __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x - 1));
+            const __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x + 1));
+            const __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + x));
+            const __m128i down = _mm_loadu_si128(reinterpret_cast<const __m128i *>(below + x));
+            const __m128i laplacian = _mm_sub_epi16(_mm_slli_epi16(centre, 2),
+                _mm_add_epi16(_mm_add_epi16(left, right), _mm_add_epi16(up, down)));
+            summed = _mm_add_epi32(summed, _mm_madd_epi16(laplacian, ones));
+            squared = _mm_add_epi32(squared, _mm_madd_epi16(laplacian, laplacian));
+        }
+        int32_t lanes[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), summed);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes + 4), squared);
+        sum += static_cast<int64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        squares += static_cast<int64_t>(lanes[4]) + lanes[5] + lanes[6] + lanes[7];
+    }
+#endif
+    for (; x < width - 1; ++x) {
+        const int laplacian = 4 * row[x] - row[x - 1] - row[x + 1] - above[x] - below[x];
+        sum += laplacian;
+        squares += laplacian * laplacian;
+    }
+}//end addLaplacian
+
+} // namespace
+
+BoxStatistics::BoxStatistics()
+    : m_pixels(0),
+    m_background(0),
+    m_laplacianCount(0),
+    m_laplacianSum(0),
+    m_laplacianSquares(0)
+{
+    clear();
+}//end constructor
+
+void BoxStatistics::clear() {
+    std::fill(&m_histogram[0][0], &m_histogram[0][0] + 3 * Bins, 0);
+    m_pixels = 0;
+    m_background = 0;
+    m_laplacianCount = 0;
+    m_laplacianSum = 0;
+    m_laplacianSquares = 0;
+}//end clear
+
+void BoxStatistics::add(const uint8_t *rgb, int width, int height, int stride) {
+    if ((width <= 0) || (height <= 0)) { return; }
+    //Two 32-bit histograms per channel, for even and odd pixels, so that runs of equal values
+    //(glass) do not wait on the same counter. They are emptied before they can overflow.
+    std::vector<uint32_t> counts(2 * 3 * Bins, 0);
+    int64_t pending = 0;
+    auto flush = [&]() {
+        for (int c = 0; c < 3; ++c) {
+            for (int v = 0; v < Bins; ++v) {
+                m_histogram[c][v] += counts[c * Bins + v] + counts[(3 + c) * Bins + v];
+            }
+        }
+        std::fill(counts.begin(), counts.end(), 0);
+        pending = 0;
+    };
+    //The channels of the current row, split into planes, and the luma of the last three rows
+    std::vector<uint8_t> planes(static_cast<size_t>(width) * 3);
+    std::vector<int16_t> luma(static_cast<size_t>(width) * 3);
+    uint8_t *red = planes.data();
+    uint8_t *green = red + width;
+    uint8_t *blue = green + width;
+    uint32_t *even = counts.data();
+    uint32_t *odd = even + 3 * Bins;
+    for (int y = 0; y < height; ++y) {
+        const uint8_t *row = rgb + static_cast<size_t>(y) * stride * 3;
+        //Histograms do not vectorize; the channels are split on the same pass
+        int x = 0;
+        for (; x + 1 < width; x += 2) {
+            const uint8_t *p = row + 3 * x;
+            ++even[p[0]];
+            ++even[Bins + p[1]];
+            ++even[2 * Bins + p[2]];
+            ++odd[p[3]];
+            ++odd[Bins + p[4]];
+            ++odd[2 * Bins + p[5]];
+            red[x] = p[0];
+            green[x] = p[1];
+            blue[x] = p[2];
+            red[x + 1] = p[3];
+            green[x + 1] = p[4];
+            blue[x + 1] = p[5];
+        }
+        if (x < width) {
+            const uint8_t *p = row + 3 * x;
+            ++even[p[0]];
+            ++even[Bins + p[1]];
+            ++even[2 * Bins + p[2]];
+            red[x] = p[0];
+            green[x] = p[1];
+            blue[x] = p[2];
+        }
+        pending += width;
+        if (pending > (int64_t(1) << 31)) { flush(); }
+
+        int16_t *current = luma.data() + static_cast<size_t>(y % 3) * width;
+        m_background += lumaAndBackground(red, green, blue, width, current);
+        if ((y >= 2) && (width >= 3)) {
+            addLaplacian(luma.data() + static_cast<size_t>((y - 2) % 3) * width,
+                luma.data() + static_cast<size_t>((y - 1) % 3) * width, current, width,
+                m_laplacianSum, m_laplacianSquares);
+            m_laplacianCount += width - 2;
+        }
+    }
+    flush();
+    m_pixels += static_cast<int64_t>(width) * height;
+}//end add
+
+void BoxStatistics::merge(const BoxStatistics &other) {
+    for (int c = 0; c < 3; ++c) {
+        for (int v = 0; v < Bins; ++v) {
+            m_histogram[c][v] += other.m_histogram[c][v];
+        }
+    }
+    m_pixels += other.m_pixels;
+    m_background += other.m_background;
+    m_laplacianCount += other.m_laplacianCount;
+    m_laplacianSum += other.m_laplacianSum;
+    m_laplacianSquares += other.m_laplacianSquares;
+}//end merge
+
+double BoxStatistics::mean(int channel) const {
+    if (m_pixels <= 0) { return 0.0; }
+    uint64_t sum = 0;
+    for (int v = 0; v < Bins; ++v) {
+        sum += m_histogram[channel][v] * v;
+    }
+    return static_cast<double>(sum) / m_pixels;
+}//end mean
+
+double BoxStatistics::standardDeviation(int channel) const {
+    if (m_pixels <= 0) { return 0.0; }
+    uint64_t squares = 0;
+    for (int v = 0; v < Bins; ++v) {
+        squares += m_histogram[channel][v] * v * v;
+    }
+    const double average = mean(channel);
+    return std::sqrt(std::max(0.0, static_cast<double>(squares) / m_pixels - average * average));
+}//end standardDeviation
+
+double BoxStatistics::laplacianVariance() const {
+    if (m_laplacianCount <= 0) { return 0.0; }
+    const double average = static_cast<double>(m_laplacianSum) / m_laplacianCount;
+    return std::max(0.0, static_cast<double>(m_laplacianSquares) / m_laplacianCount - average * average);
+}//end laplacianVariance
+
+double BoxStatistics::backgroundFraction() const {
+    return (m_pixels > 0) ? static_cast<double>(m_background) / m_pixels : 0.0;
+}//end backgroundFraction
+
+void BoxStatistics::writeCsvHeader(std::ostream &out) {
+    out << "file,name,x,y,width,height,mean_r,mean_g,mean_b,std_r,std_g,std_b,"
+        << "laplacian_variance,background_fraction,histogram_r,histogram_g,histogram_b\n";
+}//end writeCsvHeader
+
+void BoxStatistics::writeCsvRow(std::ostream &out, const std::string &file, const std::string &name,
+    const BoxRect &box) const {
+    writeCsvRow(out, file, name, box, csvValues());
+}//end writeCsvRow
+
+std::string BoxStatistics::csvValues() const {
+    std::stringstream out;
+    out << std::fixed << std::setprecision(3);
+    for (int c = 0; c < 3; ++c) { out << (c ? "," : "") << mean(c); }
+    for (int c = 0; c < 3; ++c) { out << "," << standardDeviation(c); }
+    out << "," << laplacianVariance() << "," << std::setprecision(5) << backgroundFraction();
+    //Each histogram is one field of CsvBins counts separated by spaces
+    const int group = Bins / CsvBins;
+    for (int c = 0; c < 3; ++c) {
+        out << ",";
+        for (int bin = 0; bin < CsvBins; ++bin) {
+            uint64_t count = 0;
+            for (int v = bin * group; v < (bin + 1) * group; ++v) { count += m_histogram[c][v]; }
+            out << ((bin > 0) ? " " : "") << count;
+        }
+    }
+    return out.str();
+}//end csvValues
+
+void BoxStatistics::writeCsvRow(std::ostream &out, const std::string &file, const std::string &name,
+    const BoxRect &box, const std::string &values) {
+    out << csvField(file) << "," << csvField(name) << "," << box.x << "," << box.y << ","
+        << box.width << "," << box.height << "," << values << "\n";
+}//end writeCsvRow
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,110 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_BOXSTATISTICS_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_BOXSTATISTICS_H
+
+// System headers
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Plugin headers
+#include "BoxPlacement.h"
+
+namespace sedeen {
+namespace algorithm {
+
+///Quality-control statistics of the pixels of one box, gathered from the buffers the export
+///already holds so that no pixel is read twice: a histogram of each channel (from which the
+///mean and standard deviation follow exactly), the variance of the Laplacian of the luma as a
+///measure of focus, and the fraction of background, classified as TissueMask does.
+///Blocks (tiles, strips or bands) can be added in any order and statistics merged, so each
+///export thread keeps its own. The Laplacian needs both neighbours of a pixel, so it is taken
+///over the inside of each block; the outermost rows and columns are only used as neighbours.
+///The per-pixel work runs on SSE2 where available.
+class BoxStatistics {
+public:
+    ///Number of bins of each channel histogram
+    static const int Bins = 256;
+    ///Number of bins of each histogram in the CSV table (groups of Bins / CsvBins values)
+    static const int CsvBins = 16;
+
+    BoxStatistics();
+
+    ///Forget every pixel added
+    void clear();
+
+    ///Add a width x height block of 8-bit RGB pixels, rows stride pixels apart
+    void add(const uint8_t *rgb, int width, int height, int stride);
+
+    ///Add the pixels counted by other
+    void merge(const BoxStatistics &other);
+
+    ///Number of pixels added
+    int64_t pixels() const { return m_pixels; }
+
+    ///Number of pixels with value in channel (0 red, 1 green, 2 blue)
+    uint64_t histogram(int channel, int value) const { return m_histogram[channel][value]; }
+
+    ///Mean value of channel
+    double mean(int channel) const;
+
+    ///Standard deviation of channel
+    double standardDeviation(int channel) const;
+
+    ///Variance of the 4-neighbour Laplacian of the luma; low for blurred or empty boxes
+    double laplacianVariance() const;
+
+    ///Fraction (0 to 1) of the pixels that are glass or scanner padding
+    double backgroundFraction() const;
+
+    ///Write the names of the columns written by writeCsvRow
+    static void writeCsvHeader(std::ostream &out);
+
+    ///Write one line describing the box saved to file
+    void writeCsvRow(std::ostream &out, const std::string &file, const std::string &name,
+        const BoxRect &box) const;
+
+    ///The statistics columns of a line of the table, without the file, name and box
+    std::string csvValues() const;
+
+    ///Write one line describing the box saved to file, with statistics columns kept from an earlier export
+    static void writeCsvRow(std::ostream &out, const std::string &file, const std::string &name,
+        const BoxRect &box, const std::string &values);
+
+private:
+    uint64_t m_histogram[3][Bins];
+    int64_t m_pixels;
+    int64_t m_background;
+    ///Number of Laplacian values, their sum and their sum of squares
+    int64_t m_laplacianCount;
+    int64_t m_laplacianSum;
+    int64_t m_laplacianSquares;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_BOXSTATISTICS_H
@@ -0,0 +1,110 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "Downsample.h"
+
+// System headers
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define BOXDROP_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace sedeen {
+namespace algorithm {
+
+void downsampleRGB2x2(const uint8_t *src, int srcWidth, int srcHeight, int srcStride,
+    uint8_t *dst, int dstStride) {
+    const int rowBytes = srcWidth * 3;
+    //Column sums of two rows, then sums of horizontally adjacent pixels (3 values apart).
+    //The padding lets the vector loops read past the end of the row.
+    std::vector<uint16_t> vertical(rowBytes + 16, 0);
+    std::vector<uint16_t> quad(rowBytes + 16, 0);
+    for (int y = 0; y + 1 < srcHeight; y += 2) {
+        const uint8_t *row0 = src + static_cast<size_t>(y) * srcStride * 3;
+        const uint8_t *row1 = row0 + static_cast<size_t>(srcStride) * 3;
+        int i = 0;
+#ifdef BOXDROP_USE_SSE2
+        //Widen 16 bytes of each row to 16 bits and add them
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= rowBytes; i += 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + i));
+            const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&vertical[i]), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&vertical[i + 8]), hi);
+        }
+#endif
+        for (; i < rowBytes; ++i) {
+            vertical[i] = static_cast<uint16_t>(row0[i] + row1[i]);
+        }
+
+        //quad[j] = vertical[j] + vertical[j+3]: for j = 6x + c this is the 2x2 sum of channel c
+        const int sums = rowBytes - 3;
+        i = 0;
+#ifdef BOXDROP_USE_SSE2
+        for (; i + 8 <= sums; i += 8) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&vertical[i]));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&vertical[i + 3]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&quad[i]), _mm_add_epi16(a, b));
+        }
+#endif
+        for (; i < sums; ++i) {
+            quad[i] = static_cast<uint16_t>(vertical[i] + vertical[i + 3]);
+        }
+
+        uint8_t *out = dst + static_cast<size_t>(y / 2) * dstStride * 3;
+        for (int x = 0; x < srcWidth / 2; ++x) {
+            const uint16_t *q = &quad[6 * x];
+            out[3 * x] = static_cast<uint8_t>((q[0] + 2) >> 2);
+            out[3 * x + 1] = static_cast<uint8_t>((q[1] + 2) >> 2);
+            out[3 * x + 2] = static_cast<uint8_t>((q[2] + 2) >> 2);
+        }
+    }
+}//end downsampleRGB2x2
+
+void replicateEdgesRGB(uint8_t *tile, int validWidth, int validHeight, int tileSize) {
+    if ((validWidth <= 0) || (validHeight <= 0)) { return; }
+    const size_t rowBytes = static_cast<size_t>(tileSize) * 3;
+    if (validWidth < tileSize) {
+        for (int y = 0; y < validHeight; ++y) {
+            uint8_t *row = tile + y * rowBytes;
+            const uint8_t *last = row + (validWidth - 1) * 3;
+            for (int x = validWidth; x < tileSize; ++x) {
+                std::copy(last, last + 3, row + x * 3);
+            }
+        }
+    }
+    const uint8_t *lastRow = tile + (validHeight - 1) * rowBytes;
+    for (int y = validHeight; y < tileSize; ++y) {
+        std::copy(lastRow, lastRow + rowBytes, tile + y * rowBytes);
+    }
+}//end replicateEdgesRGB
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,46 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_DOWNSAMPLE_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_DOWNSAMPLE_H
+
+// System headers
+#include <cstdint>
+
+namespace sedeen {
+namespace algorithm {
+
+///Halve an 8-bit RGB image with a 2x2 box (area) filter, rounding to nearest.
+///srcWidth and srcHeight must be even; strides are in pixels. Uses SSE2 where available.
+void downsampleRGB2x2(const uint8_t *src, int srcWidth, int srcHeight, int srcStride,
+    uint8_t *dst, int dstStride);
+
+///Copy the last valid column and row of an 8-bit RGB tile into its padding, so that
+///filtering across the edge of the image does not darken the edge pixels
+void replicateEdgesRGB(uint8_t *tile, int validWidth, int validHeight, int tileSize);
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_DOWNSAMPLE_H
@@ -0,0 +1,123 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "ExportEngine.h"
+
+// System headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace sedeen {
+namespace algorithm {
+
+ExportEngine::ExportEngine(int threads)
+    : m_threads((threads < 1) ? defaultThreadCount() : threads),
+    m_statistics(),
+    m_monitor(nullptr),
+    m_waitClock()
+{
+}//end constructor
+
+int ExportEngine::defaultThreadCount() {
+    const unsigned int n = std::thread::hardware_concurrency();
+    return (n == 0) ? 1 : static_cast<int>(n);
+}//end defaultThreadCount
+
+std::vector<int> ExportEngine::run(size_t count, const Task &task, const ProgressFunction &progress) {
+    typedef std::chrono::steady_clock Clock;
+    std::vector<int> states(count, NotRun);
+    m_statistics = Statistics();
+    m_statistics.tasks = static_cast<int>(count);
+    m_statistics.threads = static_cast<int>(std::min<size_t>(m_threads, std::max<size_t>(count, 1)));
+    if (count == 0) { return states; }
+
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> done(0);
+    std::atomic<bool> cancelled(false);
+    std::atomic<int64_t> busyNanoseconds(0);
+    std::atomic<int64_t> waitNanoseconds(0);
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    //Each worker takes the next unstarted task until none are left or the batch is cancelled
+    auto worker = [&]() {
+        for (size_t i = next++; (i < count) && !cancelled; i = next++) {
+            const auto start = Clock::now();
+            const double waitedBefore = m_waitClock ? m_waitClock() : 0.0;
+            bool ok = false;
+            try {
+                ok = task(i);
+            }
+            catch (...) {
+                ok = false;
+            }
+            busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            if (m_waitClock) { waitNanoseconds += static_cast<int64_t>((m_waitClock() - waitedBefore) * 1e9); }
+            states[i] = ok ? Succeeded : Failed;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++done;
+            }
+            finished.notify_one();
+        }
+    };
+
+    const auto batchStart = Clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < m_statistics.threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    //Report progress from this thread as tasks finish, until all are done or the batch is cancelled
+    size_t reported = 0;
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait_for(lock, std::chrono::milliseconds(ProgressInterval), [&]() { return done != reported; });
+        const size_t d = done;
+        lock.unlock();
+        if (progress && !progress(d, count)) {
+            cancelled = true;
+            if (m_monitor) { m_monitor->cancel(); }
+        }
+        reported = d;
+        //Once cancelled, join waits for the tasks already started; those watching the monitor stop at their next chunk
+        if ((d == count) || cancelled) { break; }
+    }
+    for (auto it = pool.begin(); it != pool.end(); ++it) {
+        it->join();
+    }
+
+    m_statistics.wallSeconds = std::chrono::duration<double>(Clock::now() - batchStart).count();
+    m_statistics.busySeconds = busyNanoseconds * 1e-9;
+    m_statistics.waitSeconds = waitNanoseconds * 1e-9;
+    m_statistics.succeeded = static_cast<int>(std::count(states.begin(), states.end(), static_cast<int>(Succeeded)));
+    return states;
+}//end run
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,114 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_EXPORTENGINE_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_EXPORTENGINE_H
+
+// System headers
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Plugin headers
+#include "ExportMonitor.h"
+
+namespace sedeen {
+namespace algorithm {
+
+///Runs a batch of independent export tasks (one per box) on a pool of worker threads.
+///The calling thread stays free to report progress and to cancel the batch: it is the
+///only thread that calls the progress function.
+class ExportEngine {
+public:
+    ///Timing of the last batch
+    struct Statistics {
+        int tasks = 0;
+        int succeeded = 0;
+        int threads = 0;
+        ///Elapsed time of the whole batch
+        double wallSeconds = 0.0;
+        ///Sum of the time spent in each task
+        double busySeconds = 0.0;
+        ///Part of busySeconds the workers spent waiting on each other, as told by the wait clock
+        double waitSeconds = 0.0;
+
+        double tasksPerSecond() const { return (wallSeconds > 0.0) ? tasks / wallSeconds : 0.0; }
+        ///Working time (busy time less waits), i.e. roughly what a single thread would have
+        ///needed, over the elapsed time
+        double speedup() const {
+            return (wallSeconds > 0.0) ? std::max(0.0, busySeconds - waitSeconds) / wallSeconds : 0.0;
+        }
+    };
+
+    ///Outcome of each task
+    enum TaskState {
+        NotRun = -1,
+        Failed = 0,
+        Succeeded = 1
+    };
+
+    ///Performs task number index; returns true on success. Called concurrently from the workers.
+    typedef std::function<bool(size_t index)> Task;
+    ///Receives the number of finished tasks; return false to cancel the tasks not yet started
+    typedef std::function<bool(size_t done, size_t total)> ProgressFunction;
+    ///Returns the seconds the calling thread has spent so far waiting for the other workers,
+    ///e.g. TileSource::threadWaitSeconds
+    typedef std::function<double()> WaitClock;
+
+    ///Use the given number of worker threads, or one per core if threads < 1
+    explicit ExportEngine(int threads = 0);
+
+    ///Run tasks 0 to count-1 and return the state of each. The progress function is called
+    ///at least every ProgressInterval milliseconds, and whenever a task finishes.
+    std::vector<int> run(size_t count, const Task &task,
+        const ProgressFunction &progress = ProgressFunction());
+
+    ///Cancelling the batch also cancels monitor, so that tasks watching it stop mid-way
+    void setMonitor(ExportMonitor *monitor) { m_monitor = monitor; }
+
+    ///Leave the waits measured by clock, around each task, out of its working time
+    void setWaitClock(const WaitClock &clock) { m_waitClock = clock; }
+
+    ///Longest time in milliseconds between calls to the progress function
+    static const int ProgressInterval = 50;
+
+    const Statistics &statistics() const { return m_statistics; }
+
+    int threads() const { return m_threads; }
+
+    ///Number of hardware threads, at least 1
+    static int defaultThreadCount();
+
+private:
+    int m_threads;
+    Statistics m_statistics;
+    ExportMonitor *m_monitor;
+    WaitClock m_waitClock;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_EXPORTENGINE_H
@@ -0,0 +1,281 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "ExportManifest.h"
+
+// System headers
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+///First line of every manifest file
+const char *MANIFEST_HEADER = "BoxDropManifest 1";
+
+///Manifests of one directory may be shared by several exports of a batch
+std::mutex manifestMutex;
+
+int64_t fileSizeOf(const std::string &path) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : static_cast<int64_t>(size);
+}//end fileSizeOf
+
+///Cut off a last line left without its newline by an interrupted write, so that the next
+///line appended starts on a line of its own. Returns the new size, or -1 if it cannot be cut.
+int64_t trimPartialLine(const std::string &path) {
+    const int64_t size = fileSizeOf(path);
+    if (size == 0) { return 0; }
+    std::ifstream in(path.c_str(), std::ios::binary);
+    char last = 0;
+    in.seekg(size - 1);
+    if (in.get(last) && (last == '\n')) { return size; }
+    in.clear();
+    in.seekg(0);
+    const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    const size_t end = text.rfind('\n');
+    const int64_t kept = (end == std::string::npos) ? 0 : static_cast<int64_t>(end) + 1;
+    std::error_code ec;
+    std::filesystem::resize_file(path, static_cast<uintmax_t>(kept), ec);
+    return ec ? -1 : kept;
+}//end trimPartialLine
+
+///Size and modification time of the file at path; returns false if it does not exist
+bool fileStamp(const std::string &path, int64_t &size, int64_t &modified) {
+    namespace fs = std::filesystem; //an alias
+    std::error_code ec;
+    const auto fileSize = fs::file_size(path, ec);
+    if (ec) { return false; }
+    const auto writeTime = fs::last_write_time(path, ec);
+    if (ec) { return false; }
+    size = static_cast<int64_t>(fileSize);
+    modified = static_cast<int64_t>(writeTime.time_since_epoch().count());
+    return true;
+}//end fileStamp
+
+std::string entryLine(const ExportManifest::Entry &entry, const std::string &name) {
+    std::stringstream ss;
+    ss << entry.key << "\t" << name << "\t" << entry.size << "\t" << entry.modified << "\t"
+        << entry.statistics << "\n";
+    return ss.str();
+}//end entryLine
+
+///Parse one entry line; returns false if it is malformed
+bool parseEntry(const std::string &line, ExportManifest::Entry &entry, std::string &name) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, '\t')) { fields.push_back(field); }
+    if (fields.size() == 4) { fields.push_back(std::string()); }
+    if ((fields.size() != 5) || fields[0].empty() || fields[1].empty()) { return false; }
+    try {
+        entry.key = fields[0];
+        name = fields[1];
+        entry.size = std::stoll(fields[2]);
+        entry.modified = std::stoll(fields[3]);
+        entry.statistics = fields[4];
+    }
+    catch (const std::exception &) {
+        return false;
+    }
+    return true;
+}//end parseEntry
+} // namespace
+
+ExportManifest::ExportManifest()
+    : m_filePath(),
+    m_knownSize(-1),
+    m_lines(0),
+    m_entries(),
+    m_files()
+{
+}//end constructor
+
+void ExportManifest::open(const std::string &outputPath) {
+    const std::string path = manifestFilePathFor(outputPath);
+    if (path == m_filePath) { return; }
+    m_filePath = path;
+    m_knownSize = -1;
+    m_lines = 0;
+    m_entries.clear();
+    m_files.clear();
+}//end open
+
+bool ExportManifest::find(const std::string &key, const std::string &path, Entry &entry) {
+    std::lock_guard<std::mutex> lock(manifestMutex);
+    refresh();
+    const std::string name = std::filesystem::path(path).filename().string();
+    auto self = m_entries.find(name);
+    if ((self != m_entries.end()) && (self->second.key == key) && isUnchanged(self->second)) {
+        entry = self->second;
+        return true;
+    }
+    auto names = m_files.find(key);
+    if (names == m_files.end()) { return false; }
+    for (auto it = names->second.begin(); it != names->second.end(); ++it) {
+        auto other = m_entries.find(*it);
+        //A file recorded under key may since have been written with another export
+        if ((other != m_entries.end()) && (other->second.key == key) && isUnchanged(other->second)) {
+            entry = other->second;
+            return true;
+        }
+    }
+    return false;
+}//end find
+
+bool ExportManifest::record(const std::string &key, const std::string &path, const std::string &statistics) {
+    Entry entry;
+    entry.key = key;
+    entry.path = path;
+    entry.statistics = statistics;
+    if (!fileStamp(path, entry.size, entry.modified)) { return false; }
+    const std::string name = std::filesystem::path(path).filename().string();
+
+    std::lock_guard<std::mutex> lock(manifestMutex);
+    refresh();
+    const int64_t sizeBefore = trimPartialLine(m_filePath);
+    if (sizeBefore < 0) { return false; }
+    std::string text = entryLine(entry, name);
+    if (sizeBefore == 0) { text = std::string(MANIFEST_HEADER) + "\n" + text; }
+    std::ofstream out(m_filePath.c_str(), std::ios::binary | std::ios::out | std::ios::app);
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    out.flush();
+    if (!out.good()) { return false; }
+    //Keep the entries current without rereading, unless someone else changed the file
+    if (sizeBefore == m_knownSize) {
+        m_knownSize = sizeBefore + static_cast<int64_t>(text.size());
+        ++m_lines;
+        m_entries[name] = entry;
+        m_files[key].push_back(name);
+    }
+    return true;
+}//end record
+
+size_t ExportManifest::entryCount() {
+    std::lock_guard<std::mutex> lock(manifestMutex);
+    refresh();
+    return m_entries.size();
+}//end entryCount
+
+void ExportManifest::refresh() {
+    const int64_t size = fileSizeOf(m_filePath);
+    if (size == m_knownSize) { return; }
+    m_lines = 0;
+    m_entries.clear();
+    m_files.clear();
+    m_knownSize = size;
+    std::ifstream in(m_filePath.c_str(), std::ios::binary);
+    std::string line;
+    if (!in || !std::getline(in, line) || (line != MANIFEST_HEADER)) { return; }
+    const std::filesystem::path directory = std::filesystem::path(m_filePath).parent_path();
+    while (std::getline(in, line)) {
+        //The last line has no newline only if its write was interrupted
+        if (in.eof()) { break; }
+        Entry entry;
+        std::string name;
+        if (!parseEntry(line, entry, name)) { continue; }
+        ++m_lines;
+        entry.path = (directory / name).string();
+        m_entries[name] = entry;
+        m_files[entry.key].push_back(name);
+    }
+    //Every export of a file appends a line; drop the superseded ones once they are the majority
+    if (m_lines > 2 * m_entries.size() + 16) { compact(); }
+}//end refresh
+
+bool ExportManifest::compact() {
+    namespace fs = std::filesystem; //an alias
+    const std::string tempFilePath = m_filePath + ".tmp";
+    std::stringstream ss;
+    ss << MANIFEST_HEADER << "\n";
+    m_files.clear();
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        ss << entryLine(it->second, it->first);
+        m_files[it->second.key].push_back(it->first);
+    }
+    m_lines = m_entries.size();
+    const std::string text = ss.str();
+    {
+        std::ofstream out(tempFilePath.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+        if (!out.good()) { return false; }
+    }
+    std::error_code ec;
+    fs::rename(tempFilePath, m_filePath, ec);
+    if (ec) {
+        fs::remove(tempFilePath, ec);
+        return false;
+    }
+    m_knownSize = static_cast<int64_t>(text.size());
+    return true;
+}//end compact
+
+bool ExportManifest::isUnchanged(const Entry &entry) {
+    int64_t size = 0;
+    int64_t modified = 0;
+    return fileStamp(entry.path, size, modified) && (size == entry.size) && (modified == entry.modified);
+}//end isUnchanged
+
+bool ExportManifest::linkFile(const Entry &entry, const std::string &path) {
+    namespace fs = std::filesystem; //an alias
+    std::error_code ec;
+    if (fs::equivalent(entry.path, path, ec)) { return true; }
+    //Exports write a temporary file and rename it over the old one, so a later export to
+    //either name replaces that name only and never changes the shared file
+    fs::remove(path, ec);
+    fs::create_hard_link(entry.path, path, ec);
+    if (!ec) { return true; }
+    ec.clear();
+    fs::copy_file(entry.path, path, fs::copy_options::overwrite_existing, ec);
+    return !ec;
+}//end linkFile
+
+std::string ExportManifest::digest(const std::string &text) {
+    //64-bit FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    std::stringstream ss;
+    ss << std::hex << std::setfill('0') << std::setw(16) << hash;
+    return ss.str();
+}//end digest
+
+std::string ExportManifest::manifestFilePathFor(const std::string &outputPath) {
+    //One manifest per directory, so that files exported under another name can be linked
+    std::filesystem::path path(outputPath);
+    return path.replace_filename("boxdrop.manifest").string();
+}//end manifestFilePathFor
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,109 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_EXPORTMANIFEST_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_EXPORTMANIFEST_H
+
+// System headers
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+///Append-only sidecar file, one per output directory, recording the box images exported to it.
+///Each line maps the key of an export (a digest of everything that decides its pixels: the
+///slide, the box, the extra levels, the format and the encoding) to the file written, its size
+///and modification time, and the statistics columns of the box. An export whose key is recorded
+///for a file that is unchanged since need not be done again: the file is kept, or linked to the
+///new name. A file is recorded only once it is complete, so an interrupted batch resumes where
+///it stopped. The file is rewritten without superseded lines when they outnumber the current ones.
+class ExportManifest {
+public:
+    ///A complete export: path is the file in the manifest's directory
+    struct Entry {
+        std::string key;
+        std::string path;
+        int64_t size = 0;
+        int64_t modified = 0;
+        ///Statistics columns of the statistics table, or empty
+        std::string statistics;
+    };
+
+    ExportManifest();
+
+    ///Use the manifest of the directory of outputPath
+    void open(const std::string &outputPath);
+
+    ///Find a file holding the export of key that is unchanged since it was recorded, preferring
+    ///path itself. Returns false if there is none.
+    bool find(const std::string &key, const std::string &path, Entry &entry);
+
+    ///Record that path now holds the export of key. A last line cut short by an interrupted
+    ///write is removed first. Returns false if the write failed.
+    bool record(const std::string &key, const std::string &path, const std::string &statistics);
+
+    ///Number of files recorded
+    size_t entryCount();
+
+    const std::string &filePath() const { return m_filePath; }
+
+    ///Make path another name of the file of entry: a hard link, or a copy if the file system
+    ///cannot link. An existing file at path is replaced.
+    static bool linkFile(const Entry &entry, const std::string &path);
+
+    ///Digest of the text describing an export, as 16 hexadecimal digits
+    static std::string digest(const std::string &text);
+
+    ///Return the manifest file path used for outputs beside outputPath
+    static std::string manifestFilePathFor(const std::string &outputPath);
+
+private:
+    ///Reread the file if its size is not the one last seen
+    void refresh();
+
+    ///Rewrite the file with the current entries only
+    bool compact();
+
+    ///Return true if the file of entry has the size and time recorded
+    static bool isUnchanged(const Entry &entry);
+
+private:
+    std::string m_filePath;
+    ///Size of the file when m_entries was last brought up to date
+    int64_t m_knownSize;
+    ///Lines read, including superseded ones
+    size_t m_lines;
+    ///The latest entry of each file name
+    std::unordered_map<std::string, Entry> m_entries;
+    ///File names recorded under each key
+    std::unordered_map<std::string, std::vector<std::string>> m_files;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_EXPORTMANIFEST_H
@@ -0,0 +1,68 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_EXPORTMONITOR_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_EXPORTMONITOR_H
+
+// System headers
+#include <atomic>
+#include <cstdint>
+
+namespace sedeen {
+namespace algorithm {
+
+///Progress and cancellation shared between the thread that watches an export and the
+///workers doing it. Work is counted in chunks (output tiles, or whole images for formats
+///that are encoded in one piece); workers check isCancelled between chunks.
+class ExportMonitor {
+public:
+    ExportMonitor() : m_cancelled(false), m_chunksPlanned(0), m_chunksDone(0) {}
+
+    ///Ask the workers to stop after their current chunk
+    void cancel() { m_cancelled = true; }
+    bool isCancelled() const { return m_cancelled; }
+
+    ///Add chunks to the total expected
+    void addPlanned(int64_t chunks) { m_chunksPlanned += chunks; }
+    void chunkDone() { ++m_chunksDone; }
+
+    int64_t chunksPlanned() const { return m_chunksPlanned; }
+    int64_t chunksDone() const { return m_chunksDone; }
+
+    ///Fraction of the planned chunks that are done, 0 to 1
+    double fractionDone() const {
+        const int64_t planned = m_chunksPlanned;
+        return (planned > 0) ? static_cast<double>(m_chunksDone) / planned : 0.0;
+    }
+
+private:
+    std::atomic<bool> m_cancelled;
+    std::atomic<int64_t> m_chunksPlanned;
+    std::atomic<int64_t> m_chunksDone;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_EXPORTMONITOR_H
@@ -0,0 +1,394 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "JpegEncoder.h"
+
+// System headers
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+///Natural (row-major) position of each coefficient in zigzag order
+const uint8_t ZIGZAG[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+
+///Example quantization tables of the JPEG standard (Annex K.1), in natural order
+const uint8_t LUMA_QUANT[64] = {
+    16, 11, 10, 16,  24,  40,  51,  61,
+    12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,
+    14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,
+    24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103,  99 };
+const uint8_t CHROMA_QUANT[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99 };
+
+///Standard Huffman tables (Annex K.3): number of codes of each length 1-16, then the symbols
+const uint8_t LUMA_DC_COUNTS[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const uint8_t LUMA_DC_SYMBOLS[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+const uint8_t CHROMA_DC_COUNTS[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const uint8_t CHROMA_DC_SYMBOLS[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+const uint8_t LUMA_AC_COUNTS[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+const uint8_t LUMA_AC_SYMBOLS[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa };
+const uint8_t CHROMA_AC_COUNTS[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const uint8_t CHROMA_AC_SYMBOLS[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa };
+
+///Scale factors of the AAN DCT for each row and column
+const float AAN_SCALE[8] = {
+    1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+///Forward DCT of 8 values, step apart (Arai, Agui and Nakajima), scaled by AAN_SCALE
+void fdct8(float *d, int step) {
+    float *p[8];
+    for (int i = 0; i < 8; ++i) { p[i] = d + i * step; }
+    const float tmp0 = *p[0] + *p[7], tmp7 = *p[0] - *p[7];
+    const float tmp1 = *p[1] + *p[6], tmp6 = *p[1] - *p[6];
+    const float tmp2 = *p[2] + *p[5], tmp5 = *p[2] - *p[5];
+    const float tmp3 = *p[3] + *p[4], tmp4 = *p[3] - *p[4];
+
+    //Even part
+    float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+    float tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+    *p[0] = tmp10 + tmp11;
+    *p[4] = tmp10 - tmp11;
+    const float z1 = (tmp12 + tmp13) * 0.707106781f;
+    *p[2] = tmp13 + z1;
+    *p[6] = tmp13 - z1;
+
+    //Odd part
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+    const float z5 = (tmp10 - tmp12) * 0.382683433f;
+    const float z2 = tmp10 * 0.541196100f + z5;
+    const float z4 = tmp12 * 1.306562965f + z5;
+    const float z3 = tmp11 * 0.707106781f;
+    const float z11 = tmp7 + z3, z13 = tmp7 - z3;
+    *p[5] = z13 + z2;
+    *p[3] = z13 - z2;
+    *p[1] = z11 + z4;
+    *p[7] = z11 - z4;
+}//end fdct8
+
+///Number of bits needed for the magnitude of value (its JPEG category)
+int bitLength(int value) {
+    int magnitude = std::abs(value);
+    int bits = 0;
+    while (magnitude) {
+        ++bits;
+        magnitude >>= 1;
+    }
+    return bits;
+}//end bitLength
+
+void put16(std::vector<uint8_t> &out, int value) {
+    out.push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
+    out.push_back(static_cast<uint8_t>(value & 0xFF));
+}//end put16
+
+} // namespace
+
+///Packs Huffman codes most significant bit first, inserting a zero byte after every 0xFF
+class JpegEncoder::BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t> &out) : m_out(out), m_buffer(0), m_count(0) {}
+
+    void put(uint32_t bits, int length) {
+        m_buffer = (m_buffer << length) | (bits & ((1u << length) - 1));
+        m_count += length;
+        while (m_count >= 8) {
+            m_count -= 8;
+            const uint8_t byte = static_cast<uint8_t>((m_buffer >> m_count) & 0xFF);
+            m_out.push_back(byte);
+            if (byte == 0xFF) { m_out.push_back(0); }
+        }
+        m_buffer &= (1u << m_count) - 1;
+    }
+
+    ///Pad the last byte with 1 bits
+    void flush() {
+        if (m_count > 0) { put(0x7F, 8 - m_count); }
+    }
+
+private:
+    std::vector<uint8_t> &m_out;
+    uint32_t m_buffer;
+    int m_count;
+};
+
+JpegEncoder::JpegEncoder(int quality, int channels)
+    : m_quality(std::max(1, std::min(100, quality))),
+    m_channels((channels == 1) ? 1 : 3)
+{
+    //Scale the example tables as libjpeg does for its quality setting
+    const int scale = (m_quality < 50) ? (5000 / m_quality) : (200 - 2 * m_quality);
+    for (int k = 0; k < 64; ++k) {
+        const int natural = ZIGZAG[k];
+        const int luma = std::max(1, std::min(255, (LUMA_QUANT[natural] * scale + 50) / 100));
+        const int chroma = std::max(1, std::min(255, (CHROMA_QUANT[natural] * scale + 50) / 100));
+        m_lumaTable[k] = static_cast<uint8_t>(luma);
+        m_chromaTable[k] = static_cast<uint8_t>(chroma);
+        const float aan = AAN_SCALE[natural / 8] * AAN_SCALE[natural % 8] * 8.0f;
+        m_lumaDivisors[natural] = 1.0f / (luma * aan);
+        m_chromaDivisors[natural] = 1.0f / (chroma * aan);
+    }
+    buildHuffmanTable(LUMA_DC_COUNTS, LUMA_DC_SYMBOLS, m_lumaDC);
+    buildHuffmanTable(LUMA_AC_COUNTS, LUMA_AC_SYMBOLS, m_lumaAC);
+    buildHuffmanTable(CHROMA_DC_COUNTS, CHROMA_DC_SYMBOLS, m_chromaDC);
+    buildHuffmanTable(CHROMA_AC_COUNTS, CHROMA_AC_SYMBOLS, m_chromaAC);
+}//end constructor
+
+void JpegEncoder::buildHuffmanTable(const uint8_t *counts, const uint8_t *symbols, HuffmanTable &table) {
+    //Canonical codes: consecutive values within a length, doubled when the length grows
+    std::fill(table.code, table.code + 256, 0);
+    std::fill(table.length, table.length + 256, 0);
+    uint16_t code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; ++length) {
+        for (int i = 0; i < counts[length - 1]; ++i) {
+            table.code[symbols[k]] = code++;
+            table.length[symbols[k]] = static_cast<uint8_t>(length);
+            ++k;
+        }
+        code <<= 1;
+    }
+}//end buildHuffmanTable
+
+bool JpegEncoder::encode(const uint8_t *pixels, int width, int height, int stride, std::vector<uint8_t> &out) const {
+    if ((width <= 0) || (height <= 0) || (width > MaxDimension) || (height > MaxDimension)) { return false; }
+    writeHeader(width, height, 0, out);
+    encodeSegment(pixels, width, height, stride, out);
+    writeEnd(out);
+    return true;
+}//end encode
+
+void JpegEncoder::writeHeader(int width, int height, int restartInterval, std::vector<uint8_t> &out) const {
+    const int components = m_channels;
+    //Start of image, and a JFIF segment so that viewers read the components as YCbCr
+    out.insert(out.end(), { 0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00,
+        0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00 });
+
+    //Quantization tables
+    out.push_back(0xFF);
+    out.push_back(0xDB);
+    put16(out, 2 + 65 * ((components == 3) ? 2 : 1));
+    out.push_back(0x00);
+    out.insert(out.end(), m_lumaTable, m_lumaTable + 64);
+    if (components == 3) {
+        out.push_back(0x01);
+        out.insert(out.end(), m_chromaTable, m_chromaTable + 64);
+    }
+
+    //Frame header: luma sampled 2x2 relative to chroma in colour images
+    out.push_back(0xFF);
+    out.push_back(0xC0);
+    put16(out, 8 + 3 * components);
+    out.push_back(8);
+    put16(out, height);
+    put16(out, width);
+    out.push_back(static_cast<uint8_t>(components));
+    for (int c = 0; c < components; ++c) {
+        out.push_back(static_cast<uint8_t>(c + 1));
+        out.push_back((components == 3) && (c == 0) ? 0x22 : 0x11);
+        out.push_back((c == 0) ? 0 : 1);
+    }
+
+    //Huffman tables
+    auto writeTable = [&out](int tableClass, int id, const uint8_t *counts, const uint8_t *symbols) {
+        int total = 0;
+        for (int i = 0; i < 16; ++i) { total += counts[i]; }
+        out.push_back(0xFF);
+        out.push_back(0xC4);
+        put16(out, 2 + 1 + 16 + total);
+        out.push_back(static_cast<uint8_t>((tableClass << 4) | id));
+        out.insert(out.end(), counts, counts + 16);
+        out.insert(out.end(), symbols, symbols + total);
+    };
+    writeTable(0, 0, LUMA_DC_COUNTS, LUMA_DC_SYMBOLS);
+    writeTable(1, 0, LUMA_AC_COUNTS, LUMA_AC_SYMBOLS);
+    if (components == 3) {
+        writeTable(0, 1, CHROMA_DC_COUNTS, CHROMA_DC_SYMBOLS);
+        writeTable(1, 1, CHROMA_AC_COUNTS, CHROMA_AC_SYMBOLS);
+    }
+
+    if (restartInterval > 0) {
+        out.push_back(0xFF);
+        out.push_back(0xDD);
+        put16(out, 4);
+        put16(out, restartInterval);
+    }
+
+    //Start of scan
+    out.push_back(0xFF);
+    out.push_back(0xDA);
+    put16(out, 6 + 2 * components);
+    out.push_back(static_cast<uint8_t>(components));
+    for (int c = 0; c < components; ++c) {
+        out.push_back(static_cast<uint8_t>(c + 1));
+        out.push_back((c == 0) ? 0x00 : 0x11);
+    }
+    out.push_back(0);
+    out.push_back(63);
+    out.push_back(0);
+}//end writeHeader
+
+void JpegEncoder::writeRestartMarker(int segment, std::vector<uint8_t> &out) {
+    out.push_back(0xFF);
+    out.push_back(static_cast<uint8_t>(0xD0 + (segment & 7)));
+}//end writeRestartMarker
+
+void JpegEncoder::writeEnd(std::vector<uint8_t> &out) {
+    out.push_back(0xFF);
+    out.push_back(0xD9);
+}//end writeEnd
+
+void JpegEncoder::encodeSegment(const uint8_t *pixels, int width, int rows, int stride, std::vector<uint8_t> &out) const {
+    BitWriter bits(out);
+    const int mcu = mcuSize();
+    int previousY = 0, previousCb = 0, previousCr = 0;
+    float y[4][64], cb[64], cr[64];
+    for (int top = 0; top < rows; top += mcu) {
+        for (int left = 0; left < width; left += mcu) {
+            if (m_channels == 1) {
+                //Pixels past the edge repeat the last row and column
+                for (int j = 0; j < 8; ++j) {
+                    const uint8_t *row = pixels + static_cast<size_t>(std::min(top + j, rows - 1)) * stride;
+                    for (int i = 0; i < 8; ++i) {
+                        y[0][j * 8 + i] = row[std::min(left + i, width - 1)] - 128.0f;
+                    }
+                }
+                previousY = encodeBlock(y[0], m_lumaDivisors, previousY, m_lumaDC, m_lumaAC, bits);
+                continue;
+            }
+            //Convert a 16x16 block to YCbCr, averaging chroma over 2x2 pixels
+            std::fill(cb, cb + 64, 0.0f);
+            std::fill(cr, cr + 64, 0.0f);
+            for (int j = 0; j < 16; ++j) {
+                const uint8_t *row = pixels + static_cast<size_t>(std::min(top + j, rows - 1)) * stride * 3;
+                for (int i = 0; i < 16; ++i) {
+                    const uint8_t *p = row + static_cast<size_t>(std::min(left + i, width - 1)) * 3;
+                    const float r = p[0], g = p[1], b = p[2];
+                    y[(j / 8) * 2 + (i / 8)][(j % 8) * 8 + (i % 8)] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+                    const int c = (j / 2) * 8 + (i / 2);
+                    cb[c] += 0.25f * (-0.168736f * r - 0.331264f * g + 0.5f * b);
+                    cr[c] += 0.25f * (0.5f * r - 0.418688f * g - 0.081312f * b);
+                }
+            }
+            for (int k = 0; k < 4; ++k) {
+                previousY = encodeBlock(y[k], m_lumaDivisors, previousY, m_lumaDC, m_lumaAC, bits);
+            }
+            previousCb = encodeBlock(cb, m_chromaDivisors, previousCb, m_chromaDC, m_chromaAC, bits);
+            previousCr = encodeBlock(cr, m_chromaDivisors, previousCr, m_chromaDC, m_chromaAC, bits);
+        }
+    }
+    bits.flush();
+}//end encodeSegment
+
+int JpegEncoder::encodeBlock(float *block, const float *divisors, int previousDC,
+    const HuffmanTable &dc, const HuffmanTable &ac, BitWriter &bits) const {
+    for (int row = 0; row < 8; ++row) { fdct8(block + row * 8, 1); }
+    for (int column = 0; column < 8; ++column) { fdct8(block + column, 8); }
+    int coefficients[64];
+    for (int k = 0; k < 64; ++k) {
+        const int natural = ZIGZAG[k];
+        const float v = block[natural] * divisors[natural];
+        coefficients[k] = static_cast<int>(std::lround(v));
+    }
+
+    //DC: category of the difference from the previous block, then its low bits
+    const int difference = coefficients[0] - previousDC;
+    const int dcBits = bitLength(difference);
+    bits.put(dc.code[dcBits], dc.length[dcBits]);
+    if (dcBits > 0) {
+        bits.put(static_cast<uint32_t>((difference < 0) ? difference - 1 : difference), dcBits);
+    }
+
+    //AC: runs of zeros and the category of the next value; end of block after the last value
+    int last = 63;
+    while ((last > 0) && (coefficients[last] == 0)) { --last; }
+    int run = 0;
+    for (int k = 1; k <= last; ++k) {
+        if (coefficients[k] == 0) {
+            ++run;
+            continue;
+        }
+        while (run >= 16) {
+            bits.put(ac.code[0xF0], ac.length[0xF0]);
+            run -= 16;
+        }
+        const int value = coefficients[k];
+        const int acBits = bitLength(value);
+        const int symbol = (run << 4) | acBits;
+        bits.put(ac.code[symbol], ac.length[symbol]);
+        bits.put(static_cast<uint32_t>((value < 0) ? value - 1 : value), acBits);
+        run = 0;
+    }
+    if (last < 63) {
+        bits.put(ac.code[0x00], ac.length[0x00]);
+    }
+    return coefficients[0];
+}//end encodeBlock
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,102 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_JPEGENCODER_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_JPEGENCODER_H
+
+// System headers
+#include <cstdint>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+///Baseline JPEG encoder for 8-bit RGB (stored as YCbCr 4:2:0) or greyscale pixels,
+///with the standard Huffman tables and quantization tables scaled by quality as in libjpeg.
+///An image can be encoded as independent restart segments, one horizontal strip of MCU rows
+///each, so strips can be encoded on several threads and joined in order.
+///All methods are const, so one encoder can be shared by several threads.
+class JpegEncoder {
+public:
+    ///quality is 1 (smallest) to 100 (best); channels is 3 (RGB) or 1 (grey)
+    JpegEncoder(int quality, int channels);
+
+    int quality() const { return m_quality; }
+    int channels() const { return m_channels; }
+
+    ///Height and width in pixels of a minimum coded unit: 16 for RGB, 8 for grey
+    int mcuSize() const { return (m_channels == 3) ? 16 : 8; }
+
+    ///Largest width or height a JPEG image can have
+    static const int MaxDimension = 65535;
+
+    ///Encode a whole image into out as a complete JPEG stream. pixels has rows stride pixels apart.
+    bool encode(const uint8_t *pixels, int width, int height, int stride, std::vector<uint8_t> &out) const;
+
+    ///Append the markers that precede the entropy-coded data of a width x height image.
+    ///restartInterval > 0 makes every restartInterval MCUs an independent segment.
+    void writeHeader(int width, int height, int restartInterval, std::vector<uint8_t> &out) const;
+
+    ///Append the entropy-coded data of rows of pixels (a multiple of mcuSize rows, except at
+    ///the bottom of the image) of an image of the given width, padded to a whole byte.
+    ///Each call starts a new restart segment.
+    void encodeSegment(const uint8_t *pixels, int width, int rows, int stride, std::vector<uint8_t> &out) const;
+
+    ///Append restart marker RSTn, n being the segment number modulo 8
+    static void writeRestartMarker(int segment, std::vector<uint8_t> &out);
+
+    ///Append the end of image marker
+    static void writeEnd(std::vector<uint8_t> &out);
+
+private:
+    ///Huffman code and length of each symbol of one table
+    struct HuffmanTable {
+        uint16_t code[256];
+        uint8_t length[256];
+    };
+
+    class BitWriter;
+
+    ///Transform, quantize and entropy-code one 8x8 block; returns its DC coefficient
+    int encodeBlock(float *block, const float *divisors, int previousDC,
+        const HuffmanTable &dc, const HuffmanTable &ac, BitWriter &bits) const;
+
+    static void buildHuffmanTable(const uint8_t *counts, const uint8_t *symbols, HuffmanTable &table);
+
+private:
+    int m_quality;
+    int m_channels;
+    ///Quantization tables in zigzag order, as written to the file
+    uint8_t m_lumaTable[64];
+    uint8_t m_chromaTable[64];
+    ///Reciprocal quantizer step including the scale factors of the DCT, in natural order
+    float m_lumaDivisors[64];
+    float m_chromaDivisors[64];
+    HuffmanTable m_lumaDC, m_lumaAC, m_chromaDC, m_chromaAC;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_JPEGENCODER_H
@@ -0,0 +1,318 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "PatchDataset.h"
+
+// System headers
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+#ifdef BOXDROP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+///Version written in the header of each shard
+const uint32_t SHARD_VERSION = 1;
+
+///First row of every index file
+const char *INDEX_HEADER = "shard,offset,bytes,width,height,channels,encoding,slide,x,y,name,description";
+
+///Quote a CSV field if it holds a separator, a quote or a line break
+std::string csvField(const std::string &text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) { return text; }
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"') { out += '"'; }
+        out += c;
+    }
+    return out + "\"";
+}//end csvField
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}//end alignUp
+
+///Number of the shard in an index row's shard file name, stem.NNNNN.bdshard, or -1
+int shardNumber(const std::string &fileName) {
+    const size_t end = fileName.rfind('.');
+    const size_t start = (end == std::string::npos || end == 0) ? std::string::npos : fileName.rfind('.', end - 1);
+    if (start == std::string::npos) { return -1; }
+    try {
+        return std::stoi(fileName.substr(start + 1, end - start - 1));
+    }
+    catch (const std::exception &) {
+        return -1;
+    }
+}//end shardNumber
+
+void putLittleEndian32(uint8_t *out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) { out[i] = static_cast<uint8_t>(value >> (8 * i)); }
+}//end putLittleEndian32
+} // namespace
+
+PatchDataset::PatchDataset()
+    : m_indexPath(),
+    m_encoding(Raw),
+    m_shardBytes(DefaultShardBytes),
+    m_mutex(),
+    m_shard(0),
+    m_shardEnd(0),
+    m_records(0)
+{
+}//end constructor
+
+bool PatchDataset::open(const std::string &indexPath, Encoding encoding, uint64_t shardBytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_indexPath.clear();
+    if (!isAvailable(encoding)) { return false; }
+    m_encoding = encoding;
+    m_shardBytes = std::max<uint64_t>(shardBytes, HeaderBytes);
+    m_shard = 0;
+    m_shardEnd = 0;
+    m_records = 0;
+
+    //Find the end of the last record of the last shard
+    std::ifstream in(indexPath.c_str(), std::ios::binary);
+    if (in) {
+        std::string line;
+        std::getline(in, line);
+        while (std::getline(in, line)) {
+            std::stringstream ss(line);
+            std::string shardName, offset, bytes;
+            if (!std::getline(ss, shardName, ',') || !std::getline(ss, offset, ',') || !std::getline(ss, bytes, ',')) {
+                continue;
+            }
+            const int shard = shardNumber(shardName);
+            if (shard < 0) { continue; }
+            uint64_t end = 0;
+            try {
+                end = std::stoull(offset) + std::stoull(bytes);
+            }
+            catch (const std::exception &) {
+                continue;
+            }
+            ++m_records;
+            if (shard > m_shard) {
+                m_shard = shard;
+                m_shardEnd = 0;
+            }
+            if (shard == m_shard) { m_shardEnd = std::max(m_shardEnd, end); }
+        }
+        in.close();
+        //Drop what an interrupted append wrote after the last indexed record
+        if (m_shardEnd > 0) {
+            std::error_code ec;
+            const std::string path = shardPath(indexPath, m_shard);
+            if (std::filesystem::file_size(path, ec) > m_shardEnd) {
+                std::filesystem::resize_file(path, m_shardEnd, ec);
+            }
+        }
+    }
+    else {
+        std::ofstream out(indexPath.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+        out << INDEX_HEADER << "\n";
+        if (!out) { return false; }
+    }
+    m_indexPath = indexPath;
+    return true;
+}//end open
+
+bool PatchDataset::append(TileSource &source, const Record &record, ExportMonitor *monitor,
+    BoxStatistics *statistics) {
+    const BoxRect &box = record.box;
+    if (!isOpen() || box.isEmpty()) { return false; }
+    RunProfile *profile = source.profile();
+    const uint64_t rowBytes = static_cast<uint64_t>(box.width) * 3;
+    const uint64_t rawBytes = rowBytes * box.height;
+    std::vector<uint8_t> band;
+    //Read the box a band at a time, handing each band to write
+    auto readBands = [&](const std::function<bool(const uint8_t *, uint64_t, bool)> &write) {
+        for (int y = 0; y < box.height; y += BandRows) {
+            if (monitor && monitor->isCancelled()) { return false; }
+            const int rows = std::min(BandRows, box.height - y);
+            if (!source.readRegion(BoxRect(box.x, box.y + y, box.width, rows), band, box.width, rows)) {
+                return false;
+            }
+            {
+                ScopedStageTimer timer(profile, RunProfile::Encoding);
+                if (statistics) { statistics->add(band.data(), box.width, rows, box.width); }
+                if (!write(band.data(), rowBytes * rows, y + rows >= box.height)) { return false; }
+            }
+            if (monitor) { monitor->chunkDone(); }
+        }
+        return true;
+    };
+
+    int shard = 0;
+    uint64_t offset = 0;
+    uint64_t bytes = 0;
+    if (m_encoding == Raw) {
+        //The size is known, so the space is reserved first and the pixels go straight to the shard
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!reserve(rawBytes, shard, offset)) { return false; }
+        }
+        std::fstream out(shardPath(m_indexPath, shard).c_str(), std::ios::binary | std::ios::in | std::ios::out);
+        out.seekp(static_cast<std::streamoff>(offset));
+        const bool complete = readBands([&](const uint8_t *data, uint64_t size, bool) {
+            out.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+            return static_cast<bool>(out);
+        });
+        out.flush();
+        if (!complete || !out) { return false; }
+        bytes = rawBytes;
+    }
+    else {
+#ifdef BOXDROP_HAVE_ZLIB
+        //The compressed size is only known at the end, so the record is compressed in memory
+        std::vector<uint8_t> compressed;
+        z_stream stream = z_stream();
+        if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK) { return false; }
+        const bool complete = readBands([&](const uint8_t *data, uint64_t size, bool last) {
+            stream.next_in = const_cast<Bytef *>(data);
+            stream.avail_in = static_cast<uInt>(size);
+            int status = Z_OK;
+            do {
+                const size_t used = compressed.size();
+                compressed.resize(used + std::max<size_t>(size / 2, 1 << 16));
+                stream.next_out = compressed.data() + used;
+                stream.avail_out = static_cast<uInt>(compressed.size() - used);
+                status = deflate(&stream, last ? Z_FINISH : Z_NO_FLUSH);
+                compressed.resize(compressed.size() - stream.avail_out);
+            } while ((status == Z_OK) && ((stream.avail_in > 0) || (last && (status != Z_STREAM_END))));
+            return (status == Z_OK) || (status == Z_STREAM_END) || (status == Z_BUF_ERROR);
+        });
+        deflateEnd(&stream);
+        if (!complete) { return false; }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!reserve(compressed.size(), shard, offset)) { return false; }
+        }
+        std::fstream out(shardPath(m_indexPath, shard).c_str(), std::ios::binary | std::ios::in | std::ios::out);
+        out.seekp(static_cast<std::streamoff>(offset));
+        out.write(reinterpret_cast<const char *>(compressed.data()), static_cast<std::streamsize>(compressed.size()));
+        out.flush();
+        if (!out) { return false; }
+        bytes = compressed.size();
+#else
+        return false;
+#endif
+    }
+    if (profile) {
+        profile->add(RunProfile::BytesWritten, static_cast<int64_t>(bytes));
+        profile->add(RunProfile::BytesEncoded, static_cast<int64_t>(rawBytes));
+    }
+    return writeIndexRow(record, shard, offset, bytes);
+}//end append
+
+size_t PatchDataset::recordCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_records;
+}//end recordCount
+
+bool PatchDataset::reserve(uint64_t bytes, int &shard, uint64_t &offset) {
+    uint64_t start = alignUp(m_shardEnd, RecordAlignment);
+    //A record larger than a whole shard gets a shard of its own
+    const bool full = (m_shardEnd > static_cast<uint64_t>(HeaderBytes)) && (start + bytes > m_shardBytes);
+    if ((m_shardEnd == 0) || full) {
+        if (m_shardEnd != 0) { ++m_shard; }
+        if (!createShard(m_shard)) { return false; }
+        m_shardEnd = HeaderBytes;
+        start = HeaderBytes;
+    }
+    shard = m_shard;
+    offset = start;
+    m_shardEnd = start + bytes;
+    return true;
+}//end reserve
+
+bool PatchDataset::createShard(int shard) {
+    std::vector<uint8_t> header(HeaderBytes, 0);
+    std::copy_n("BDSHARD1", 8, header.begin());
+    putLittleEndian32(&header[8], SHARD_VERSION);
+    putLittleEndian32(&header[12], HeaderBytes);
+    putLittleEndian32(&header[16], RecordAlignment);
+    std::ofstream out(shardPath(m_indexPath, shard).c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(header.data()), header.size());
+    return static_cast<bool>(out);
+}//end createShard
+
+bool PatchDataset::writeIndexRow(const Record &record, int shard, uint64_t offset, uint64_t bytes) {
+    std::stringstream ss;
+    ss << std::filesystem::path(shardPath(m_indexPath, shard)).filename().string() << ","
+        << offset << "," << bytes << "," << record.box.width << "," << record.box.height << ",3,"
+        << name(m_encoding) << "," << csvField(record.slide) << "," << record.box.x << "," << record.box.y << ","
+        << csvField(record.name) << "," << csvField(record.description) << "\n";
+    const std::string row = ss.str();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ofstream out(m_indexPath.c_str(), std::ios::binary | std::ios::out | std::ios::app);
+    out.write(row.data(), static_cast<std::streamsize>(row.size()));
+    out.flush();
+    if (!out) { return false; }
+    ++m_records;
+    return true;
+}//end writeIndexRow
+
+bool PatchDataset::isDatasetPath(const std::string &path) {
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".bdpatch";
+}//end isDatasetPath
+
+std::string PatchDataset::shardPath(const std::string &indexPath, int shard) {
+    std::filesystem::path path(indexPath);
+    std::stringstream ss;
+    ss << path.stem().string() << "." << std::setw(5) << std::setfill('0') << shard << ".bdshard";
+    return (path.parent_path() / ss.str()).string();
+}//end shardPath
+
+bool PatchDataset::isAvailable(Encoding encoding) {
+#ifdef BOXDROP_HAVE_ZLIB
+    return (encoding == Raw) || (encoding == Deflate);
+#else
+    return encoding == Raw;
+#endif
+}//end isAvailable
+
+const char *PatchDataset::name(Encoding encoding) {
+    return (encoding == Deflate) ? "deflate" : "raw";
+}//end name
+
+int64_t PatchDataset::bandCount(const BoxRect &box) {
+    return box.isEmpty() ? 1 : (box.height + BandRows - 1) / BandRows;
+}//end bandCount
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,141 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_PATCHDATASET_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_PATCHDATASET_H
+
+// System headers
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Plugin headers
+#include "BoxPlacement.h"
+#include "BoxStatistics.h"
+#include "ExportMonitor.h"
+#include "TileSource.h"
+
+namespace sedeen {
+namespace algorithm {
+
+///Appends the pixels of boxes, from any number of slides, to one dataset made for training
+///loaders: an index file (CSV, with the extension .bdpatch) and shard files next to it
+///(stem.00000.bdshard, stem.00001.bdshard, ...). A shard starts with a HeaderBytes header
+///("BDSHARD1", then the format version, header size and record alignment as 32-bit little-endian
+///integers) followed by records aligned to RecordAlignment bytes. A Raw record holds the
+///height x width x 3 RGB bytes of one box, rows top to bottom, so a loader can mmap the shard
+///and use each patch in place. A Deflate record is the same bytes as one zlib stream.
+///Each index row gives the shard, offset and size of a record, its width, height, channels and
+///encoding, and the slide, position, name and description of its box.
+///Records are written before their index row, so a row always refers to complete pixels.
+///Several threads can append at once: a raw record reserves its space under a lock, then reads
+///and writes its pixels in parallel with the others.
+class PatchDataset {
+public:
+    ///How record pixels are stored
+    enum Encoding {
+        Raw = 0,
+        Deflate
+    };
+
+    ///Size of the header at the start of each shard
+    static const int HeaderBytes = 4096;
+    ///Records start at multiples of this offset within a shard
+    static const int RecordAlignment = 64;
+    ///Rows of a box read and written at a time
+    static const int BandRows = 512;
+    ///A new shard is started when a record would take a shard past this size
+    static const uint64_t DefaultShardBytes = 1ull << 30;
+
+    ///Where a box came from
+    struct Record {
+        std::string slide;
+        BoxRect box;
+        std::string name;
+        std::string description;
+    };
+
+    PatchDataset();
+
+    ///Open the dataset with index file indexPath, creating it or appending to it. Space left
+    ///after the last indexed record of the last shard (by an interrupted append) is reclaimed.
+    bool open(const std::string &indexPath, Encoding encoding = Raw, uint64_t shardBytes = DefaultShardBytes);
+
+    ///Return true if open succeeded
+    bool isOpen() const { return !m_indexPath.empty(); }
+
+    ///Read the box of record from source and append it. Progress is reported to monitor in
+    ///bands of BandRows rows; if it is cancelled, nothing is indexed and false is returned.
+    ///If statistics is given, the statistics of the pixels are added to it band by band.
+    bool append(TileSource &source, const Record &record, ExportMonitor *monitor = nullptr,
+        BoxStatistics *statistics = nullptr);
+
+    ///Number of records in the index
+    size_t recordCount() const;
+
+    ///Path of the index file
+    const std::string &indexPath() const { return m_indexPath; }
+
+    ///Return true if path names a dataset index (extension .bdpatch)
+    static bool isDatasetPath(const std::string &path);
+
+    ///Path of shard number shard of the dataset with index file indexPath
+    static std::string shardPath(const std::string &indexPath, int shard);
+
+    ///Return true if this build can write encoding (Deflate needs zlib)
+    static bool isAvailable(Encoding encoding);
+
+    ///Name of encoding as written in the index
+    static const char *name(Encoding encoding);
+
+    ///Number of progress chunks append reports for box
+    static int64_t bandCount(const BoxRect &box);
+
+private:
+    ///Reserve bytes in the current shard, starting a new one if needed. Sets the shard and
+    ///offset of the record. Call with m_mutex held.
+    bool reserve(uint64_t bytes, int &shard, uint64_t &offset);
+
+    ///Create shard number shard with its header. Call with m_mutex held.
+    bool createShard(int shard);
+
+    ///Append the index row of a record written to shard at offset
+    bool writeIndexRow(const Record &record, int shard, uint64_t offset, uint64_t bytes);
+
+private:
+    std::string m_indexPath;
+    Encoding m_encoding;
+    uint64_t m_shardBytes;
+    ///Guards the members below and the index file
+    mutable std::mutex m_mutex;
+    int m_shard;
+    uint64_t m_shardEnd;
+    size_t m_records;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_PATCHDATASET_H
@@ -0,0 +1,183 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#include "RunProfile.h"
+
+// System headers
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+///Escape a string for a JSON value
+std::string jsonEscape(const std::string &text) {
+    std::ostringstream ss;
+    for (char c : text) {
+        if ((c == '"') || (c == '\\')) { ss << '\\' << c; }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        }
+        else { ss << c; }
+    }
+    return ss.str();
+}//end jsonEscape
+
+///Quote a CSV field, doubling embedded quotes
+std::string csvQuote(const std::string &text) {
+    std::string out("\"");
+    for (char c : text) {
+        if (c == '"') { out += '"'; }
+        out += c;
+    }
+    return out + "\"";
+}//end csvQuote
+
+} // namespace
+
+RunProfile::RunProfile() {
+    reset();
+}//end constructor
+
+void RunProfile::reset() {
+    for (int s = 0; s < StageCount; ++s) {
+        m_nanoseconds[s] = 0;
+        m_calls[s] = 0;
+    }
+    for (int c = 0; c < CounterCount; ++c) {
+        m_counters[c] = 0;
+    }
+}//end reset
+
+void RunProfile::addTime(Stage stage, std::chrono::steady_clock::duration duration) {
+    const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    m_nanoseconds[stage].fetch_add(ns, std::memory_order_relaxed);
+    m_calls[stage].fetch_add(1, std::memory_order_relaxed);
+}//end addTime
+
+void RunProfile::add(Counter counter, int64_t amount) {
+    m_counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}//end add
+
+double RunProfile::seconds(Stage stage) const {
+    return m_nanoseconds[stage].load(std::memory_order_relaxed) * 1e-9;
+}//end seconds
+
+int64_t RunProfile::calls(Stage stage) const {
+    return m_calls[stage].load(std::memory_order_relaxed);
+}//end calls
+
+int64_t RunProfile::count(Counter counter) const {
+    return m_counters[counter].load(std::memory_order_relaxed);
+}//end count
+
+double RunProfile::cacheHitRate() const {
+    const int64_t lookups = count(CacheHits) + count(CacheMisses);
+    return (lookups > 0) ? static_cast<double>(count(CacheHits)) / lookups : 0.0;
+}//end cacheHitRate
+
+const char *RunProfile::stageName(Stage stage) {
+    static const char *names[StageCount] = {
+        "session_load", "box_placement", "session_save", "compositing", "encoding", "export", "total" };
+    return names[stage];
+}//end stageName
+
+const char *RunProfile::counterName(Counter counter) {
+    static const char *names[CounterCount] = {
+        "bytes_written", "tiles_fetched", "boxes_exported", "cache_hits", "cache_misses", "bytes_encoded",
+        "aligned_tiles", "tiles_prefetched", "boxes_reused" };
+    return names[counter];
+}//end counterName
+
+void RunProfile::writeJson(std::ostream &out, const std::string &imagePath) const {
+    out << "{\"image\":\"" << jsonEscape(imagePath) << "\"";
+    for (int s = 0; s < StageCount; ++s) {
+        out << ",\"" << stageName(static_cast<Stage>(s)) << "_s\":" << std::fixed << std::setprecision(6)
+            << seconds(static_cast<Stage>(s));
+    }
+    for (int c = 0; c < CounterCount; ++c) {
+        out << ",\"" << counterName(static_cast<Counter>(c)) << "\":" << count(static_cast<Counter>(c));
+    }
+    out << ",\"cache_hit_rate\":" << std::setprecision(4) << cacheHitRate() << "}\n";
+}//end writeJson
+
+std::string RunProfile::csvHeader() {
+    std::ostringstream ss;
+    ss << "image";
+    for (int s = 0; s < StageCount; ++s) {
+        ss << "," << stageName(static_cast<Stage>(s)) << "_s";
+    }
+    for (int c = 0; c < CounterCount; ++c) {
+        ss << "," << counterName(static_cast<Counter>(c));
+    }
+    ss << ",cache_hit_rate";
+    return ss.str();
+}//end csvHeader
+
+void RunProfile::writeCsvHeader(std::ostream &out) {
+    out << csvHeader() << "\n";
+}//end writeCsvHeader
+
+void RunProfile::writeCsvRow(std::ostream &out, const std::string &imagePath) const {
+    out << csvQuote(imagePath);
+    for (int s = 0; s < StageCount; ++s) {
+        out << "," << std::fixed << std::setprecision(6) << seconds(static_cast<Stage>(s));
+    }
+    for (int c = 0; c < CounterCount; ++c) {
+        out << "," << count(static_cast<Counter>(c));
+    }
+    out << "," << std::setprecision(4) << cacheHitRate() << "\n";
+}//end writeCsvRow
+
+bool RunProfile::appendToLog(const std::string &logPath, const std::string &imagePath) const {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    const bool isNew = !fs::exists(logPath, ec) || (fs::file_size(logPath, ec) == 0);
+    const bool isJson = fs::path(logPath).extension() == ".json";
+    //Rows are only appended under the same columns, e.g. not to a log of an older version
+    if (!isNew && !isJson) {
+        std::ifstream in(logPath);
+        std::string header;
+        std::getline(in, header);
+        if (!header.empty() && (header.back() == '\r')) { header.pop_back(); }
+        if (header != csvHeader()) { return false; }
+    }
+    std::ofstream out(logPath, std::ios::app);
+    if (!out) { return false; }
+    if (isJson) {
+        writeJson(out, imagePath);
+    }
+    else {
+        if (isNew) { writeCsvHeader(out); }
+        writeCsvRow(out, imagePath);
+    }
+    return static_cast<bool>(out);
+}//end appendToLog
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,143 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_RUNPROFILE_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_RUNPROFILE_H
+
+// System headers
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace sedeen {
+namespace algorithm {
+
+///Time spent in each stage of a run, and counters of the work done.
+///Every update is a relaxed atomic add, so export workers can record into the
+///same profile without locking and the cost per measurement is two clock reads.
+class RunProfile {
+public:
+    ///The stages of a run that are timed
+    enum Stage {
+        SessionLoad = 0,
+        BoxPlacement,
+        SessionSave,
+        Compositing,
+        Encoding,
+        Export,
+        Total,
+        StageCount
+    };
+
+    ///The quantities that are counted
+    enum Counter {
+        BytesWritten = 0,
+        TilesFetched,
+        BoxesExported,
+        CacheHits,
+        CacheMisses,
+        ///Uncompressed pixel bytes handed to the encoders
+        BytesEncoded,
+        ///Output tiles encoded straight from a cached tile, without compositing or copying
+        AlignedTiles,
+        ///Cells read into the tile cache ahead of the export by the prefetcher
+        TilesPrefetched,
+        ///Boxes not exported because an unchanged file already held their pixels (kept or linked)
+        BoxesReused,
+        CounterCount
+    };
+
+    RunProfile();
+
+    ///Zero every stage and counter
+    void reset();
+
+    ///Add the duration of one pass through stage
+    void addTime(Stage stage, std::chrono::steady_clock::duration duration);
+
+    void add(Counter counter, int64_t amount);
+
+    ///Total seconds spent in stage. Stages run by several workers add up their time.
+    double seconds(Stage stage) const;
+
+    ///Number of passes through stage
+    int64_t calls(Stage stage) const;
+
+    int64_t count(Counter counter) const;
+
+    ///Fraction of tile cache lookups that were hits, or 0 if there were none
+    double cacheHitRate() const;
+
+    static const char *stageName(Stage stage);
+    static const char *counterName(Counter counter);
+
+    ///Write the profile as one line of JSON, labelled with the image it was recorded on
+    void writeJson(std::ostream &out, const std::string &imagePath) const;
+
+    ///The CSV column names matching writeCsvRow, without a line break
+    static std::string csvHeader();
+
+    ///Write the CSV column names matching writeCsvRow
+    static void writeCsvHeader(std::ostream &out);
+
+    ///Write the profile as one CSV row
+    void writeCsvRow(std::ostream &out, const std::string &imagePath) const;
+
+    ///Append the profile to a log file: JSON lines if the extension is .json, CSV otherwise.
+    ///A new CSV file starts with the header. Returns false if the file cannot be written, or if
+    ///it is a CSV file whose header lists other columns, so that its rows always match its header.
+    bool appendToLog(const std::string &logPath, const std::string &imagePath) const;
+
+private:
+    std::atomic<int64_t> m_nanoseconds[StageCount];
+    std::atomic<int64_t> m_calls[StageCount];
+    std::atomic<int64_t> m_counters[CounterCount];
+};
+
+///Adds the time from construction to destruction to a stage of a profile.
+///A null profile makes the timer do nothing.
+class ScopedStageTimer {
+public:
+    ScopedStageTimer(RunProfile *profile, RunProfile::Stage stage)
+        : m_profile(profile), m_stage(stage),
+        m_start(profile ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point()) {}
+    ~ScopedStageTimer() {
+        if (m_profile) { m_profile->addTime(m_stage, std::chrono::steady_clock::now() - m_start); }
+    }
+
+    ScopedStageTimer(const ScopedStageTimer &) = delete;
+    ScopedStageTimer &operator=(const ScopedStageTimer &) = delete;
+
+private:
+    RunProfile *m_profile;
+    RunProfile::Stage m_stage;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_RUNPROFILE_H
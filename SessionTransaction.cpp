@@ -0,0 +1,244 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "SessionTransaction.h"
+
+// System headers
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <sstream>
+#include <system_error>
+#include <utility>
+
+namespace sedeen {
+namespace algorithm {
+
+GraphicDescription makeBoxGraphic(const BoxRect &box, const std::string &name,
+    const std::string &description, const GraphicStyle &style,
+    const GraphicDescription *templateGraphic) {
+    GraphicDescription graph;
+    graph.setDescription(description.c_str());
+    graph.setName(name.c_str());
+    graph.setStyle(style);
+    if (nullptr != templateGraphic) {
+        graph.setGeometry(templateGraphic->getGeometry());
+    }
+    //The four corners of the box, clockwise from the top left
+    std::vector<PointF> vectorP;
+    PointF p;
+    p.setX(box.x);
+    p.setY(box.y);
+    vectorP.push_back(p);
+    p.setX(box.right());
+    p.setY(box.y);
+    vectorP.push_back(p);
+    p.setX(box.right());
+    p.setY(box.bottom());
+    vectorP.push_back(p);
+    p.setX(box.x);
+    p.setY(box.bottom());
+    vectorP.push_back(p);
+    std::vector<std::vector<PointF>> newPoints;
+    newPoints.push_back(vectorP);
+    graph.setPoints(newPoints);
+    return graph;
+}//end makeBoxGraphic
+
+SessionTransaction::SessionTransaction(const std::string &imagePath)
+    : m_session(imagePath),
+    m_sessionFilePath(sessionFilePathFor(imagePath)),
+    m_graphics(),
+    m_ownIndex(),
+    m_index(&m_ownIndex),
+    m_dirty(false),
+    m_writes(0)
+{
+}//end constructor
+
+SessionTransaction::SessionTransaction(const std::string &imagePath, AnnotationIndex &index)
+    : m_session(imagePath),
+    m_sessionFilePath(sessionFilePathFor(imagePath)),
+    m_graphics(),
+    m_ownIndex(),
+    m_index(&index),
+    m_dirty(false),
+    m_writes(0)
+{
+}//end constructor
+
+bool SessionTransaction::load() {
+    bool loaded = m_session.loadFromFile();
+    m_graphics = m_session.getGraphics();
+    m_dirty = false;
+    //Only rehash the annotations if the session file changed since the index was built
+    const std::string stamp = fileStamp();
+    if (!m_index->matches(stamp) || (m_index->size() != m_graphics.size())) {
+        rebuildIndex();
+        m_index->setStamp(stamp);
+    }
+    return loaded;
+}//end load
+
+void SessionTransaction::addGraphic(const GraphicDescription &graphic) {
+    m_index->insert(keyOf(graphic), m_graphics.size());
+    m_graphics.push_back(graphic);
+    //Until committed, the index no longer matches the session file
+    m_index->setStamp(std::string());
+    m_dirty = true;
+}//end addGraphic
+
+void SessionTransaction::replaceGraphic(size_t position, const GraphicDescription &graphic) {
+    if (position >= m_graphics.size()) { return; }
+    m_index->erase(keyOf(m_graphics[position]), position);
+    m_index->insert(keyOf(graphic), position);
+    m_graphics[position] = graphic;
+    m_index->setStamp(std::string());
+    m_dirty = true;
+}//end replaceGraphic
+
+int SessionTransaction::addBoxGraphics(const std::vector<GraphicDescription> &boxes, size_t templatePosition) {
+    //A user-drawn graphic with no description is a placeholder
+    size_t placeholder = AnnotationIndex::npos;
+    std::string placeholderName;
+    if ((templatePosition < m_graphics.size())
+        && std::string(m_graphics[templatePosition].getDescription()).empty()) {
+        placeholder = templatePosition;
+        placeholderName = m_graphics[templatePosition].getName();
+    }
+    int changed = 0;
+    for (auto it = boxes.begin(); it != boxes.end(); ++it) {
+        const AnnotationKey key = keyOf(*it);
+        //A box already in the session (e.g. the same placement run twice) is not added again,
+        //but takes a new description in place
+        const size_t existing = m_index->find(key);
+        if ((placeholder != AnnotationIndex::npos) && (key.name == placeholderName)
+            && ((existing == AnnotationIndex::npos) || (existing == placeholder))) {
+            replaceGraphic(placeholder, *it);
+            placeholder = AnnotationIndex::npos;
+            ++changed;
+        }
+        else if (existing == AnnotationIndex::npos) {
+            addGraphic(*it);
+            ++changed;
+        }
+        else if (std::string(m_graphics[existing].getDescription()) != it->getDescription()) {
+            replaceGraphic(existing, *it);
+            ++changed;
+        }
+    }
+    return changed;
+}//end addBoxGraphics
+
+void SessionTransaction::setGraphics(std::vector<GraphicDescription> graphics) {
+    m_graphics = std::move(graphics);
+    rebuildIndex();
+    m_dirty = true;
+}//end setGraphics
+
+size_t SessionTransaction::findGraphic(const std::string &name, const BoxRect &bounds) const {
+    AnnotationKey key;
+    key.name = name;
+    key.bounds = bounds;
+    return m_index->find(key);
+}//end findGraphic
+
+AnnotationKey SessionTransaction::keyOf(const GraphicDescription &graphic) {
+    AnnotationKey key;
+    key.name = graphic.getName();
+    //Bounding box of all the points, rounded to whole pixels
+    bool first = true;
+    int xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+    auto points = graphic.getPoints();
+    for (auto ring = points.begin(); ring != points.end(); ++ring) {
+        for (auto pt = ring->begin(); pt != ring->end(); ++pt) {
+            const int x = static_cast<int>(std::lround(pt->getX()));
+            const int y = static_cast<int>(std::lround(pt->getY()));
+            xmin = first ? x : std::min(xmin, x);
+            ymin = first ? y : std::min(ymin, y);
+            xmax = first ? x : std::max(xmax, x);
+            ymax = first ? y : std::max(ymax, y);
+            first = false;
+        }
+    }
+    key.bounds = BoxRect(xmin, ymin, xmax - xmin, ymax - ymin);
+    return key;
+}//end keyOf
+
+bool SessionTransaction::commit() {
+    namespace fs = std::filesystem; //an alias
+    //Nothing to do if no annotation was modified
+    if (!m_dirty) { return true; }
+
+    m_session.setGraphics(m_graphics);
+    //Write next to the session file, so the rename stays on one volume
+    const std::string tempFilePath = m_sessionFilePath + ".tmp";
+    std::error_code ec;
+    if (!m_session.saveToFile(tempFilePath)) {
+        fs::remove(tempFilePath, ec);
+        return false;
+    }
+    //rename replaces an existing session file in a single step
+    fs::rename(tempFilePath, m_sessionFilePath, ec);
+    if (ec) {
+        fs::remove(tempFilePath, ec);
+        return false;
+    }
+    m_dirty = false;
+    ++m_writes;
+    //The index now describes the file just written
+    m_index->setStamp(fileStamp());
+    return true;
+}//end commit
+
+std::string SessionTransaction::fileStamp() const {
+    namespace fs = std::filesystem; //an alias
+    std::error_code ec;
+    auto writeTime = fs::last_write_time(m_sessionFilePath, ec);
+    if (ec) { return std::string(); }
+    auto fileSize = fs::file_size(m_sessionFilePath, ec);
+    if (ec) { return std::string(); }
+    std::stringstream ss;
+    ss << m_sessionFilePath << "|" << writeTime.time_since_epoch().count()
+        << "|" << fileSize << "|" << m_graphics.size();
+    return ss.str();
+}//end fileStamp
+
+void SessionTransaction::rebuildIndex() {
+    std::vector<AnnotationKey> keys;
+    keys.reserve(m_graphics.size());
+    for (auto it = m_graphics.begin(); it != m_graphics.end(); ++it) {
+        keys.push_back(keyOf(*it));
+    }
+    m_index->rebuild(keys);
+}//end rebuildIndex
+
+std::string SessionTransaction::sessionFilePathFor(const std::string &imagePath) {
+    //Sedeen Viewer keeps the session beside the image, as <image file name>.session.xml
+    return imagePath + ".session.xml";
+}//end sessionFilePathFor
+
+} // namespace algorithm
+} // namespace sedeen
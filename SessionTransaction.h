@@ -0,0 +1,127 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_SESSIONTRANSACTION_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_SESSIONTRANSACTION_H
+
+// System headers
+#include <string>
+#include <vector>
+
+// DPTK headers
+#include "archive/Session.h"
+
+// Plugin headers
+#include "AnnotationIndex.h"
+
+namespace sedeen {
+namespace algorithm {
+
+///Create the annotation of a box: its four corners, clockwise from the top left, with the
+///given name, description and style. The geometry type is copied from templateGraphic if given.
+GraphicDescription makeBoxGraphic(const BoxRect &box, const std::string &name,
+    const std::string &description, const GraphicStyle &style,
+    const GraphicDescription *templateGraphic);
+
+///Reads the session file of an image once, applies annotation edits in memory,
+///and writes the result back at most once, only if something changed.
+///The write goes to a temporary file that is then renamed over the session file,
+///so a failed or interrupted save never leaves a truncated session behind.
+class SessionTransaction {
+public:
+    ///Open a transaction on the session belonging to the image at imagePath
+    explicit SessionTransaction(const std::string &imagePath);
+
+    ///Open a transaction that keeps index up to date. If index was built from the
+    ///current session file by an earlier transaction, it is reused instead of rebuilt.
+    SessionTransaction(const std::string &imagePath, AnnotationIndex &index);
+
+    ///Read the session file. Returns false if it could not be read.
+    bool load();
+
+    ///Return the annotations as they will be written by commit
+    const std::vector<GraphicDescription> &graphics() const { return m_graphics; }
+
+    ///Append an annotation
+    void addGraphic(const GraphicDescription &graphic);
+
+    ///Replace the annotation at position, in place
+    void replaceGraphic(size_t position, const GraphicDescription &graphic);
+
+    ///Add the annotations of new boxes. If the graphic at templatePosition is a placeholder
+    ///(no description), the box with the same name takes its place instead of being appended,
+    ///so the placeholder never has to be searched for. Boxes already in the session are skipped,
+    ///unless their description differs, in which case they are replaced in place.
+    ///Returns the number of annotations added or replaced.
+    int addBoxGraphics(const std::vector<GraphicDescription> &boxes, size_t templatePosition);
+
+    ///Replace the full list of annotations
+    void setGraphics(std::vector<GraphicDescription> graphics);
+
+    ///Return the position of an annotation with this name and bounding box, or AnnotationIndex::npos
+    size_t findGraphic(const std::string &name, const BoxRect &bounds) const;
+
+    ///Spatial index of the bounding boxes of the annotations, with their positions as ids
+    const SpatialIndex &spatialIndex() const { return m_index->spatial(); }
+
+    ///Return the name and bounding box of the annotation's points
+    static AnnotationKey keyOf(const GraphicDescription &graphic);
+
+    ///Return true if the annotations were modified since load or the last commit
+    bool isDirty() const { return m_dirty; }
+
+    ///Write the session if it was modified. Returns false only if a write was needed and failed.
+    bool commit();
+
+    ///Number of times the session file was actually written by this transaction
+    int writeCount() const { return m_writes; }
+
+    ///Full path of the session file that commit replaces
+    const std::string &sessionFilePath() const { return m_sessionFilePath; }
+
+    ///Return the session file path that Sedeen Viewer uses for the given image
+    static std::string sessionFilePathFor(const std::string &imagePath);
+
+private:
+    ///Identify the current contents of the session file by its time, size and annotation count
+    std::string fileStamp() const;
+
+    ///Index every annotation in m_graphics
+    void rebuildIndex();
+
+private:
+    Session m_session;
+    std::string m_sessionFilePath;
+    std::vector<GraphicDescription> m_graphics;
+    ///Used when no index is supplied by the caller
+    AnnotationIndex m_ownIndex;
+    AnnotationIndex *m_index;
+    bool m_dirty;
+    int m_writes;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_SESSIONTRANSACTION_H
@@ -0,0 +1,300 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "SpatialIndex.h"
+
+// System headers
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <tuple>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+///Side of the grid on which box centres are ordered
+const uint32_t HILBERT_SIDE = 1u << 16;
+
+///Distance along the Hilbert curve of the grid point (x,y)
+uint64_t hilbertDistance(uint32_t x, uint32_t y) {
+    uint64_t d = 0;
+    for (uint32_t s = HILBERT_SIDE / 2; s > 0; s /= 2) {
+        const uint32_t rx = (x & s) ? 1 : 0;
+        const uint32_t ry = (y & s) ? 1 : 0;
+        d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+        //Rotate the quadrant so that the curve is continuous
+        if (ry == 0) {
+            if (rx == 1) {
+                x = HILBERT_SIDE - 1 - x;
+                y = HILBERT_SIDE - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}//end hilbertDistance
+
+///Distance between the closest points of two rectangles given by their edges
+double gapDistance(const BoxRect &box, int x0, int y0, int x1, int y1) {
+    const double dx = std::max(0, std::max(x0 - box.right(), box.x - x1));
+    const double dy = std::max(0, std::max(y0 - box.bottom(), box.y - y1));
+    return std::sqrt(dx * dx + dy * dy);
+}//end gapDistance
+} // namespace
+
+const size_t SpatialIndex::npos = static_cast<size_t>(-1);
+
+SpatialIndex::SpatialIndex()
+    : m_entries(),
+    m_packed(0),
+    m_levels(),
+    m_live(0),
+    m_dead(0)
+{
+}//end constructor
+
+void SpatialIndex::clear() {
+    m_entries.clear();
+    m_levels.clear();
+    m_packed = 0;
+    m_live = 0;
+    m_dead = 0;
+}//end clear
+
+void SpatialIndex::insert(const BoxRect &box, size_t id) {
+    append(box, id);
+    //Repack once the unsorted tail would slow queries down noticeably
+    if (m_entries.size() - m_packed > std::max<size_t>(256, m_packed / 16)) {
+        pack();
+    }
+}//end insert
+
+void SpatialIndex::append(const BoxRect &box, size_t id) {
+    m_entries.push_back(Entry{ box, id, true });
+    ++m_live;
+}//end append
+
+void SpatialIndex::erase(const BoxRect &box, size_t id) {
+    const size_t entry = findEntry(box, id);
+    if (entry == npos) { return; }
+    m_entries[entry].alive = false;
+    --m_live;
+    ++m_dead;
+    if (m_dead > std::max<size_t>(256, m_entries.size() / 4)) {
+        pack();
+    }
+}//end erase
+
+void SpatialIndex::pack() {
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(),
+        [](const Entry &e) { return !e.alive; }), m_entries.end());
+    m_dead = 0;
+    m_levels.clear();
+    m_packed = m_entries.size();
+    if (m_entries.empty()) { return; }
+
+    //Order the boxes along a Hilbert curve through their centres, scaled to the grid
+    int64_t minX = std::numeric_limits<int64_t>::max(), minY = minX;
+    int64_t maxX = std::numeric_limits<int64_t>::min(), maxY = maxX;
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        const int64_t cx = it->box.x + it->box.width / 2;
+        const int64_t cy = it->box.y + it->box.height / 2;
+        minX = std::min(minX, cx);
+        maxX = std::max(maxX, cx);
+        minY = std::min(minY, cy);
+        maxY = std::max(maxY, cy);
+    }
+    const int64_t spanX = std::max<int64_t>(1, maxX - minX);
+    const int64_t spanY = std::max<int64_t>(1, maxY - minY);
+    std::vector<std::pair<uint64_t, size_t>> order(m_entries.size());
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        const BoxRect &b = m_entries[i].box;
+        const uint32_t hx = static_cast<uint32_t>((b.x + b.width / 2 - minX) * (HILBERT_SIDE - 1) / spanX);
+        const uint32_t hy = static_cast<uint32_t>((b.y + b.height / 2 - minY) * (HILBERT_SIDE - 1) / spanY);
+        order[i] = std::make_pair(hilbertDistance(hx, hy), i);
+    }
+    std::sort(order.begin(), order.end());
+    std::vector<Entry> sorted;
+    sorted.reserve(m_entries.size());
+    for (auto it = order.begin(); it != order.end(); ++it) { sorted.push_back(m_entries[it->second]); }
+    m_entries.swap(sorted);
+
+    //Pack full nodes level by level until one node is left
+    std::vector<Node> level;
+    for (size_t first = 0; first < m_entries.size(); first += NodeCapacity) {
+        const size_t count = std::min<size_t>(NodeCapacity, m_entries.size() - first);
+        Node node{ std::numeric_limits<int>::max(), std::numeric_limits<int>::max(),
+            std::numeric_limits<int>::min(), std::numeric_limits<int>::min(),
+            static_cast<uint32_t>(first), static_cast<uint32_t>(count) };
+        for (size_t i = first; i < first + count; ++i) {
+            const BoxRect &b = m_entries[i].box;
+            node.x0 = std::min(node.x0, b.x);
+            node.y0 = std::min(node.y0, b.y);
+            node.x1 = std::max(node.x1, b.right());
+            node.y1 = std::max(node.y1, b.bottom());
+        }
+        level.push_back(node);
+    }
+    m_levels.push_back(level);
+    while (m_levels.back().size() > 1) {
+        const std::vector<Node> &below = m_levels.back();
+        std::vector<Node> above;
+        for (size_t first = 0; first < below.size(); first += NodeCapacity) {
+            const size_t count = std::min<size_t>(NodeCapacity, below.size() - first);
+            Node node = below[first];
+            node.first = static_cast<uint32_t>(first);
+            node.count = static_cast<uint32_t>(count);
+            for (size_t i = first + 1; i < first + count; ++i) {
+                node.x0 = std::min(node.x0, below[i].x0);
+                node.y0 = std::min(node.y0, below[i].y0);
+                node.x1 = std::max(node.x1, below[i].x1);
+                node.y1 = std::max(node.y1, below[i].y1);
+            }
+            above.push_back(node);
+        }
+        m_levels.push_back(above);
+    }
+}//end pack
+
+template <class Visit>
+void SpatialIndex::visit(int x0, int y0, int x1, int y1, Visit visitEntry) const {
+    //Closed intersection tests, so that boxes touching the query are visited too
+    auto touches = [&](int bx0, int by0, int bx1, int by1) {
+        return (bx0 <= x1) && (bx1 >= x0) && (by0 <= y1) && (by1 >= y0);
+    };
+    if (!m_levels.empty()) {
+        std::vector<std::pair<size_t, size_t>> stack;
+        stack.push_back(std::make_pair(m_levels.size() - 1, size_t(0)));
+        while (!stack.empty()) {
+            const size_t levelIndex = stack.back().first;
+            const Node &node = m_levels[levelIndex][stack.back().second];
+            stack.pop_back();
+            if (!touches(node.x0, node.y0, node.x1, node.y1)) { continue; }
+            for (size_t i = node.first; i < node.first + node.count; ++i) {
+                if (levelIndex > 0) {
+                    stack.push_back(std::make_pair(levelIndex - 1, i));
+                    continue;
+                }
+                const Entry &e = m_entries[i];
+                if (e.alive && touches(e.box.x, e.box.y, e.box.right(), e.box.bottom())) { visitEntry(e); }
+            }
+        }
+    }
+    for (size_t i = m_packed; i < m_entries.size(); ++i) {
+        const Entry &e = m_entries[i];
+        if (e.alive && touches(e.box.x, e.box.y, e.box.right(), e.box.bottom())) { visitEntry(e); }
+    }
+}//end visit
+
+size_t SpatialIndex::findEntry(const BoxRect &box, size_t id) const {
+    size_t found = npos;
+    visit(box.x, box.y, box.right(), box.bottom(), [&](const Entry &e) {
+        if ((found == npos) && (e.id == id) && (e.box.x == box.x) && (e.box.y == box.y)
+            && (e.box.width == box.width) && (e.box.height == box.height)) {
+            found = static_cast<size_t>(&e - m_entries.data());
+        }
+    });
+    return found;
+}//end findEntry
+
+void SpatialIndex::overlapping(const BoxRect &query, std::vector<size_t> &ids) const {
+    visit(query.x, query.y, query.right(), query.bottom(), [&](const Entry &e) {
+        if (boxesIntersect(e.box, query)) { ids.push_back(e.id); }
+    });
+}//end overlapping
+
+void SpatialIndex::containing(const BoxRect &query, std::vector<size_t> &ids) const {
+    visit(query.x, query.y, query.right(), query.bottom(), [&](const Entry &e) {
+        if ((e.box.x <= query.x) && (e.box.y <= query.y)
+            && (e.box.right() >= query.right()) && (e.box.bottom() >= query.bottom())) {
+            ids.push_back(e.id);
+        }
+    });
+}//end containing
+
+void SpatialIndex::within(const BoxRect &query, std::vector<size_t> &ids) const {
+    visit(query.x, query.y, query.right(), query.bottom(), [&](const Entry &e) {
+        if ((e.box.x >= query.x) && (e.box.y >= query.y)
+            && (e.box.right() <= query.right()) && (e.box.bottom() <= query.bottom())) {
+            ids.push_back(e.id);
+        }
+    });
+}//end within
+
+double SpatialIndex::maxOverlapFraction(const BoxRect &box, size_t ignoreId) const {
+    if (box.isEmpty()) { return 0.0; }
+    int64_t largest = 0;
+    visit(box.x, box.y, box.right(), box.bottom(), [&](const Entry &e) {
+        if (e.id != ignoreId) { largest = std::max(largest, intersectionArea(box, e.box)); }
+    });
+    return static_cast<double>(largest) / box.area();
+}//end maxOverlapFraction
+
+std::vector<SpatialIndex::Neighbour> SpatialIndex::nearest(const BoxRect &box, int count, size_t ignoreId) const {
+    std::vector<Neighbour> found;
+    if (count <= 0) { return found; }
+    //Best-first search: nodes and boxes are taken in order of their distance from box.
+    //An item is (distance, level + 1, index), with level 0 for boxes.
+    typedef std::tuple<double, size_t, size_t> Item;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+    if (!m_levels.empty()) {
+        const Node &root = m_levels.back().front();
+        queue.push(Item(gapDistance(box, root.x0, root.y0, root.x1, root.y1), m_levels.size(), 0));
+    }
+    for (size_t i = m_packed; i < m_entries.size(); ++i) {
+        const BoxRect &b = m_entries[i].box;
+        if (m_entries[i].alive) { queue.push(Item(gapDistance(box, b.x, b.y, b.right(), b.bottom()), 0, i)); }
+    }
+    while (!queue.empty() && (found.size() < static_cast<size_t>(count))) {
+        const Item item = queue.top();
+        queue.pop();
+        const size_t level = std::get<1>(item);
+        const size_t index = std::get<2>(item);
+        if (level == 0) {
+            const Entry &e = m_entries[index];
+            if (e.id != ignoreId) { found.push_back(Neighbour{ e.id, e.box, std::get<0>(item) }); }
+            continue;
+        }
+        const Node &node = m_levels[level - 1][index];
+        for (size_t i = node.first; i < node.first + node.count; ++i) {
+            if (level == 1) {
+                const Entry &e = m_entries[i];
+                if (e.alive) {
+                    queue.push(Item(gapDistance(box, e.box.x, e.box.y, e.box.right(), e.box.bottom()), 0, i));
+                }
+            }
+            else {
+                const Node &child = m_levels[level - 2][i];
+                queue.push(Item(gapDistance(box, child.x0, child.y0, child.x1, child.y1), level - 1, i));
+            }
+        }
+    }
+    return found;
+}//end nearest
+
+} // namespace algorithm
+} // namespace sedeen
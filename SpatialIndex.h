@@ -0,0 +1,126 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_SPATIALINDEX_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_SPATIALINDEX_H
+
+// System headers
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Plugin headers
+#include "BoxPlacement.h"
+
+namespace sedeen {
+namespace algorithm {
+
+///Packed Hilbert R-tree over the bounding boxes of annotations, each with an id (its position
+///in the session). Boxes are sorted along a Hilbert curve through their centres and packed into
+///full nodes, so a query visits O(log n) nodes plus the boxes it returns. Boxes inserted after
+///the last pack wait in a short unsorted list that every query also scans; the tree is repacked
+///when that list grows, which keeps inserts cheap on average. Erased boxes are only marked.
+class SpatialIndex {
+public:
+    ///Number of children of each node
+    static const int NodeCapacity = 16;
+    ///Returned by queries that find nothing
+    static const size_t npos;
+
+    ///A box returned by nearest, and its distance in pixels from the query (0 if they touch)
+    struct Neighbour {
+        size_t id;
+        BoxRect box;
+        double distance;
+    };
+
+    SpatialIndex();
+
+    ///Remove every box
+    void clear();
+
+    ///Add a box
+    void insert(const BoxRect &box, size_t id);
+
+    ///Add a box without repacking the tree. Call pack once a bulk load is done.
+    void append(const BoxRect &box, size_t id);
+
+    ///Remove the box with this id and bounds
+    void erase(const BoxRect &box, size_t id);
+
+    ///Pack every box into the tree
+    void pack();
+
+    ///Number of boxes indexed
+    size_t size() const { return m_live; }
+
+    ///Append to ids the boxes sharing some area with query
+    void overlapping(const BoxRect &query, std::vector<size_t> &ids) const;
+
+    ///Append to ids the boxes that contain query entirely
+    void containing(const BoxRect &query, std::vector<size_t> &ids) const;
+
+    ///Append to ids the boxes that lie entirely inside query
+    void within(const BoxRect &query, std::vector<size_t> &ids) const;
+
+    ///Largest fraction of the area of box covered by any one indexed box, other than ignoreId
+    double maxOverlapFraction(const BoxRect &box, size_t ignoreId = npos) const;
+
+    ///Return up to count boxes nearest to box, closest first, other than ignoreId
+    std::vector<Neighbour> nearest(const BoxRect &box, int count, size_t ignoreId = npos) const;
+
+private:
+    struct Entry {
+        BoxRect box;
+        size_t id;
+        bool alive;
+    };
+    ///Bounds of a node and the range of its children in the level below (or in m_entries)
+    struct Node {
+        int x0, y0, x1, y1;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    ///Call visit(entry) for every live entry whose box intersects the query bounds
+    template <class Visit>
+    void visit(int x0, int y0, int x1, int y1, Visit visitEntry) const;
+
+    ///Return the entry index holding id and box, or npos
+    size_t findEntry(const BoxRect &box, size_t id) const;
+
+private:
+    ///Packed entries in Hilbert order, followed by the unpacked ones
+    std::vector<Entry> m_entries;
+    size_t m_packed;
+    ///Levels of the tree, leaves first; the last level has a single root node
+    std::vector<std::vector<Node>> m_levels;
+    size_t m_live;
+    size_t m_dead;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_SPATIALINDEX_H
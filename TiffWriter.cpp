@@ -0,0 +1,292 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "TiffWriter.h"
+
+// System headers
+#include <cstdio>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+//TIFF field types
+const uint16_t TIFF_SHORT = 3;
+const uint16_t TIFF_LONG = 4;
+const uint16_t TIFF_LONG8 = 16;
+
+///Largest offset a classic TIFF can hold
+const uint64_t CLASSIC_OFFSET_LIMIT = 0xFFFFFFFFull;
+
+///A directory entry and its encoded value
+struct TiffEntry {
+    uint16_t tag;
+    uint16_t type;
+    uint64_t count;
+    std::vector<uint8_t> value;
+};
+} // namespace
+
+TiffWriter::TiffWriter()
+    : m_file(),
+    m_path(),
+    m_width(0),
+    m_height(0),
+    m_tileSize(0),
+    m_channels(0),
+    m_tilesAcross(0),
+    m_tilesDown(0),
+    m_codec(),
+    m_bigTiff(false),
+    m_failed(false),
+    m_offset(0),
+    m_tileOffsets(),
+    m_tileByteCounts(),
+    m_encoded()
+{
+}//end constructor
+
+TiffWriter::~TiffWriter() {
+    if (m_file.is_open()) {
+        close();
+    }
+}//end destructor
+
+bool TiffWriter::needsBigTiff(int width, int height, int channels, TileCodec::Compression compression) {
+    //Leave room below 4 GB for the directory and the padding of edge tiles
+    const uint64_t classicLimit = 0xF0000000ull;
+    uint64_t pixelBytes = static_cast<uint64_t>(width) * height * channels;
+    if (compression != TileCodec::None) { pixelBytes += pixelBytes / 2; }
+    return pixelBytes + pixelBytes / 8 > classicLimit;
+}//end needsBigTiff
+
+bool TiffWriter::open(const std::string &path, int width, int height, int tileSize, int channels,
+    const TileCodec &codec) {
+    if ((width <= 0) || (height <= 0) || (tileSize <= 0) || (tileSize % 16 != 0)
+        || ((channels != 1) && (channels != 3))) {
+        return false;
+    }
+    m_path = path;
+    m_width = width;
+    m_height = height;
+    m_tileSize = tileSize;
+    m_channels = channels;
+    m_codec = codec;
+    m_tilesAcross = (width + tileSize - 1) / tileSize;
+    m_tilesDown = (height + tileSize - 1) / tileSize;
+    m_bigTiff = needsBigTiff(width, height, channels, codec.compression());
+    m_failed = false;
+    m_offset = 0;
+    const size_t numberOfTiles = static_cast<size_t>(m_tilesAcross) * m_tilesDown;
+    m_tileOffsets.assign(numberOfTiles, 0);
+    m_tileByteCounts.assign(numberOfTiles, 0);
+
+    m_file.open(path.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!m_file.good()) { return false; }
+    writeHeader();
+    return m_file.good();
+}//end open
+
+bool TiffWriter::writeTile(int column, int row, const uint8_t *data) {
+    if (!m_codec.encode(data, m_tileSize, m_tileSize, m_channels, m_encoded)) {
+        m_failed = true;
+        return false;
+    }
+    return writeEncodedTile(column, row, m_encoded.data(), m_encoded.size());
+}//end writeTile
+
+bool TiffWriter::writeEncodedTile(int column, int row, const uint8_t *data, size_t size) {
+    if (!m_file.is_open() || (column < 0) || (row < 0)
+        || (column >= m_tilesAcross) || (row >= m_tilesDown) || (size == 0)) {
+        return false;
+    }
+    //needsBigTiff is only an estimate; a classic file that outgrows it would get truncated offsets
+    if (!m_bigTiff && (m_offset + size > CLASSIC_OFFSET_LIMIT)) {
+        m_failed = true;
+        return false;
+    }
+    const size_t index = static_cast<size_t>(row) * m_tilesAcross + column;
+    m_file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+    if (!m_file.good()) {
+        m_failed = true;
+        return false;
+    }
+    m_tileOffsets[index] = m_offset;
+    m_tileByteCounts[index] = size;
+    m_offset += size;
+    return true;
+}//end writeEncodedTile
+
+bool TiffWriter::close() {
+    if (!m_file.is_open()) { return false; }
+    bool complete = !m_failed;
+    for (auto it = m_tileByteCounts.begin(); it != m_tileByteCounts.end(); ++it) {
+        if (*it == 0) { complete = false; }
+    }
+    if (complete) {
+        writeDirectory();
+    }
+    complete = complete && !m_failed && m_file.good();
+    m_file.close();
+    return complete;
+}//end close
+
+void TiffWriter::abort() {
+    if (m_file.is_open()) {
+        m_file.close();
+    }
+    if (!m_path.empty()) {
+        std::remove(m_path.c_str());
+    }
+}//end abort
+
+void TiffWriter::writeHeader() {
+    std::vector<uint8_t> header;
+    //Little-endian byte order
+    header.push_back('I');
+    header.push_back('I');
+    if (m_bigTiff) {
+        put16(header, 43);
+        //Offsets are 8 bytes, followed by a reserved word
+        put16(header, 8);
+        put16(header, 0);
+        put64(header, 0);
+    }
+    else {
+        put16(header, 42);
+        put32(header, 0);
+    }
+    //The offset of the directory is patched in by writeDirectory
+    m_file.write(reinterpret_cast<const char *>(header.data()), header.size());
+    m_offset = header.size();
+}//end writeHeader
+
+void TiffWriter::writeDirectory() {
+    //Directory entries, in ascending tag order
+    std::vector<TiffEntry> entries;
+    auto addShorts = [&](uint16_t tag, const std::vector<uint16_t> &values) {
+        TiffEntry e{ tag, TIFF_SHORT, values.size(), std::vector<uint8_t>() };
+        for (auto v : values) { put16(e.value, v); }
+        entries.push_back(e);
+    };
+    auto addLong = [&](uint16_t tag, uint32_t value) {
+        TiffEntry e{ tag, TIFF_LONG, 1, std::vector<uint8_t>() };
+        put32(e.value, value);
+        entries.push_back(e);
+    };
+    auto addOffsets = [&](uint16_t tag, const std::vector<uint64_t> &values) {
+        TiffEntry e{ tag, m_bigTiff ? TIFF_LONG8 : TIFF_LONG, values.size(), std::vector<uint8_t>() };
+        for (auto v : values) { putOffset(e.value, v); }
+        entries.push_back(e);
+    };
+    addLong(256, static_cast<uint32_t>(m_width));                   //ImageWidth
+    addLong(257, static_cast<uint32_t>(m_height));                  //ImageLength
+    addShorts(258, std::vector<uint16_t>(m_channels, 8));           //BitsPerSample
+    //JPEG stores colour as subsampled YCbCr
+    const bool ycbcr = (m_codec.compression() == TileCodec::JPEG) && (m_channels == 3);
+    addShorts(259, std::vector<uint16_t>(1, static_cast<uint16_t>(m_codec.compression()))); //Compression
+    addShorts(262, std::vector<uint16_t>(1, ycbcr ? 6 : ((m_channels == 3) ? 2 : 1))); //Photometric: YCbCr, RGB or BlackIsZero
+    addShorts(277, std::vector<uint16_t>(1, static_cast<uint16_t>(m_channels))); //SamplesPerPixel
+    addShorts(284, std::vector<uint16_t>(1, 1));                    //PlanarConfiguration: chunky
+    if (m_codec.usesPredictor()) {
+        addShorts(317, std::vector<uint16_t>(1, 2));                //Predictor: horizontal differencing
+    }
+    addLong(322, static_cast<uint32_t>(m_tileSize));                //TileWidth
+    addLong(323, static_cast<uint32_t>(m_tileSize));                //TileLength
+    addOffsets(324, m_tileOffsets);                                 //TileOffsets
+    addOffsets(325, m_tileByteCounts);                              //TileByteCounts
+    if (ycbcr) {
+        addShorts(530, std::vector<uint16_t>{ 2, 2 });              //YCbCrSubSampling
+    }
+
+    //The directory must start on a word boundary
+    std::vector<uint8_t> out;
+    if (m_offset % 2) { out.push_back(0); }
+    const uint64_t directoryOffset = m_offset + out.size();
+    const uint64_t countSize = m_bigTiff ? 8 : 2;
+    const uint64_t entrySize = m_bigTiff ? 20 : 12;
+    const uint64_t inlineSize = m_bigTiff ? 8 : 4;
+    const uint64_t directorySize = countSize + entries.size() * entrySize + inlineSize;
+
+    //Values too large to fit in an entry are stored after the directory
+    std::vector<uint8_t> extra;
+    uint64_t extraOffset = directoryOffset + directorySize;
+    if (m_bigTiff) { put64(out, entries.size()); }
+    else { put16(out, static_cast<uint16_t>(entries.size())); }
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        put16(out, it->tag);
+        put16(out, it->type);
+        if (m_bigTiff) { put64(out, it->count); }
+        else { put32(out, static_cast<uint32_t>(it->count)); }
+        if (it->value.size() <= inlineSize) {
+            std::vector<uint8_t> value = it->value;
+            value.resize(inlineSize, 0);
+            out.insert(out.end(), value.begin(), value.end());
+        }
+        else {
+            putOffset(out, extraOffset + extra.size());
+            extra.insert(extra.end(), it->value.begin(), it->value.end());
+            if (extra.size() % 2) { extra.push_back(0); }
+        }
+    }
+    //No further directories
+    putOffset(out, 0);
+    out.insert(out.end(), extra.begin(), extra.end());
+    if (!m_bigTiff && (m_offset + out.size() > CLASSIC_OFFSET_LIMIT)) {
+        m_failed = true;
+        return;
+    }
+    m_file.write(reinterpret_cast<const char *>(out.data()), out.size());
+    m_offset += out.size();
+
+    //Point the header at the directory
+    std::vector<uint8_t> pointer;
+    putOffset(pointer, directoryOffset);
+    m_file.seekp(m_bigTiff ? 8 : 4);
+    m_file.write(reinterpret_cast<const char *>(pointer.data()), pointer.size());
+}//end writeDirectory
+
+void TiffWriter::put16(std::vector<uint8_t> &buf, uint16_t v) const {
+    buf.push_back(static_cast<uint8_t>(v & 0xFF));
+    buf.push_back(static_cast<uint8_t>(v >> 8));
+}//end put16
+
+void TiffWriter::put32(std::vector<uint8_t> &buf, uint32_t v) const {
+    put16(buf, static_cast<uint16_t>(v & 0xFFFF));
+    put16(buf, static_cast<uint16_t>(v >> 16));
+}//end put32
+
+void TiffWriter::put64(std::vector<uint8_t> &buf, uint64_t v) const {
+    put32(buf, static_cast<uint32_t>(v & 0xFFFFFFFFull));
+    put32(buf, static_cast<uint32_t>(v >> 32));
+}//end put64
+
+void TiffWriter::putOffset(std::vector<uint8_t> &buf, uint64_t v) const {
+    if (m_bigTiff) { put64(buf, v); }
+    else { put32(buf, static_cast<uint32_t>(v)); }
+}//end putOffset
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,112 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TIFFWRITER_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_TIFFWRITER_H
+
+// System headers
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Plugin headers
+#include "TileCodec.h"
+
+namespace sedeen {
+namespace algorithm {
+
+///Writes an 8-bit RGB or greyscale image to a tiled TIFF file one tile at a time,
+///so that only the tile being written has to be held in memory. Tiles may arrive
+///in any order. The directory is written by close(), after the pixel data.
+///Files that could exceed 4 GB are written as BigTIFF. Tiles are compressed by a TileCodec,
+///either by writeTile or, so that several threads can share the work, beforehand.
+class TiffWriter {
+public:
+    TiffWriter();
+    ///Closes the file if it is still open
+    ~TiffWriter();
+
+    TiffWriter(const TiffWriter &) = delete;
+    TiffWriter &operator=(const TiffWriter &) = delete;
+
+    ///Create the file. tileSize must be a multiple of 16. Returns false if the file cannot be created.
+    bool open(const std::string &path, int width, int height, int tileSize, int channels = 3,
+        const TileCodec &codec = TileCodec());
+
+    ///Compress and write the tile at the given column and row. data holds tileSize x tileSize
+    ///pixels, row by row, channels bytes per pixel; edge tiles are padded to the full tile size.
+    bool writeTile(int column, int row, const uint8_t *data);
+
+    ///Write a tile already compressed by codec(). Fails, and so does close(), if the tile
+    ///would end past the 4 GB that the offsets of a classic (not BigTIFF) file can reach.
+    bool writeEncodedTile(int column, int row, const uint8_t *data, size_t size);
+
+    ///Write the image directory and close the file. Returns false if any tile is missing or a write failed.
+    bool close();
+
+    ///Close and delete the file
+    void abort();
+
+    int tilesAcross() const { return m_tilesAcross; }
+    int tilesDown() const { return m_tilesDown; }
+    int tileSize() const { return m_tileSize; }
+    bool isBigTiff() const { return m_bigTiff; }
+    const TileCodec &codec() const { return m_codec; }
+    ///Bytes written to the file so far
+    uint64_t bytesWritten() const { return m_offset; }
+
+    ///Return true if a file with these dimensions needs BigTIFF offsets. Compressed
+    ///files are allowed to grow by half, the worst case of LZW on noise.
+    static bool needsBigTiff(int width, int height, int channels,
+        TileCodec::Compression compression = TileCodec::None);
+
+private:
+    void writeHeader();
+    void writeDirectory();
+    void put16(std::vector<uint8_t> &buf, uint16_t v) const;
+    void put32(std::vector<uint8_t> &buf, uint32_t v) const;
+    void put64(std::vector<uint8_t> &buf, uint64_t v) const;
+    ///Append an offset-sized value (4 bytes, or 8 for BigTIFF)
+    void putOffset(std::vector<uint8_t> &buf, uint64_t v) const;
+
+private:
+    std::ofstream m_file;
+    std::string m_path;
+    int m_width, m_height, m_tileSize, m_channels;
+    int m_tilesAcross, m_tilesDown;
+    TileCodec m_codec;
+    bool m_bigTiff;
+    bool m_failed;
+    uint64_t m_offset;
+    std::vector<uint64_t> m_tileOffsets;
+    std::vector<uint64_t> m_tileByteCounts;
+    ///Compressed tile reused by writeTile
+    std::vector<uint8_t> m_encoded;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TIFFWRITER_H
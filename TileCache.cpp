@@ -0,0 +1,137 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "TileCache.h"
+
+// System headers
+#include <functional>
+#include <utility>
+
+namespace sedeen {
+namespace algorithm {
+
+size_t TileKeyHash::operator()(const TileKey &key) const {
+    size_t seed = std::hash<int>()(key.level);
+    seed ^= std::hash<int>()(key.column) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed ^= std::hash<int>()(key.row) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    return seed;
+}//end operator()
+
+TileCache::TileCache(size_t capacityBytes)
+    : m_mutex(),
+    m_recency(),
+    m_entries(),
+    m_capacityBytes(capacityBytes),
+    m_bytes(0),
+    m_hits(0),
+    m_misses(0),
+    m_evictions(0)
+{
+}//end constructor
+
+std::shared_ptr<const TileBuffer> TileCache::find(const TileKey &key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        ++m_misses;
+        return nullptr;
+    }
+    ++m_hits;
+    //Move to the front of the recency list without reallocating the node
+    m_recency.splice(m_recency.begin(), m_recency, it->second.position);
+    return it->second.tile;
+}//end find
+
+std::shared_ptr<const TileBuffer> TileCache::peek(const TileKey &key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) { return nullptr; }
+    m_recency.splice(m_recency.begin(), m_recency, it->second.position);
+    return it->second.tile;
+}//end peek
+
+void TileCache::insert(const TileKey &key, std::shared_ptr<const TileBuffer> tile) {
+    if (!tile) { return; }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (tile->bytes() > m_capacityBytes) { return; }
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        //Another reader composed the same tile; keep the newer copy
+        m_bytes -= it->second.tile->bytes();
+        it->second.tile = tile;
+        m_recency.splice(m_recency.begin(), m_recency, it->second.position);
+    }
+    else {
+        m_recency.push_front(key);
+        m_entries.emplace(key, Entry{ tile, m_recency.begin() });
+    }
+    m_bytes += tile->bytes();
+    evictToCapacity();
+}//end insert
+
+void TileCache::setCapacity(size_t capacityBytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacityBytes = capacityBytes;
+    evictToCapacity();
+}//end setCapacity
+
+void TileCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_recency.clear();
+    m_bytes = 0;
+}//end clear
+
+TileCache::Statistics TileCache::statistics() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Statistics stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.evictions = m_evictions;
+    stats.entries = m_entries.size();
+    stats.bytes = m_bytes;
+    stats.capacityBytes = m_capacityBytes;
+    return stats;
+}//end statistics
+
+void TileCache::resetCounters() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+}//end resetCounters
+
+void TileCache::evictToCapacity() {
+    while ((m_bytes > m_capacityBytes) && !m_recency.empty()) {
+        auto it = m_entries.find(m_recency.back());
+        m_bytes -= it->second.tile->bytes();
+        m_entries.erase(it);
+        m_recency.pop_back();
+        ++m_evictions;
+    }
+}//end evictToCapacity
+
+} // namespace algorithm
+} // namespace sedeen
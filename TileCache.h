@@ -0,0 +1,131 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TILECACHE_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_TILECACHE_H
+
+// System headers
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+///Decoded 8-bit RGB pixels of one cache tile, rows packed without padding
+struct TileBuffer {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+
+    size_t bytes() const { return pixels.size(); }
+};
+
+///Position of a tile in the grid of one pyramid level
+struct TileKey {
+    int level;
+    int column;
+    int row;
+
+    bool operator==(const TileKey &other) const {
+        return (level == other.level) && (column == other.column) && (row == other.row);
+    }
+};
+
+///Hash function for TileKey
+struct TileKeyHash {
+    size_t operator()(const TileKey &key) const;
+};
+
+///Thread-safe cache of decoded tiles, bounded by the total size of the pixels it holds
+///rather than by a number of entries. When full, the least recently used tiles are evicted.
+///Tiles are shared with readers, so an evicted tile stays valid for whoever still holds it.
+class TileCache {
+public:
+    ///Counters used to tune the byte budget for a scanner's tile size
+    struct Statistics {
+        int64_t hits = 0;
+        int64_t misses = 0;
+        int64_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+        size_t capacityBytes = 0;
+
+        double hitRate() const {
+            const int64_t lookups = hits + misses;
+            return (lookups > 0) ? static_cast<double>(hits) / lookups : 0.0;
+        }
+    };
+
+    explicit TileCache(size_t capacityBytes);
+
+    ///Return the tile and mark it most recently used, or nullptr if it is not cached
+    std::shared_ptr<const TileBuffer> find(const TileKey &key);
+
+    ///Return the tile like find, without counting a hit or a miss (for prefetching)
+    std::shared_ptr<const TileBuffer> peek(const TileKey &key);
+
+    ///Add a tile, evicting the least recently used tiles to stay within the byte budget.
+    ///A tile larger than the whole budget is not kept.
+    void insert(const TileKey &key, std::shared_ptr<const TileBuffer> tile);
+
+    ///Change the byte budget, evicting tiles if it shrinks
+    void setCapacity(size_t capacityBytes);
+
+    ///Remove every tile
+    void clear();
+
+    Statistics statistics() const;
+
+    ///Zero the hit, miss and eviction counters
+    void resetCounters();
+
+private:
+    ///Evict from the back of the recency list until the tiles fit in the budget. m_mutex must be held.
+    void evictToCapacity();
+
+private:
+    typedef std::list<TileKey> RecencyList;
+    struct Entry {
+        std::shared_ptr<const TileBuffer> tile;
+        RecencyList::iterator position;
+    };
+
+    mutable std::mutex m_mutex;
+    ///Most recently used at the front
+    RecencyList m_recency;
+    std::unordered_map<TileKey, Entry, TileKeyHash> m_entries;
+    size_t m_capacityBytes;
+    size_t m_bytes;
+    int64_t m_hits, m_misses, m_evictions;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TILECACHE_H
@@ -0,0 +1,239 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "TileCodec.h"
+
+// System headers
+#include <algorithm>
+#include <cstring>
+
+#ifdef BOXDROP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// Plugin headers
+#include "JpegEncoder.h"
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+//LZW codes of the TIFF variant
+const int LZW_CLEAR = 256;
+const int LZW_END = 257;
+const int LZW_FIRST = 258;
+const int LZW_MAX_BITS = 12;
+///Table size at which the encoder starts again with a Clear code (as libtiff does)
+const int LZW_LIMIT = (1 << LZW_MAX_BITS) - 2;
+
+///Packs variable-width codes most significant bit first
+class CodeWriter {
+public:
+    explicit CodeWriter(std::vector<uint8_t> &out) : m_out(out), m_buffer(0), m_count(0) {}
+
+    void put(int code, int bits) {
+        m_buffer = (m_buffer << bits) | static_cast<uint32_t>(code);
+        m_count += bits;
+        while (m_count >= 8) {
+            m_count -= 8;
+            m_out.push_back(static_cast<uint8_t>((m_buffer >> m_count) & 0xFF));
+        }
+        m_buffer &= (1u << m_count) - 1;
+    }
+
+    void flush() {
+        if (m_count > 0) { m_out.push_back(static_cast<uint8_t>((m_buffer << (8 - m_count)) & 0xFF)); }
+        m_buffer = 0;
+        m_count = 0;
+    }
+
+private:
+    std::vector<uint8_t> &m_out;
+    uint32_t m_buffer;
+    int m_count;
+};
+} // namespace
+
+TileCodec::TileCodec(Compression compression, int jpegQuality)
+    : m_compression(compression),
+    m_jpegQuality(std::max(1, std::min(100, jpegQuality)))
+{
+}//end constructor
+
+bool TileCodec::isAvailable(Compression compression) {
+    switch (compression) {
+    case None:
+    case LZW:
+    case JPEG:
+    case PackBits:
+        return true;
+    case Deflate:
+#ifdef BOXDROP_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}//end isAvailable
+
+const char *TileCodec::name(Compression compression) {
+    switch (compression) {
+    case None: return "None";
+    case LZW: return "LZW";
+    case JPEG: return "JPEG";
+    case Deflate: return "Deflate";
+    case PackBits: return "PackBits";
+    }
+    return "Unknown";
+}//end name
+
+bool TileCodec::encode(const uint8_t *pixels, int width, int height, int channels, std::vector<uint8_t> &out) const {
+    out.clear();
+    const size_t rowBytes = static_cast<size_t>(width) * channels;
+    const size_t size = rowBytes * height;
+    if (m_compression == None) {
+        out.assign(pixels, pixels + size);
+        return true;
+    }
+    if (m_compression == JPEG) {
+        if ((width % 16 != 0) || (height % 16 != 0)) { return false; }
+        JpegEncoder encoder(m_jpegQuality, channels);
+        return encoder.encode(pixels, width, height, width, out);
+    }
+    if (m_compression == PackBits) {
+        encodePackBits(pixels, rowBytes, height, out);
+        return true;
+    }
+
+    //Differences from the pixel to the left compress much better than the values themselves
+    std::vector<uint8_t> differences(pixels, pixels + size);
+    for (int y = 0; y < height; ++y) {
+        uint8_t *row = differences.data() + y * rowBytes;
+        for (size_t i = rowBytes - 1; i >= static_cast<size_t>(channels); --i) {
+            row[i] = static_cast<uint8_t>(row[i] - row[i - channels]);
+        }
+    }
+    if (m_compression == LZW) {
+        encodeLZW(differences.data(), size, out);
+        return true;
+    }
+    return encodeDeflate(differences.data(), size, out);
+}//end encode
+
+void TileCodec::encodePackBits(const uint8_t *data, size_t rowBytes, int rows, std::vector<uint8_t> &out) {
+    //Each row is packed separately, in runs and literals of up to 128 bytes
+    for (int y = 0; y < rows; ++y) {
+        const uint8_t *row = data + y * rowBytes;
+        size_t i = 0;
+        while (i < rowBytes) {
+            size_t j = i + 1;
+            while ((j < rowBytes) && (j - i < 128) && (row[j] == row[i])) { ++j; }
+            if (j - i >= 2) {
+                out.push_back(static_cast<uint8_t>(257 - (j - i)));
+                out.push_back(row[i]);
+                i = j;
+                continue;
+            }
+            //A literal ends where a run of three or more begins
+            j = i + 1;
+            while ((j < rowBytes) && (j - i < 128)
+                && !((j + 2 < rowBytes) && (row[j] == row[j + 1]) && (row[j] == row[j + 2]))) {
+                ++j;
+            }
+            out.push_back(static_cast<uint8_t>(j - i - 1));
+            out.insert(out.end(), row + i, row + j);
+            i = j;
+        }
+    }
+}//end encodePackBits
+
+void TileCodec::encodeLZW(const uint8_t *data, size_t size, std::vector<uint8_t> &out) {
+    //Open-addressed table from (prefix code, next byte) to code; twice the number of codes
+    const int tableSize = 1 << (LZW_MAX_BITS + 1);
+    std::vector<int32_t> keys(tableSize, -1);
+    std::vector<int16_t> codes(tableSize, 0);
+    CodeWriter writer(out);
+    int bits = 9;
+    int next = LZW_FIRST;
+    //TIFF readers switch to wider codes one code early, so the encoder does too
+    auto added = [&]() {
+        ++next;
+        if (next == LZW_LIMIT) {
+            writer.put(LZW_CLEAR, bits);
+            std::fill(keys.begin(), keys.end(), -1);
+            next = LZW_FIRST;
+            bits = 9;
+        }
+        else if (next > (1 << bits) - 1) {
+            ++bits;
+        }
+    };
+
+    writer.put(LZW_CLEAR, bits);
+    if (size > 0) {
+        int prefix = data[0];
+        for (size_t i = 1; i < size; ++i) {
+            const int32_t key = (prefix << 8) | data[i];
+            size_t slot = (static_cast<uint32_t>(key) * 2654435761u) >> (32 - LZW_MAX_BITS - 1);
+            while ((keys[slot] != -1) && (keys[slot] != key)) { slot = (slot + 1) & (tableSize - 1); }
+            if (keys[slot] == key) {
+                prefix = codes[slot];
+                continue;
+            }
+            writer.put(prefix, bits);
+            keys[slot] = key;
+            codes[slot] = static_cast<int16_t>(next);
+            added();
+            prefix = data[i];
+        }
+        writer.put(prefix, bits);
+        added();
+    }
+    writer.put(LZW_END, bits);
+    writer.flush();
+}//end encodeLZW
+
+bool TileCodec::encodeDeflate(const uint8_t *data, size_t size, std::vector<uint8_t> &out) {
+#ifdef BOXDROP_HAVE_ZLIB
+    //Fastest level: on tissue it gives most of the saving of the default level in a fraction of the time
+    uLongf length = compressBound(static_cast<uLong>(size));
+    out.resize(length);
+    if (compress2(out.data(), &length, data, static_cast<uLong>(size), Z_BEST_SPEED) != Z_OK) {
+        out.clear();
+        return false;
+    }
+    out.resize(length);
+    return true;
+#else
+    (void)data;
+    (void)size;
+    (void)out;
+    return false;
+#endif
+}//end encodeDeflate
+
+} // namespace algorithm
+} // namespace sedeen
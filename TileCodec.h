@@ -0,0 +1,81 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TILECODEC_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_TILECODEC_H
+
+// System headers
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+///Compresses one TIFF tile (or strip) of 8-bit RGB or greyscale pixels. A codec holds no
+///state between calls, so one codec can compress tiles on several threads at once.
+class TileCodec {
+public:
+    ///Compression schemes, valued as the TIFF Compression tag
+    enum Compression {
+        None = 1,
+        LZW = 5,
+        JPEG = 7,
+        Deflate = 8,
+        PackBits = 32773
+    };
+
+    explicit TileCodec(Compression compression = None, int jpegQuality = 90);
+
+    Compression compression() const { return m_compression; }
+    ///Quality (1-100) of JPEG compression
+    int jpegQuality() const { return m_jpegQuality; }
+
+    ///Return true if rows are stored as differences from the pixel to the left (TIFF Predictor 2)
+    bool usesPredictor() const { return (m_compression == LZW) || (m_compression == Deflate); }
+
+    ///Compress width x height pixels of channels bytes, rows packed one after another, into out.
+    ///JPEG needs width and height to be multiples of 16. Returns false on failure.
+    bool encode(const uint8_t *pixels, int width, int height, int channels, std::vector<uint8_t> &out) const;
+
+    ///Return true if this build can write compression (Deflate needs zlib)
+    static bool isAvailable(Compression compression);
+
+    ///Short name of compression, e.g. "LZW"
+    static const char *name(Compression compression);
+
+private:
+    static void encodePackBits(const uint8_t *data, size_t rowBytes, int rows, std::vector<uint8_t> &out);
+    static void encodeLZW(const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+    static bool encodeDeflate(const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+
+private:
+    Compression m_compression;
+    int m_jpegQuality;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TILECODEC_H
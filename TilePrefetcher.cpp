@@ -0,0 +1,115 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "TilePrefetcher.h"
+
+// System headers
+#include <algorithm>
+
+namespace sedeen {
+namespace algorithm {
+
+TilePrefetcher::TilePrefetcher(std::shared_ptr<TileSource> source, int lookAhead)
+    : m_source(source),
+    m_maxLookAhead(std::max(0, lookAhead)),
+    m_lookAhead(0),
+    m_plan(),
+    m_thread(),
+    m_mutex(),
+    m_wake(),
+    m_stopping(false),
+    m_ahead(),
+    m_requested(),
+    m_prefetched(0)
+{
+}//end constructor
+
+TilePrefetcher::~TilePrefetcher() {
+    stop();
+}//end destructor
+
+void TilePrefetcher::start(const std::vector<TileKey> &plan) {
+    stop();
+    m_plan = plan;
+    m_ahead.clear();
+    m_requested.clear();
+    m_prefetched = 0;
+    m_stopping = false;
+    //Keep the prefetched cells within a quarter of the cache, so that they survive until they are read
+    auto cache = m_source->cache();
+    m_lookAhead = 0;
+    if (!cache || m_plan.empty()) { return; }
+    const size_t cellBytes = static_cast<size_t>(m_source->cellSize()) * m_source->cellSize() * 3;
+    const size_t affordable = cache->statistics().capacityBytes / 4 / cellBytes;
+    m_lookAhead = static_cast<int>(std::min<size_t>(m_maxLookAhead, affordable));
+    if (m_lookAhead <= 0) { return; }
+    m_thread = std::thread(&TilePrefetcher::prefetch, this);
+}//end start
+
+void TilePrefetcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    if (m_thread.joinable()) { m_thread.join(); }
+}//end stop
+
+void TilePrefetcher::cellRequested(const TileKey &key) {
+    bool released = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requested.insert(key);
+        released = (m_ahead.erase(key) > 0);
+    }
+    if (released) { m_wake.notify_all(); }
+}//end cellRequested
+
+int64_t TilePrefetcher::cellsPrefetched() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_prefetched;
+}//end cellsPrefetched
+
+void TilePrefetcher::prefetch() {
+    for (auto it = m_plan.begin(); it != m_plan.end(); ++it) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]() {
+                return m_stopping || (m_ahead.size() < static_cast<size_t>(m_lookAhead));
+            });
+            if (m_stopping) { return; }
+            //The readers have passed this cell already
+            if (m_requested.count(*it) > 0) { continue; }
+        }
+        //Cells already cached, or being composed by a reader, are not composed again
+        if (!m_source->prefetchCell(*it)) { continue; }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_prefetched;
+        if (m_requested.count(*it) == 0) { m_ahead.insert(*it); }
+    }
+}//end prefetch
+
+} // namespace algorithm
+} // namespace sedeen
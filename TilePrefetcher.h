@@ -0,0 +1,104 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TILEPREFETCHER_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_TILEPREFETCHER_H
+
+// System headers
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Plugin headers
+#include "TileCache.h"
+#include "TileSource.h"
+
+namespace sedeen {
+namespace algorithm {
+
+///Reads the cells of the cache grid that an export will need into the tile cache on a
+///background thread, in the order the export will use them, so that decoding (and the slide
+///I/O behind it) overlaps the compositing and encoding of the regions before them.
+///The prefetcher stays at most lookAhead cells ahead of the readers: a cell counts until a
+///reader asks for it, and cells the readers have already asked for are skipped. The look-ahead
+///is also kept to a quarter of the cache budget, so prefetched cells are not evicted before use.
+///Register the prefetcher with TileSource::setPrefetcher while the export runs.
+class TilePrefetcher {
+public:
+    ///Number of cells read ahead of the readers, unless another is given
+    static const int DefaultLookAhead = 32;
+
+    explicit TilePrefetcher(std::shared_ptr<TileSource> source, int lookAhead = DefaultLookAhead);
+
+    ///Stops the background thread
+    ~TilePrefetcher();
+
+    ///Start prefetching the cells of plan in order, stopping any earlier plan first
+    void start(const std::vector<TileKey> &plan);
+
+    ///Stop prefetching and wait for the background thread
+    void stop();
+
+    ///Record that a reader asked for key. Called by the tile source from the reading threads.
+    void cellRequested(const TileKey &key);
+
+    ///Number of cells the prefetcher composed since the last start
+    int64_t cellsPrefetched() const;
+
+    ///Number of cells in the plan of the last start
+    size_t cellsPlanned() const { return m_plan.size(); }
+
+    ///Look-ahead in use, after the bound set by the cache budget
+    int lookAhead() const { return m_lookAhead; }
+
+private:
+    ///Body of the background thread
+    void prefetch();
+
+private:
+    std::shared_ptr<TileSource> m_source;
+    ///Look-ahead asked for, and the one in use by the current plan
+    int m_maxLookAhead;
+    int m_lookAhead;
+    std::vector<TileKey> m_plan;
+    std::thread m_thread;
+    ///Guards the members below
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping;
+    ///Cells prefetched that no reader has asked for yet
+    std::unordered_set<TileKey, TileKeyHash> m_ahead;
+    ///Cells the readers have asked for
+    std::unordered_set<TileKey, TileKeyHash> m_requested;
+    int64_t m_prefetched;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TILEPREFETCHER_H
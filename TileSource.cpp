@@ -0,0 +1,280 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "TileSource.h"
+
+// System headers
+#include <algorithm>
+#include <chrono>
+
+// Plugin headers
+#include "TilePrefetcher.h"
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+///Time this thread has waited for cells composed by other readers
+thread_local int64_t t_waitNanoseconds = 0;
+
+///Integer division rounding towards negative infinity
+int floorDiv(int a, int b) {
+    return (a >= 0) ? (a / b) : -((-a + b - 1) / b);
+}
+} // namespace
+
+TileSource::TileSource(std::shared_ptr<image::tile::Factory> factory)
+    : m_factory(factory),
+    m_cache(nullptr),
+    m_imageBounds(),
+    m_cellSize(DefaultCellSize),
+    m_idleCompositors(),
+    m_mutex(),
+    m_regionsRead(0),
+    m_profile(nullptr),
+    m_prefetcher(nullptr),
+    m_pending(),
+    m_pendingMutex(),
+    m_pendingDone()
+{
+}//end constructor
+
+TileSource::TileSource(std::shared_ptr<image::tile::Factory> factory, const Size &imageSize,
+    std::shared_ptr<TileCache> cache, int cellSize)
+    : m_factory(factory),
+    m_cache(cache),
+    m_imageBounds(0, 0, imageSize.width(), imageSize.height()),
+    m_cellSize((cellSize > 0) ? cellSize : DefaultCellSize),
+    m_idleCompositors(),
+    m_mutex(),
+    m_regionsRead(0),
+    m_profile(nullptr),
+    m_prefetcher(nullptr),
+    m_pending(),
+    m_pendingMutex(),
+    m_pendingDone()
+{
+}//end constructor
+
+image::RawImage TileSource::getImage(const BoxRect &region, const Size &outputSize) {
+    Size size;
+    size.setWidth(region.width);
+    size.setHeight(region.height);
+    Point point;
+    point.setX(region.x);
+    point.setY(region.y);
+    //Only taking a compositor is serialized; the read itself runs alongside other readers
+    std::unique_ptr<image::tile::Compositor> compositor;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_idleCompositors.empty()) {
+            compositor = std::move(m_idleCompositors.back());
+            m_idleCompositors.pop_back();
+        }
+    }
+    if (!compositor) { compositor = std::make_unique<image::tile::Compositor>(m_factory); }
+    ++m_regionsRead;
+    if (m_profile) { m_profile->add(RunProfile::TilesFetched, 1); }
+    image::RawImage image;
+    {
+        ScopedStageTimer timer(m_profile, RunProfile::Compositing);
+        image = compositor->getImage(Rect(point, size), outputSize);
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_idleCompositors.push_back(std::move(compositor));
+    return image;
+}//end getImage
+
+int TileSource::previewLevel(const BoxRect &region, int previewSide) {
+    const int side = std::max(region.width, region.height);
+    int level = 0;
+    while ((previewSide > 0) && ((side >> (level + 1)) >= previewSide)) {
+        ++level;
+    }
+    return level;
+}//end previewLevel
+
+image::RawImage TileSource::getPreview(const BoxRect &region, int previewSide) {
+    if (region.isEmpty()) { return image::RawImage(); }
+    const int level = previewLevel(region, previewSide);
+    const int scale = 1 << level;
+    //Round up, so that a partial pixel of the level at the edge is kept
+    Size size;
+    size.setWidth((region.width + scale - 1) / scale);
+    size.setHeight((region.height + scale - 1) / scale);
+    return getImage(region, size);
+}//end getPreview
+
+bool TileSource::readRegion(const BoxRect &region, std::vector<uint8_t> &buffer, int stride, int rows) {
+    if (region.isEmpty() || (stride < region.width) || (rows < region.height)) { return false; }
+    buffer.assign(static_cast<size_t>(rows) * stride * 3, 0);
+    if (m_cache) {
+        //Assemble the region from the cells of the cache grid that it overlaps
+        const int firstColumn = floorDiv(region.x, m_cellSize);
+        const int lastColumn = floorDiv(region.right() - 1, m_cellSize);
+        const int firstRow = floorDiv(region.y, m_cellSize);
+        const int lastRow = floorDiv(region.bottom() - 1, m_cellSize);
+        for (int row = firstRow; row <= lastRow; ++row) {
+            for (int column = firstColumn; column <= lastColumn; ++column) {
+                auto cell = cachedCell(column, row);
+                if (!cell) {
+                    //Cells outside the image stay black
+                    if (boxesIntersect(BoxRect(column * m_cellSize, row * m_cellSize, m_cellSize, m_cellSize),
+                        m_imageBounds)) {
+                        return false;
+                    }
+                    continue;
+                }
+                const BoxRect cellRect(column * m_cellSize, row * m_cellSize, cell->width, cell->height);
+                const int x0 = std::max(region.x, cellRect.x);
+                const int x1 = std::min(region.right(), cellRect.right());
+                const int y0 = std::max(region.y, cellRect.y);
+                const int y1 = std::min(region.bottom(), cellRect.bottom());
+                for (int y = y0; y < y1; ++y) {
+                    const uint8_t *src = cell->pixels.data()
+                        + (static_cast<size_t>(y - cellRect.y) * cell->width + (x0 - cellRect.x)) * 3;
+                    uint8_t *dst = buffer.data()
+                        + (static_cast<size_t>(y - region.y) * stride + (x0 - region.x)) * 3;
+                    std::copy(src, src + static_cast<size_t>(x1 - x0) * 3, dst);
+                }
+            }
+        }
+        return true;
+    }
+    //Request the region at full resolution: output size equal to the source size
+    Size size;
+    size.setWidth(region.width);
+    size.setHeight(region.height);
+    image::RawImage image = getImage(region, size);
+    if ((image.width() < region.width) || (image.height() < region.height)) { return false; }
+    //The copy happens outside the lock
+    copyToRGB(image, region.width, region.height, buffer.data(), stride);
+    return true;
+}//end readRegion
+
+std::shared_ptr<const TileBuffer> TileSource::alignedCell(const BoxRect &region) {
+    if (!m_cache || region.isEmpty() || (region.x % m_cellSize != 0) || (region.y % m_cellSize != 0)) {
+        return nullptr;
+    }
+    auto cell = cachedCell(floorDiv(region.x, m_cellSize), floorDiv(region.y, m_cellSize));
+    if (!cell || (cell->width != region.width) || (cell->height != region.height)) { return nullptr; }
+    return cell;
+}//end alignedCell
+
+std::shared_ptr<const TileBuffer> TileSource::cachedCell(int column, int row) {
+    TileKey key{ 0, column, row };
+    if (m_prefetcher) { m_prefetcher->cellRequested(key); }
+    auto cell = m_cache->find(key);
+    if (cell) { return cell; }
+    return composeCell(key);
+}//end cachedCell
+
+std::shared_ptr<const TileBuffer> TileSource::composeCell(const TileKey &key, bool *composed) {
+    if (composed) { *composed = false; }
+    {
+        std::unique_lock<std::mutex> lock(m_pendingMutex);
+        //Another reader, or the prefetcher, is composing the cell: wait for it rather than decode it twice
+        if (m_pending.count(key) > 0) {
+            const auto waitStart = std::chrono::steady_clock::now();
+            m_pendingDone.wait(lock, [&]() { return m_pending.count(key) == 0; });
+            t_waitNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - waitStart).count();
+            auto cell = m_cache->peek(key);
+            if (cell) { return cell; }
+        }
+        m_pending.insert(key);
+    }
+    std::shared_ptr<TileBuffer> tile;
+    //Clip the cell to the image; the last row and column of cells may be partial
+    const int x0 = std::max(key.column * m_cellSize, m_imageBounds.x);
+    const int y0 = std::max(key.row * m_cellSize, m_imageBounds.y);
+    const int x1 = std::min((key.column + 1) * m_cellSize, m_imageBounds.right());
+    const int y1 = std::min((key.row + 1) * m_cellSize, m_imageBounds.bottom());
+    if ((x1 > x0) && (y1 > y0)) {
+        BoxRect cellRect(x0, y0, x1 - x0, y1 - y0);
+        Size size;
+        size.setWidth(cellRect.width);
+        size.setHeight(cellRect.height);
+        image::RawImage image = getImage(cellRect, size);
+        if ((image.width() >= cellRect.width) && (image.height() >= cellRect.height)) {
+            tile = std::make_shared<TileBuffer>();
+            tile->width = cellRect.width;
+            tile->height = cellRect.height;
+            tile->pixels.resize(static_cast<size_t>(tile->width) * tile->height * 3);
+            copyToRGB(image, tile->width, tile->height, tile->pixels.data(), tile->width);
+            m_cache->insert(key, tile);
+            if (composed) { *composed = true; }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending.erase(key);
+    }
+    m_pendingDone.notify_all();
+    return tile;
+}//end composeCell
+
+bool TileSource::prefetchCell(const TileKey &key) {
+    if (!m_cache || m_cache->peek(key)) { return false; }
+    bool composed = false;
+    composeCell(key, &composed);
+    return composed;
+}//end prefetchCell
+
+void TileSource::appendCells(const BoxRect &region, std::vector<TileKey> &cells) const {
+    if (!m_cache || region.isEmpty()) { return; }
+    const int x0 = std::max(region.x, m_imageBounds.x);
+    const int y0 = std::max(region.y, m_imageBounds.y);
+    const int x1 = std::min(region.right(), m_imageBounds.right());
+    const int y1 = std::min(region.bottom(), m_imageBounds.bottom());
+    if ((x1 <= x0) || (y1 <= y0)) { return; }
+    for (int row = floorDiv(y0, m_cellSize); row <= floorDiv(y1 - 1, m_cellSize); ++row) {
+        for (int column = floorDiv(x0, m_cellSize); column <= floorDiv(x1 - 1, m_cellSize); ++column) {
+            cells.push_back(TileKey{ 0, column, row });
+        }
+    }
+}//end appendCells
+
+double TileSource::threadWaitSeconds() {
+    return t_waitNanoseconds * 1e-9;
+}//end threadWaitSeconds
+
+void TileSource::copyToRGB(const image::RawImage &image, int width, int height,
+    uint8_t *dst, int dstStride) {
+    //Greyscale images are replicated into all three channels; an alpha channel is dropped
+    const int components = image.components();
+    for (int y = 0; y < height; ++y) {
+        uint8_t *out = dst + static_cast<size_t>(y) * dstStride * 3;
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                const int source = (components >= 3) ? c : 0;
+                out[3 * x + c] = static_cast<uint8_t>(image.at(x, y, source));
+            }
+        }
+    }
+}//end copyToRGB
+
+} // namespace algorithm
+} // namespace sedeen
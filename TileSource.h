@@ -0,0 +1,158 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TILESOURCE_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_TILESOURCE_H
+
+// System headers
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+// DPTK headers
+#include "Global.h"
+#include "Image.h"
+#include "image/tile/Factory.h"
+
+// Plugin headers
+#include "BoxPlacement.h"
+#include "RunProfile.h"
+#include "TileCache.h"
+
+namespace sedeen {
+namespace algorithm {
+
+class TilePrefetcher;
+
+///Thread-safe access to the pixels of one image through a single shared (cached) tile factory.
+///Several export workers can read regions at the same time: each read composes through a
+///compositor of its own over the shared factory, which must itself be thread-safe (the cached
+///factory of the viewer is), so decoding, compositing and encoding all run in parallel.
+///If a TileCache is given, full-resolution reads are assembled from cached cells of a fixed
+///grid, so pixels decoded by one run are reused by the next. A cell wanted by several readers
+///at once is composed by the first and waited for by the others.
+class TileSource {
+public:
+    ///Edge length in pixels of the cache grid, unless another is given
+    static const int DefaultCellSize = 512;
+
+    ///Read every region directly from the factory
+    explicit TileSource(std::shared_ptr<image::tile::Factory> factory);
+
+    ///Read full-resolution regions through cache, in cells of cellSize pixels aligned to
+    ///the image origin. imageSize is the level-0 size of the image.
+    TileSource(std::shared_ptr<image::tile::Factory> factory, const Size &imageSize,
+        std::shared_ptr<TileCache> cache, int cellSize = DefaultCellSize);
+
+    ///Compose region into an image of outputSize (full resolution if the sizes are equal)
+    image::RawImage getImage(const BoxRect &region, const Size &outputSize);
+
+    ///Coarsest pyramid level, counting power-of-two downsamplings from level 0, at which the
+    ///longer side of region still spans at least previewSide pixels (0 if it never does)
+    static int previewLevel(const BoxRect &region, int previewSide);
+
+    ///Compose region at its previewLevel, so that the compositor reads the tiles of that level
+    ///of the pyramid through the cached factory and the cost follows previewSide, not the
+    ///size of region. The level-0 cache grid is bypassed.
+    image::RawImage getPreview(const BoxRect &region, int previewSide);
+
+    ///Compose region at full resolution into the top left of buffer, which is resized to
+    ///rows x stride 8-bit RGB pixels and padded with black
+    bool readRegion(const BoxRect &region, std::vector<uint8_t> &buffer, int stride, int rows);
+
+    ///Return the cached cell that covers exactly region (composing it on a miss), so that its
+    ///pixels can be used without copying. nullptr if there is no cache or region is not one
+    ///whole cell of the grid (clipped to the image).
+    std::shared_ptr<const TileBuffer> alignedCell(const BoxRect &region);
+
+    ///Compose the cell key into the cache unless it is cached or being composed already.
+    ///Returns true if this call composed it.
+    bool prefetchCell(const TileKey &key);
+
+    ///Append to cells the cells of the cache grid that region overlaps inside the image, row by
+    ///row. Nothing is appended if there is no cache.
+    void appendCells(const BoxRect &region, std::vector<TileKey> &cells) const;
+
+    ///Edge length in pixels of the cache grid
+    int cellSize() const { return m_cellSize; }
+
+    ///Number of regions requested from the factory
+    int64_t regionsRead() const { return m_regionsRead; }
+
+    ///Seconds the calling thread has spent, across all sources, waiting for a cell another
+    ///reader was composing. Export workers subtract it from their busy time.
+    static double threadWaitSeconds();
+
+    std::shared_ptr<image::tile::Factory> factory() const { return m_factory; }
+
+    ///The cache shared by the readers, or nullptr
+    std::shared_ptr<TileCache> cache() const { return m_cache; }
+
+    ///Record compositing time and fetched regions in profile, and let the readers record
+    ///their own stages in it. Set before the readers start; nullptr stops recording.
+    void setProfile(RunProfile *profile) { m_profile = profile; }
+    RunProfile *profile() const { return m_profile; }
+
+    ///Tell prefetcher about every cell the readers ask for, so that it stays a bounded distance
+    ///ahead of them. Set before the readers start; nullptr stops it.
+    void setPrefetcher(TilePrefetcher *prefetcher) { m_prefetcher = prefetcher; }
+
+    ///Copy a width x height block of image into dst as 8-bit RGB, rows dstStride pixels apart
+    static void copyToRGB(const image::RawImage &image, int width, int height,
+        uint8_t *dst, int dstStride);
+
+private:
+    ///Return the cached cell at column, row, composing it on a miss. nullptr if outside the image.
+    std::shared_ptr<const TileBuffer> cachedCell(int column, int row);
+
+    ///Compose key into the cache, or wait for the reader already composing it. composed, if
+    ///given, is set to whether this call composed the cell.
+    std::shared_ptr<const TileBuffer> composeCell(const TileKey &key, bool *composed = nullptr);
+
+private:
+    std::shared_ptr<image::tile::Factory> m_factory;
+    std::shared_ptr<TileCache> m_cache;
+    BoxRect m_imageBounds;
+    int m_cellSize;
+    ///Compositors not in use by a reader; a reader with none free makes another
+    std::vector<std::unique_ptr<image::tile::Compositor>> m_idleCompositors;
+    ///Guards m_idleCompositors
+    std::mutex m_mutex;
+    std::atomic<int64_t> m_regionsRead;
+    RunProfile *m_profile;
+    TilePrefetcher *m_prefetcher;
+    ///Cells being composed, and the signal that one has been
+    std::unordered_set<TileKey, TileKeyHash> m_pending;
+    std::mutex m_pendingMutex;
+    std::condition_variable m_pendingDone;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TILESOURCE_H
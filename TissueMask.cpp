@@ -0,0 +1,91 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Primary header
+#include "TissueMask.h"
+
+// System headers
+#include <algorithm>
+#include <cmath>
+
+namespace sedeen {
+namespace algorithm {
+
+TissueMask::TissueMask()
+    : m_width(0),
+    m_height(0),
+    m_scaleX(0.0),
+    m_scaleY(0.0),
+    m_integral()
+{
+}//end constructor
+
+void TissueMask::build(const uint8_t *rgb, int width, int height, int imageWidth, int imageHeight,
+    int saturationThreshold, int brightnessThreshold) {
+    m_integral.clear();
+    if ((width <= 0) || (height <= 0) || (imageWidth <= 0) || (imageHeight <= 0)) { return; }
+    m_width = width;
+    m_height = height;
+    m_scaleX = static_cast<double>(width) / imageWidth;
+    m_scaleY = static_cast<double>(height) / imageHeight;
+    //Pixels darker than this are padding around the scanned area, not tissue
+    const int blackThreshold = 25;
+
+    const size_t stride = static_cast<size_t>(width) + 1;
+    m_integral.assign(stride * (height + 1), 0);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t *row = rgb + static_cast<size_t>(y) * width * 3;
+        uint32_t rowSum = 0;
+        for (int x = 0; x < width; ++x) {
+            const int r = row[3 * x], g = row[3 * x + 1], b = row[3 * x + 2];
+            const int saturation = std::max(r, std::max(g, b)) - std::min(r, std::min(g, b));
+            const int brightness = (r + g + b) / 3;
+            const bool tissue = (brightness > blackThreshold)
+                && ((saturation >= saturationThreshold) || (brightness <= brightnessThreshold));
+            rowSum += tissue ? 1 : 0;
+            m_integral[(y + 1) * stride + (x + 1)] = m_integral[y * stride + (x + 1)] + rowSum;
+        }
+    }
+}//end build
+
+double TissueMask::tissueFraction(const BoxRect &box) const {
+    if (isEmpty() || box.isEmpty()) { return 0.0; }
+    //Mask pixels touched by the box, clipped to the mask
+    const int x0 = std::max(0, static_cast<int>(std::floor(box.x * m_scaleX)));
+    const int y0 = std::max(0, static_cast<int>(std::floor(box.y * m_scaleY)));
+    const int x1 = std::min(m_width, static_cast<int>(std::ceil(box.right() * m_scaleX)));
+    const int y1 = std::min(m_height, static_cast<int>(std::ceil(box.bottom() * m_scaleY)));
+    if ((x1 <= x0) || (y1 <= y0)) { return 0.0; }
+    const double area = static_cast<double>(x1 - x0) * (y1 - y0);
+    return count(x0, y0, x1, y1) / area;
+}//end tissueFraction
+
+uint32_t TissueMask::count(int x0, int y0, int x1, int y1) const {
+    const size_t stride = static_cast<size_t>(m_width) + 1;
+    return m_integral[y1 * stride + x1] - m_integral[y0 * stride + x1]
+        - m_integral[y1 * stride + x0] + m_integral[y0 * stride + x0];
+}//end count
+
+} // namespace algorithm
+} // namespace sedeen
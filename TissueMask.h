@@ -0,0 +1,81 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TISSUEMASK_H
+#define SEDEEN_SRC_PLUGINS_BOXDROP_TISSUEMASK_H
+
+// System headers
+#include <cstdint>
+#include <vector>
+
+// Plugin headers
+#include "BoxPlacement.h"
+
+namespace sedeen {
+namespace algorithm {
+
+///Low-resolution mask of the tissue on a slide, built once from a thumbnail.
+///The mask is stored as a summed-area table, so the fraction of tissue under any
+///level-0 box is found with four lookups, without reading any full-resolution pixels.
+class TissueMask {
+public:
+    ///Default lower bound on (max - min) of the RGB values for a pixel to count as stained
+    static const int DefaultSaturationThreshold = 20;
+    ///Default upper bound on the mean RGB value for an unsaturated pixel to count as tissue
+    static const int DefaultBrightnessThreshold = 210;
+
+    TissueMask();
+
+    ///Classify each pixel of an 8-bit RGB thumbnail (rows packed) of an image whose level-0
+    ///size is imageWidth x imageHeight. Bright, unsaturated pixels are glass; black pixels
+    ///(outside the scanned area) are not tissue either.
+    void build(const uint8_t *rgb, int width, int height, int imageWidth, int imageHeight,
+        int saturationThreshold = DefaultSaturationThreshold,
+        int brightnessThreshold = DefaultBrightnessThreshold);
+
+    ///Return true until build has been called with a non-empty thumbnail
+    bool isEmpty() const { return m_integral.empty(); }
+
+    ///Fraction (0 to 1) of the level-0 box covered by tissue, in constant time
+    double tissueFraction(const BoxRect &box) const;
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+private:
+    ///Number of tissue pixels in the mask rectangle [x0,x1) x [y0,y1)
+    uint32_t count(int x0, int y0, int x1, int y1) const;
+
+private:
+    int m_width, m_height;
+    ///Mask pixels per level-0 pixel, in each direction
+    double m_scaleX, m_scaleY;
+    ///(m_width + 1) x (m_height + 1) summed-area table with a zero first row and column
+    std::vector<uint32_t> m_integral;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif // ifndef SEDEEN_SRC_PLUGINS_BOXDROP_TISSUEMASK_H
@@ -0,0 +1,544 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Headless batch driver: drops boxes on many slides and exports them, using the same
+// placement, session and export code as the BoxDrop plugin, without Sedeen Viewer.
+//
+// Usage: BoxDropBatch [options] SLIDE... | --slides LIST
+//   --slides LIST        file with one slide path per line
+//   --mode centre|random|lattice
+//                        centre one box on the slide's last annotation (or the whole slide),
+//                        drop random boxes anywhere in the slide, or cover the annotation (or
+//                        the whole slide) with a lattice of boxes (default centre)
+//   --stride N           distance between neighbouring lattice boxes (box size)
+//   --size N             box width and height in pixels (512)
+//   --regions PATTERN    drop boxes on every annotation whose name matches PATTERN (* and ?
+//                        wildcards) instead of the last one or the whole slide
+//   --count N            number of random boxes (1)
+//   --seed N             random seed (1)
+//   --spacing N          minimum gap between random boxes (0)
+//   --min-tissue F       reject random boxes with less tissue than this fraction (0)
+//   --max-overlap F      reject boxes covered by an existing annotation over more than this
+//                        fraction of their area; 0 forbids any overlap (1: off)
+//   --description TEXT   description of the box annotations
+//   --snap N             align boxes to a grid of N pixels, in whole cells (0: off)
+//   --journal N          append boxes to the slide's annotation journal, and write them
+//                        to the session once it holds N boxes (0: write the session directly)
+//   --format EXT         tif, png, bmp, gif, jpg; "none" only updates the sessions (tif)
+//   --dataset PATH       append every box of every slide to the patch dataset with index
+//                        PATH (.bdpatch) instead of saving images; --compression deflate
+//                        compresses its records
+//   --statistics on|off  write the colour statistics, sharpness and background fraction of the
+//                        saved boxes to a CSV table next to them, e.g. slide_roi.stats.csv (on)
+//   --reuse on|off       keep or link the images of boxes saved by an earlier run from unchanged
+//                        files recorded in boxdrop.manifest, instead of saving them again, so an
+//                        interrupted batch resumes where it stopped (on)
+//   --levels N           extra downsampled levels of each TIF (0)
+//   --compression C      none, packbits, lzw, deflate or jpeg compression of TIF tiles (none)
+//   --quality N          quality of JPG images and JPEG-compressed TIF tiles (90)
+//   --encode-threads N   threads compressing the tiles of each box (1)
+//   --output-dir DIR     where images are saved (next to each slide)
+//   --jobs N             slides processed at the same time (number of cores)
+//   --cache-mb N         tile cache per slide, in MB (256)
+//   --prefetch N         tiles read ahead of the export on a background thread; 0: off (32)
+//   --log FILE           append the timings of each slide (CSV, or JSON lines for .json)
+//   --generate PATH W H  write a synthetic W x H slide as a tiled TIFF and exit
+//
+// Slides are read by FileSlide (uncompressed TIFF or PPM). Sessions are the stand-in
+// session files next to each slide.
+
+// System headers
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Plugin headers
+#include "BoxPipeline.h"
+#include "ExportEngine.h"
+#include "ExportManifest.h"
+#include "PatchDataset.h"
+#include "RunProfile.h"
+#include "SessionTransaction.h"
+#include "TiffWriter.h"
+#include "TileCache.h"
+#include "TilePrefetcher.h"
+#include "TileSource.h"
+
+#include "FileSlide.h"
+#include "SyntheticSlide.h"
+
+namespace fs = std::filesystem;
+using namespace sedeen;
+using namespace sedeen::algorithm;
+
+namespace {
+
+struct Options {
+    std::vector<std::string> slides;
+    BoxSpec spec;
+    std::string regionPattern;
+    std::string format = "tif";
+    std::string datasetPath;
+    ///Shared by all the slides when datasetPath is given
+    PatchDataset *dataset = nullptr;
+    bool statistics = true;
+    bool reuse = true;
+    int levels = 0;
+    int journalThreshold = 0;
+    ExportProfile profile;
+    std::string outputDirectory;
+    int jobs = 0;
+    int cacheMegabytes = 256;
+    int prefetchTiles = TilePrefetcher::DefaultLookAhead;
+    std::string logPath;
+};
+
+///Outcome of one slide
+struct SlideResult {
+    bool ok = false;
+    std::string message;
+    int boxes = 0;
+    int saved = 0;
+    ///Saved boxes kept or linked from an earlier run
+    int reused = 0;
+    double seconds = 0.0;
+};
+
+void printUsage() {
+    std::cerr << "Usage: BoxDropBatch [--mode centre|random|lattice] [--stride N] [--regions PATTERN]\n"
+        << "           [--size N] [--count N] [--seed N] [--spacing N] [--min-tissue F] [--max-overlap F]\n"
+        << "           [--description TEXT] [--snap N] [--journal N] [--format EXT|none] [--dataset PATH]\n"
+        << "           [--statistics on|off] [--reuse on|off] [--levels N] [--quality N]\n"
+        << "           [--compression none|packbits|lzw|deflate|jpeg] [--encode-threads N] [--output-dir DIR]\n"
+        << "           [--jobs N] [--cache-mb N] [--prefetch N] [--log FILE] (SLIDE... | --slides LIST)\n"
+        << "       BoxDropBatch --generate PATH WIDTH HEIGHT" << std::endl;
+}//end printUsage
+
+bool readSlideList(const std::string &listPath, std::vector<std::string> &slides) {
+    std::ifstream in(listPath);
+    if (!in) { return false; }
+    std::string line;
+    while (std::getline(in, line)) {
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty() && (line[0] != '#')) { slides.push_back(line); }
+    }
+    return true;
+}//end readSlideList
+
+bool parseArguments(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if ((arg.size() < 2) || (arg.compare(0, 2, "--") != 0)) {
+            options.slides.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (arg == "--slides") {
+                if (!readSlideList(value, options.slides)) {
+                    std::cerr << "Cannot read " << value << std::endl;
+                    return false;
+                }
+            }
+            else if (arg == "--mode") {
+                if ((value != "centre") && (value != "center") && (value != "random") && (value != "lattice")) {
+                    std::cerr << "Unknown mode " << value << std::endl;
+                    return false;
+                }
+                options.spec.randomSampling = (value == "random");
+                options.spec.lattice = (value == "lattice");
+            }
+            else if (arg == "--stride") { options.spec.latticeStride = std::max(0, std::stoi(value)); }
+            else if (arg == "--size") { options.spec.boxSize = std::max(1, std::stoi(value)); }
+            else if (arg == "--count") { options.spec.count = std::max(1, std::stoi(value)); }
+            else if (arg == "--seed") { options.spec.seed = std::stoull(value); }
+            else if (arg == "--spacing") { options.spec.spacing = std::max(0, std::stoi(value)); }
+            else if (arg == "--min-tissue") { options.spec.minTissueFraction = std::stod(value); }
+            else if (arg == "--regions") { options.regionPattern = value; }
+            else if (arg == "--max-overlap") { options.spec.maxOverlapFraction = std::stod(value); }
+            else if (arg == "--description") { options.spec.description = value; }
+            else if (arg == "--snap") { options.spec.snapGrid = std::max(0, std::stoi(value)); }
+            else if (arg == "--journal") { options.journalThreshold = std::max(0, std::stoi(value)); }
+            else if (arg == "--dataset") { options.datasetPath = value; }
+            else if (arg == "--format") {
+                options.format = value;
+                if (!options.format.empty() && (options.format[0] == '.')) { options.format.erase(0, 1); }
+            }
+            else if (arg == "--statistics") {
+                if ((value != "on") && (value != "off")) {
+                    std::cerr << "--statistics must be on or off" << std::endl;
+                    return false;
+                }
+                options.statistics = (value == "on");
+            }
+            else if (arg == "--reuse") {
+                if ((value != "on") && (value != "off")) {
+                    std::cerr << "--reuse must be on or off" << std::endl;
+                    return false;
+                }
+                options.reuse = (value == "on");
+            }
+            else if (arg == "--levels") { options.levels = std::max(0, std::stoi(value)); }
+            else if (arg == "--compression") {
+                const TileCodec::Compression compressions[] = { TileCodec::None, TileCodec::PackBits,
+                    TileCodec::LZW, TileCodec::Deflate, TileCodec::JPEG };
+                bool known = false;
+                for (auto c : compressions) {
+                    std::string name = TileCodec::name(c);
+                    std::transform(name.begin(), name.end(), name.begin(),
+                        [](unsigned char ch) { return static_cast<char>(std::tolower(ch)); });
+                    if (name == value) {
+                        options.profile.compression = c;
+                        known = true;
+                    }
+                }
+                if (!known || !TileCodec::isAvailable(options.profile.compression)) {
+                    std::cerr << "Compression " << value << " is not available" << std::endl;
+                    return false;
+                }
+            }
+            else if (arg == "--quality") { options.profile.jpegQuality = std::max(1, std::min(100, std::stoi(value))); }
+            else if (arg == "--encode-threads") { options.profile.encodeThreads = std::max(1, std::stoi(value)); }
+            else if (arg == "--output-dir") { options.outputDirectory = value; }
+            else if (arg == "--jobs") { options.jobs = std::stoi(value); }
+            else if (arg == "--cache-mb") { options.cacheMegabytes = std::max(16, std::stoi(value)); }
+            else if (arg == "--prefetch") { options.prefetchTiles = std::max(0, std::stoi(value)); }
+            else if (arg == "--log") { options.logPath = value; }
+            else {
+                std::cerr << "Unknown argument " << arg << std::endl;
+                return false;
+            }
+        }
+        catch (const std::exception &) {
+            std::cerr << "Invalid value " << value << " for " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}//end parseArguments
+
+///Write a synthetic slide to a tiled TIFF, so the driver can be tried without real slides
+int generateSlide(const std::string &path, int width, int height) {
+    standalone::SyntheticSlide slide(width, height);
+    TiffWriter writer;
+    const int tileSize = 256;
+    if ((width <= 0) || (height <= 0) || !writer.open(path, width, height, tileSize)) {
+        std::cerr << "Cannot create " << path << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> tile(static_cast<size_t>(tileSize) * tileSize * 3);
+    for (int row = 0; row < writer.tilesDown(); ++row) {
+        for (int column = 0; column < writer.tilesAcross(); ++column) {
+            for (int y = 0; y < tileSize; ++y) {
+                for (int x = 0; x < tileSize; ++x) {
+                    slide.pixel(column * tileSize + x, row * tileSize + y,
+                        tile.data() + (static_cast<size_t>(y) * tileSize + x) * 3);
+                }
+            }
+            writer.writeTile(column, row, tile.data());
+        }
+    }
+    if (!writer.close()) {
+        std::cerr << "Cannot write " << path << std::endl;
+        return 1;
+    }
+    return 0;
+}//end generateSlide
+
+///Drop the boxes on one slide, save the session, and export the boxes: the steps of
+///BoxDrop::run with the parameters taken from options
+SlideResult processSlide(const std::string &slidePath, const Options &options, RunProfile &profile) {
+    SlideResult result;
+    const auto start = std::chrono::steady_clock::now();
+    std::string error;
+    auto slide = standalone::FileSlide::open(slidePath, error);
+    if (!slide) {
+        result.message = error;
+        return result;
+    }
+    const Size imageSize = slide->imageSize();
+    const size_t cacheBytes = static_cast<size_t>(options.cacheMegabytes) << 20;
+    auto source = std::make_shared<TileSource>(slide, imageSize, std::make_shared<TileCache>(cacheBytes));
+    source->setProfile(&profile);
+
+    SessionTransaction session(slidePath);
+    {
+        //A slide without a session file starts with no annotations
+        ScopedStageTimer timer(&profile, RunProfile::SessionLoad);
+        session.load();
+    }
+
+    std::vector<PlacedBox> boxes;
+    AnnotationJournal journal;
+    std::vector<JournalRecord> records;
+    {
+        ScopedStageTimer timer(&profile, RunProfile::BoxPlacement);
+        const BoxRect wholeSlide(0, 0, imageSize.width(), imageSize.height());
+        std::vector<BoxRegion> regions;
+        if (!options.regionPattern.empty()) {
+            regions = regionsMatching(session, options.regionPattern);
+        }
+        else {
+            BoxRegion region{ wholeSlide, AnnotationIndex::npos,
+                options.spec.randomSampling ? "Random Box" : "Box" };
+            //As in the viewer, a centred box or a lattice is dropped on the most recent annotation and takes its name
+            if (!options.spec.randomSampling && !session.graphics().empty()) {
+                const AnnotationKey key = SessionTransaction::keyOf(session.graphics().back());
+                if (!key.bounds.isEmpty()) {
+                    region = BoxRegion{ key.bounds, session.graphics().size() - 1, key.name };
+                }
+            }
+            regions.push_back(region);
+        }
+        std::shared_ptr<TissueMask> mask;
+        if ((options.spec.randomSampling || options.spec.lattice) && (options.spec.minTissueFraction > 0.0)) {
+            mask = buildTissueMask(*source, imageSize);
+        }
+        if (options.journalThreshold > 0) {
+            journal.open(slidePath);
+        }
+        boxes = dropBoxesOnRegions(session, options.spec, regions, mask.get(),
+            (options.journalThreshold > 0) ? &journal : nullptr, records);
+    }
+    result.boxes = static_cast<int>(boxes.size());
+
+    bool sessionSaved = true;
+    {
+        ScopedStageTimer timer(&profile, RunProfile::SessionSave);
+        if (options.journalThreshold > 0) {
+            sessionSaved = journal.append(records);
+            if (sessionSaved && (journal.recordCount() >= static_cast<size_t>(options.journalThreshold))) {
+                sessionSaved = journal.compactInto(session);
+            }
+        }
+        else {
+            sessionSaved = session.commit();
+        }
+    }
+    if (!sessionSaved) {
+        result.message = "cannot save session " + session.sessionFilePath();
+        return result;
+    }
+
+    //Where each box goes: every box to the dataset, or an image per box
+    std::vector<std::string> boxPaths;
+    std::string outputPath = options.datasetPath;
+    if (!options.dataset && (options.format != "none")) {
+        const fs::path slideFile(slidePath);
+        const fs::path directory = options.outputDirectory.empty()
+            ? slideFile.parent_path() : fs::path(options.outputDirectory);
+        outputPath = (directory / (slideFile.stem().string() + "_roi." + options.format)).string();
+    }
+    for (size_t i = 0; (options.dataset || (options.format != "none")) && (i < boxes.size()); ++i) {
+        boxPaths.push_back(options.dataset ? outputPath : numberedFilePath(outputPath, static_cast<int>(i), result.boxes));
+    }
+
+    //Images an unchanged file of an earlier run already holds are kept, or linked to their new
+    //name, instead of saved again, so an interrupted batch resumes where it stopped
+    ExportManifest manifest;
+    const bool reuse = options.reuse && !options.dataset && !boxPaths.empty();
+    if (reuse) { manifest.open(outputPath); }
+    std::vector<std::string> exportKeys(boxPaths.size());
+    std::vector<bool> reused(boxPaths.size(), false);
+    std::vector<std::string> reusedStatistics(boxPaths.size());
+    std::vector<BoxRect> pendingRects;
+    std::vector<std::string> pendingPaths;
+    for (size_t i = 0; i < boxPaths.size(); ++i) {
+        ExportManifest::Entry entry;
+        if (reuse) { exportKeys[i] = exportKey(slidePath, boxes[i].rect, options.levels, boxPaths[i], options.profile); }
+        if (reuse && manifest.find(exportKeys[i], boxPaths[i], entry) && (!options.statistics || !entry.statistics.empty())) {
+            const bool kept = fs::path(entry.path).filename() == fs::path(boxPaths[i]).filename();
+            if (kept || (ExportManifest::linkFile(entry, boxPaths[i]) && manifest.record(exportKeys[i], boxPaths[i], entry.statistics))) {
+                reused[i] = true;
+                reusedStatistics[i] = entry.statistics;
+                ++result.reused;
+                continue;
+            }
+        }
+        pendingRects.push_back(boxes[i].rect);
+        pendingPaths.push_back(boxPaths[i]);
+    }
+    profile.add(RunProfile::BoxesReused, result.reused);
+
+    //Read the tiles of the boxes a bounded distance ahead of the export, on a background thread
+    TilePrefetcher prefetcher(source, options.prefetchTiles);
+    if (!pendingPaths.empty() && (options.prefetchTiles > 0)) {
+        source->setPrefetcher(&prefetcher);
+        prefetcher.start(exportCellPlan(*source, pendingRects, pendingPaths));
+    }
+    //Statistics of the saved boxes, gathered while they are written
+    std::vector<StatisticsRecord> statistics;
+    StatisticsRecord boxStatistics;
+    if (options.dataset) {
+        ScopedStageTimer timer(&profile, RunProfile::Export);
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            const PatchDataset::Record record{ slidePath, boxes[i].rect, boxes[i].name, options.spec.description };
+            boxStatistics = StatisticsRecord{ options.datasetPath, boxes[i].name, boxes[i].rect, BoxStatistics(), std::string() };
+            if (options.dataset->append(*source, record, nullptr, options.statistics ? &boxStatistics.statistics : nullptr)) {
+                ++result.saved;
+                if (options.statistics) { statistics.push_back(boxStatistics); }
+            }
+            else {
+                result.message = "cannot append " + boxes[i].name + " to " + options.datasetPath;
+            }
+        }
+        profile.add(RunProfile::BoxesExported, result.saved);
+        //Slides share the table of the dataset
+        static std::mutex tableMutex;
+        std::lock_guard<std::mutex> lock(tableMutex);
+        const std::string tablePath = statisticsTablePath(options.datasetPath);
+        if (!statistics.empty() && !saveStatisticsTable(tablePath, statistics, true)) {
+            result.message = "cannot write " + tablePath;
+        }
+    }
+    else if (options.format != "none") {
+        ScopedStageTimer timer(&profile, RunProfile::Export);
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            const std::string &boxPath = boxPaths[i];
+            boxStatistics = StatisticsRecord{ boxPath, boxes[i].name, boxes[i].rect, BoxStatistics(), reusedStatistics[i] };
+            if (reused[i]) {
+                ++result.saved;
+                if (options.statistics) { statistics.push_back(boxStatistics); }
+            }
+            else if (exportBoxImage(source, boxes[i].rect, boxPath, options.levels, nullptr, options.profile,
+                options.statistics ? &boxStatistics.statistics : nullptr)) {
+                ++result.saved;
+                if (options.statistics) { statistics.push_back(boxStatistics); }
+                //Recorded only once complete
+                const std::string values = options.statistics ? boxStatistics.statistics.csvValues() : std::string();
+                if (reuse && !manifest.record(exportKeys[i], boxPath, values)) {
+                    result.message = "cannot write " + manifest.filePath();
+                }
+            }
+            else {
+                result.message = "cannot save " + boxPath;
+            }
+        }
+        profile.add(RunProfile::BoxesExported, result.saved - result.reused);
+        const std::string tablePath = statisticsTablePath(outputPath);
+        if (!statistics.empty() && !saveStatisticsTable(tablePath, statistics, false)) {
+            result.message = "cannot write " + tablePath;
+        }
+        const TileCache::Statistics cacheStatistics = source->cache()->statistics();
+        profile.add(RunProfile::CacheHits, static_cast<int64_t>(cacheStatistics.hits));
+        profile.add(RunProfile::CacheMisses, static_cast<int64_t>(cacheStatistics.misses));
+    }
+    prefetcher.stop();
+    source->setPrefetcher(nullptr);
+    profile.add(RunProfile::TilesPrefetched, prefetcher.cellsPrefetched());
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.seconds = elapsed.count();
+    profile.addTime(RunProfile::Total, std::chrono::steady_clock::now() - start);
+    result.ok = result.message.empty();
+    return result;
+}//end processSlide
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if ((argc == 5) && (std::string(argv[1]) == "--generate")) {
+        return generateSlide(argv[2], std::atoi(argv[3]), std::atoi(argv[4]));
+    }
+    Options options;
+    if (!parseArguments(argc, argv, options) || options.slides.empty()) {
+        printUsage();
+        return 2;
+    }
+    if (!options.outputDirectory.empty()) {
+        std::error_code ec;
+        fs::create_directories(options.outputDirectory, ec);
+        if (ec) {
+            std::cerr << "Cannot create " << options.outputDirectory << ": " << ec.message() << std::endl;
+            return 1;
+        }
+    }
+
+    PatchDataset dataset;
+    if (!options.datasetPath.empty()) {
+        const PatchDataset::Encoding encoding = (options.profile.compression == TileCodec::Deflate)
+            ? PatchDataset::Deflate : PatchDataset::Raw;
+        if (!dataset.open(options.datasetPath, encoding)) {
+            std::cerr << "Cannot open the patch dataset " << options.datasetPath << std::endl;
+            return 1;
+        }
+        options.dataset = &dataset;
+    }
+
+    //Slides run in parallel up to the concurrency limit; the boxes of one slide are exported
+    //in order by its worker, which keeps one slide's tiles hot in its own cache
+    std::vector<SlideResult> results(options.slides.size());
+    std::mutex logMutex;
+    bool logFailed = false;
+    auto task = [&](size_t i) {
+        RunProfile profile;
+        results[i] = processSlide(options.slides[i], options, profile);
+        if (!options.logPath.empty()) {
+            std::lock_guard<std::mutex> lock(logMutex);
+            if (!profile.appendToLog(options.logPath, options.slides[i])) { logFailed = true; }
+        }
+        return results[i].ok;
+    };
+    size_t reported = 0;
+    auto progress = [&](size_t done, size_t total) {
+        if ((done != reported) || (done == 0)) {
+            std::cerr << "\rProcessed " << done << " of " << total << " slides" << std::flush;
+            reported = done;
+        }
+        return true;
+    };
+    ExportEngine engine(options.jobs);
+    engine.run(options.slides.size(), task, progress);
+    std::cerr << std::endl;
+
+    int failed = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::cout << (results[i].ok ? "OK     " : "FAILED ") << options.slides[i]
+            << "  boxes=" << results[i].boxes << " saved=" << results[i].saved << " reused=" << results[i].reused
+            << " time=" << std::fixed << std::setprecision(3) << results[i].seconds << "s";
+        if (!results[i].message.empty()) { std::cout << "  " << results[i].message; }
+        std::cout << std::endl;
+        if (!results[i].ok) { ++failed; }
+    }
+    const ExportEngine::Statistics &statistics = engine.statistics();
+    std::cout << results.size() - failed << " of " << results.size() << " slides done in "
+        << std::setprecision(2) << statistics.wallSeconds << " s on " << statistics.threads
+        << " threads (" << statistics.tasksPerSecond() << " slides/s)" << std::endl;
+    if (logFailed) {
+        std::cerr << "cannot append to the log " << options.logPath
+            << ": a CSV log must be new or have the columns of this version" << std::endl;
+    }
+    return (failed == 0) ? 0 : 1;
+}//end main
@@ -0,0 +1,541 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Benchmarks of the BoxDrop hot paths against the SDK stand-ins in sdk/ and a
+// synthetic slide, so they can run on machines without Sedeen Viewer.
+//
+// Usage: BoxDropBenchmark [--annotations 100,1000,10000] [--roi 512,2048,4096]
+//            [--iterations 5] [--decode-us 0] [--threads 1,2,4] [--workdir DIR] [--output FILE]
+//
+// Results are written as JSON to FILE, or to standard output.
+
+// System headers
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Plugin headers
+#include "AnnotationIndex.h"
+#include "BoxExporter.h"
+#include "BoxPipeline.h"
+#include "BoxPlacement.h"
+#include "BoxStatistics.h"
+#include "ExportEngine.h"
+#include "SessionTransaction.h"
+#include "SpatialIndex.h"
+#include "TileCache.h"
+#include "TilePrefetcher.h"
+#include "TileSource.h"
+
+#include "SyntheticSlide.h"
+
+namespace fs = std::filesystem;
+using namespace sedeen;
+using namespace sedeen::algorithm;
+
+namespace {
+
+struct Options {
+    std::vector<int> annotationCounts{ 100, 1000, 10000 };
+    std::vector<int> roiSizes{ 512, 2048, 4096 };
+    int iterations = 5;
+    int decodeMicroseconds = 0;
+    ///Export threads of the parallel export case; 1, 2, 4, ... up to the number of cores if empty
+    std::vector<int> threadCounts;
+    std::string workDirectory;
+    std::string outputPath;
+};
+
+///Timings of one benchmark case, in milliseconds
+struct Result {
+    std::string name;
+    std::vector<std::pair<std::string, double>> parameters;
+    std::vector<double> milliseconds;
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+std::vector<int> parseList(const std::string &text) {
+    std::vector<int> values;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) { values.push_back(std::stoi(item)); }
+    }
+    return values;
+}//end parseList
+
+bool parseArguments(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (arg == "--annotations") { options.annotationCounts = parseList(value); }
+        else if (arg == "--roi") { options.roiSizes = parseList(value); }
+        else if (arg == "--iterations") { options.iterations = std::max(1, std::stoi(value)); }
+        else if (arg == "--decode-us") { options.decodeMicroseconds = std::max(0, std::stoi(value)); }
+        else if (arg == "--threads") { options.threadCounts = parseList(value); }
+        else if (arg == "--workdir") { options.workDirectory = value; }
+        else if (arg == "--output") { options.outputPath = value; }
+        else {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}//end parseArguments
+
+///Time body once per iteration; setup runs before each iteration and is not timed
+Result measure(const std::string &name, int iterations, const std::function<void()> &body,
+    const std::function<void()> &setup = std::function<void()>()) {
+    Result result;
+    result.name = name;
+    for (int i = 0; i < iterations; ++i) {
+        if (setup) { setup(); }
+        auto start = std::chrono::steady_clock::now();
+        body();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        result.milliseconds.push_back(elapsed.count());
+    }
+    return result;
+}//end measure
+
+///A user-drawn rectangle with no description, as the plugin finds it before a run
+GraphicDescription placeholderGraphic(const BoxRect &box) {
+    return makeBoxGraphic(box, "Placeholder", "", GraphicStyle(), nullptr);
+}//end placeholderGraphic
+
+///Write a session for imagePath holding count annotations, the last one a placeholder
+void writeSession(const std::string &imagePath, int count) {
+    std::vector<GraphicDescription> graphics;
+    graphics.reserve(count);
+    for (int i = 0; i < count - 1; ++i) {
+        const BoxRect box((i % 200) * 150, (i / 200) * 150, 100, 100);
+        graphics.push_back(makeBoxGraphic(box, "Annotation " + std::to_string(i),
+            "Benchmark annotation", GraphicStyle(), nullptr));
+    }
+    graphics.push_back(placeholderGraphic(BoxRect(20000, 15000, 400, 300)));
+    Session session(imagePath);
+    session.setGraphics(graphics);
+    session.saveToFile();
+}//end writeSession
+
+///The annotation clean-up run() did before annotations were indexed: copy every
+///graphic, dropping a description-less graphic followed by one of the same name
+std::vector<GraphicDescription> legacyDedup(const std::vector<GraphicDescription> &graphics) {
+    std::vector<GraphicDescription> newGraphics;
+    const size_t numberOfOverlays = graphics.size();
+    size_t i = 0;
+    while (i < numberOfOverlays) {
+        if ((i < numberOfOverlays - 1) && std::string(graphics[i].getDescription()).empty()
+            && (std::strcmp(graphics[i].getName(), graphics[i + 1].getName()) == 0)) {
+            i++;
+        }
+        newGraphics.push_back(graphics[i]);
+        i++;
+    }
+    return newGraphics;
+}//end legacyDedup
+
+///The session part of BoxDrop::buildPipeline in centre-on-region mode
+void buildPipeline(const std::string &imagePath, AnnotationIndex &index, int boxSize) {
+    SessionTransaction session(imagePath, index);
+    session.load();
+    const auto &graphics = session.graphics();
+    if (graphics.empty()) { return; }
+    const GraphicDescription templateGraphic = graphics.back();
+    const AnnotationKey key = SessionTransaction::keyOf(templateGraphic);
+    const BoxRect box = centredBox(key.bounds, boxSize);
+    std::vector<GraphicDescription> boxes;
+    boxes.push_back(makeBoxGraphic(box, key.name, "Benchmark", GraphicStyle(), &templateGraphic));
+    session.addBoxGraphics(boxes, graphics.size() - 1);
+}//end buildPipeline
+
+void benchmarkSessions(const Options &options, const fs::path &workDirectory, std::vector<Result> &results) {
+    for (int count : options.annotationCounts) {
+        if (count < 1) { continue; }
+        const std::string imagePath = (workDirectory / ("slide_" + std::to_string(count) + ".svs")).string();
+        writeSession(imagePath, count);
+        const double annotations = count;
+
+        //Load the session and add the box, rebuilding the annotation index every time
+        Result cold = measure("build_pipeline_cold_index", options.iterations, [&]() {
+            AnnotationIndex index;
+            buildPipeline(imagePath, index, 256);
+        });
+        cold.parameters.emplace_back("annotations", annotations);
+        results.push_back(cold);
+
+        //As the plugin does on repeated runs: the index is reused while the file is unchanged
+        AnnotationIndex sharedIndex;
+        buildPipeline(imagePath, sharedIndex, 256);
+        Result warm = measure("build_pipeline_warm_index", options.iterations, [&]() {
+            buildPipeline(imagePath, sharedIndex, 256);
+        });
+        warm.parameters.emplace_back("annotations", annotations);
+        results.push_back(warm);
+
+        //Clean-up of the placeholder: the old full scan against the indexed replacement
+        SessionTransaction loaded(imagePath);
+        loaded.load();
+        const std::vector<GraphicDescription> graphics = loaded.graphics();
+        Result legacy = measure("dedup_legacy_scan", options.iterations, [&]() {
+            volatile size_t kept = legacyDedup(graphics).size();
+            (void)kept;
+        });
+        legacy.parameters.emplace_back("annotations", annotations);
+        results.push_back(legacy);
+
+        const AnnotationKey placeholderKey = SessionTransaction::keyOf(graphics.back());
+        const std::vector<GraphicDescription> boxes{ makeBoxGraphic(centredBox(placeholderKey.bounds, 256),
+            placeholderKey.name, "Benchmark", GraphicStyle(), &graphics.back()) };
+        std::unique_ptr<SessionTransaction> transaction;
+        Result indexed = measure("dedup_indexed", options.iterations, [&]() {
+            transaction->addBoxGraphics(boxes, graphics.size() - 1);
+        }, [&]() {
+            //Index building belongs to the load, which is measured above
+            transaction = std::make_unique<SessionTransaction>(imagePath, sharedIndex);
+            transaction->load();
+        });
+        indexed.parameters.emplace_back("annotations", annotations);
+        results.push_back(indexed);
+
+        //Write latency of a session with one more annotation each time
+        int added = 0;
+        Result commit = measure("session_commit", options.iterations, [&]() {
+            transaction->commit();
+        }, [&]() {
+            transaction = std::make_unique<SessionTransaction>(imagePath, sharedIndex);
+            transaction->load();
+            transaction->addGraphic(makeBoxGraphic(BoxRect(0, 0, 10, 10 + added++), "Extra", "Benchmark",
+                GraphicStyle(), nullptr));
+        });
+        commit.parameters.emplace_back("annotations", annotations);
+        commit.counters.emplace_back("session_bytes",
+            static_cast<double>(fs::file_size(SessionTransaction::sessionFilePathFor(imagePath))));
+        results.push_back(commit);
+
+        //Placement checks against the spatial index of the annotations, a batch of boxes at a time
+        const int queries = 1000;
+        std::vector<BoxRect> probes;
+        for (int i = 0; i < queries; ++i) {
+            probes.push_back(BoxRect((i * 7919) % 30000, (i * 104729) % 30000, 512, 512));
+        }
+        const SpatialIndex &spatial = loaded.spatialIndex();
+        Result overlap = measure("overlap_query_batch", options.iterations, [&]() {
+            double worst = 0.0;
+            for (const BoxRect &probe : probes) { worst = std::max(worst, spatial.maxOverlapFraction(probe)); }
+            volatile double kept = worst;
+            (void)kept;
+        });
+        overlap.parameters.emplace_back("annotations", annotations);
+        overlap.parameters.emplace_back("queries", queries);
+        results.push_back(overlap);
+        Result nearest = measure("nearest_query_batch", options.iterations, [&]() {
+            size_t found = 0;
+            for (const BoxRect &probe : probes) { found += spatial.nearest(probe, 3).size(); }
+            volatile size_t kept = found;
+            (void)kept;
+        });
+        nearest.parameters.emplace_back("annotations", annotations);
+        nearest.parameters.emplace_back("queries", queries);
+        results.push_back(nearest);
+    }
+}//end benchmarkSessions
+
+void benchmarkExports(const Options &options, const fs::path &workDirectory, std::vector<Result> &results) {
+    const int slideWidth = 40000;
+    const int slideHeight = 30000;
+    for (int roi : options.roiSizes) {
+        if (roi < 1) { continue; }
+        const BoxRect box = centredBox(BoxRect(0, 0, slideWidth, slideHeight), roi);
+        const std::string path = (workDirectory / ("roi_" + std::to_string(roi) + ".tif")).string();
+        const double megabytes = static_cast<double>(box.area()) * 3 / (1024.0 * 1024.0);
+
+        //Without a tile cache every export decodes the region again
+        auto slide = std::make_shared<standalone::SyntheticSlide>(slideWidth, slideHeight, options.decodeMicroseconds);
+        auto source = std::make_shared<TileSource>(slide);
+        Result uncached = measure("export_tiff_uncached", options.iterations, [&]() {
+            BoxExporter exporter(source);
+            exporter.exportTiff(box, path);
+        });
+        uncached.parameters.emplace_back("roi", roi);
+        uncached.counters.emplace_back("megabytes", megabytes);
+        uncached.counters.emplace_back("tiles_decoded", static_cast<double>(slide->tilesDecoded()) / options.iterations);
+        results.push_back(uncached);
+
+        //A new cache per iteration: the first export of a region
+        std::shared_ptr<TileCache> cache;
+        Result cold = measure("export_tiff_cold_cache", options.iterations, [&]() {
+            BoxExporter exporter(std::make_shared<TileSource>(slide, slide->imageSize(), cache));
+            exporter.exportTiff(box, path);
+        }, [&]() {
+            cache = std::make_shared<TileCache>(static_cast<size_t>(1) << 30);
+        });
+        cold.parameters.emplace_back("roi", roi);
+        cold.counters.emplace_back("megabytes", megabytes);
+        results.push_back(cold);
+
+        //The same first export, with the tiles read ahead on another thread while it encodes
+        int64_t prefetched = 0;
+        Result prefetch = measure("export_tiff_prefetch", options.iterations, [&]() {
+            auto prefetchSource = std::make_shared<TileSource>(slide, slide->imageSize(), cache);
+            TilePrefetcher prefetcher(prefetchSource, TilePrefetcher::DefaultLookAhead);
+            prefetchSource->setPrefetcher(&prefetcher);
+            prefetcher.start(exportCellPlan(*prefetchSource, { box }, { path }));
+            BoxExporter exporter(prefetchSource);
+            exporter.exportTiff(box, path);
+            prefetcher.stop();
+            prefetchSource->setPrefetcher(nullptr);
+            prefetched += prefetcher.cellsPrefetched();
+        }, [&]() {
+            cache = std::make_shared<TileCache>(static_cast<size_t>(1) << 30);
+        });
+        prefetch.parameters.emplace_back("roi", roi);
+        prefetch.counters.emplace_back("megabytes", megabytes);
+        prefetch.counters.emplace_back("tiles_prefetched", static_cast<double>(prefetched) / options.iterations);
+        results.push_back(prefetch);
+
+        //One cache for all iterations: re-exporting the same region
+        auto warmSource = std::make_shared<TileSource>(slide, slide->imageSize(),
+            std::make_shared<TileCache>(static_cast<size_t>(1) << 30));
+        BoxExporter(warmSource).exportTiff(box, path);
+        warmSource->cache()->resetCounters();
+        Result warm = measure("export_tiff_warm_cache", options.iterations, [&]() {
+            BoxExporter exporter(warmSource);
+            exporter.exportTiff(box, path);
+        });
+        warm.parameters.emplace_back("roi", roi);
+        warm.counters.emplace_back("megabytes", megabytes);
+        warm.counters.emplace_back("cache_hit_rate", warmSource->cache()->statistics().hitRate());
+        results.push_back(warm);
+
+        //With two extra pyramid levels
+        Result pyramid = measure("export_tiff_pyramid", options.iterations, [&]() {
+            BoxExporter exporter(warmSource);
+            exporter.exportTiff(box, path, 2);
+        });
+        pyramid.parameters.emplace_back("roi", roi);
+        pyramid.counters.emplace_back("megabytes", megabytes);
+        results.push_back(pyramid);
+    }
+}//end benchmarkExports
+
+///Median of the timings of result
+double medianMilliseconds(const Result &result) {
+    std::vector<double> ms = result.milliseconds;
+    std::sort(ms.begin(), ms.end());
+    return (ms.size() % 2) ? ms[ms.size() / 2] : (ms[ms.size() / 2 - 1] + ms[ms.size() / 2]) / 2;
+}//end medianMilliseconds
+
+void benchmarkParallelExports(const Options &options, const fs::path &workDirectory, std::vector<Result> &results) {
+    //Several boxes exported at once by the export pool from one cold cache, as a run of the
+    //plugin does, on one thread and on more. The speedup is measured against one thread.
+    const int slideWidth = 40000;
+    const int slideHeight = 30000;
+    const int boxCount = 8;
+    std::vector<int> threadCounts = options.threadCounts;
+    if (threadCounts.empty()) {
+        for (int t = 1; t < ExportEngine::defaultThreadCount(); t *= 2) { threadCounts.push_back(t); }
+        threadCounts.push_back(ExportEngine::defaultThreadCount());
+    }
+    //Speedups are relative to the first count, normally 1
+    for (int roi : options.roiSizes) {
+        if (roi < 1) { continue; }
+        std::vector<BoxRect> boxes;
+        std::vector<std::string> paths;
+        for (int i = 0; i < boxCount; ++i) {
+            const BoxRect cell((i % 4) * slideWidth / 4, (i / 4) * slideHeight / 2, slideWidth / 4, slideHeight / 2);
+            boxes.push_back(centredBox(cell, roi));
+            paths.push_back((workDirectory / ("boxes_" + std::to_string(i) + ".tif")).string());
+        }
+        auto slide = std::make_shared<standalone::SyntheticSlide>(slideWidth, slideHeight, options.decodeMicroseconds);
+        double singleThreadMilliseconds = 0.0;
+        for (int threads : threadCounts) {
+            std::shared_ptr<TileSource> source;
+            ExportEngine engine(threads);
+            engine.setWaitClock(&TileSource::threadWaitSeconds);
+            double estimated = 0.0;
+            Result result = measure("export_boxes_parallel", options.iterations, [&]() {
+                engine.run(boxes.size(), [&](size_t i) {
+                    return BoxExporter(source).exportTiff(boxes[i], paths[i]);
+                });
+                estimated += engine.statistics().speedup();
+            }, [&]() {
+                source = std::make_shared<TileSource>(slide, slide->imageSize(),
+                    std::make_shared<TileCache>(static_cast<size_t>(1) << 30));
+            });
+            const double median = medianMilliseconds(result);
+            if (singleThreadMilliseconds == 0.0) { singleThreadMilliseconds = median; }
+            result.parameters.emplace_back("roi", roi);
+            result.parameters.emplace_back("threads", threads);
+            result.counters.emplace_back("boxes", boxCount);
+            result.counters.emplace_back("speedup", (median > 0.0) ? singleThreadMilliseconds / median : 0.0);
+            result.counters.emplace_back("estimated_speedup", estimated / options.iterations);
+            results.push_back(result);
+        }
+    }
+}//end benchmarkParallelExports
+
+void benchmarkPreview(const Options &options, std::vector<Result> &results) {
+    //The live preview of a box, read from the coarsest pyramid level that fills 512 pixels
+    const int previewSide = 512;
+    const BoxRect bounds(0, 0, 40000, 30000);
+    for (int roi : { 4096, 16384, 30000 }) {
+        const BoxRect box = centredBox(bounds, roi);
+        auto slide = std::make_shared<standalone::SyntheticSlide>(bounds.width, bounds.height, options.decodeMicroseconds);
+        TileSource source(slide);
+        Result result = measure("preview", options.iterations, [&]() {
+            source.getPreview(box, previewSide);
+        });
+        result.parameters.emplace_back("roi", roi);
+        result.counters.emplace_back("level", TileSource::previewLevel(box, previewSide));
+        result.counters.emplace_back("tiles_decoded", static_cast<double>(slide->tilesDecoded()) / options.iterations);
+        results.push_back(result);
+    }
+}//end benchmarkPreview
+
+void benchmarkStatistics(const Options &options, std::vector<Result> &results) {
+    //The per-box statistics computed during export, over one tile of each roi size read once
+    const standalone::SyntheticSlide slide(40000, 30000);
+    for (int roi : options.roiSizes) {
+        if (roi < 1) { continue; }
+        const BoxRect box = centredBox(BoxRect(0, 0, 40000, 30000), roi);
+        std::vector<uint8_t> pixels(static_cast<size_t>(roi) * roi * 3);
+        for (int y = 0; y < roi; ++y) {
+            for (int x = 0; x < roi; ++x) {
+                slide.pixel(box.x + x, box.y + y, &pixels[(static_cast<size_t>(y) * roi + x) * 3]);
+            }
+        }
+        double sharpness = 0.0;
+        Result result = measure("box_statistics", options.iterations, [&]() {
+            BoxStatistics statistics;
+            statistics.add(pixels.data(), roi, roi, roi);
+            sharpness = statistics.laplacianVariance();
+        });
+        result.parameters.emplace_back("roi", roi);
+        result.counters.emplace_back("megapixels", static_cast<double>(box.area()) / 1e6);
+        result.counters.emplace_back("laplacian_variance", sharpness);
+        results.push_back(result);
+    }
+}//end benchmarkStatistics
+
+void benchmarkPlacement(const Options &options, std::vector<Result> &results) {
+    const BoxRect bounds(0, 0, 40000, 30000);
+    for (int count : { 10, 100, 1000 }) {
+        int64_t candidates = 0;
+        size_t placed = 0;
+        Result result = measure("poisson_placement", options.iterations, [&]() {
+            PoissonBoxSampler sampler(bounds, 256, 64, 12345);
+            placed = sampler.sample(count).size();
+            candidates = sampler.candidatesTested();
+        });
+        result.parameters.emplace_back("boxes", count);
+        result.counters.emplace_back("placed", static_cast<double>(placed));
+        result.counters.emplace_back("candidates", static_cast<double>(candidates));
+        results.push_back(result);
+    }
+}//end benchmarkPlacement
+
+void writePairs(std::ostream &out, const std::vector<std::pair<std::string, double>> &pairs) {
+    out << "{";
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        out << (i ? ", " : "") << "\"" << pairs[i].first << "\": " << pairs[i].second;
+    }
+    out << "}";
+}//end writePairs
+
+void writeJson(std::ostream &out, const Options &options, const std::vector<Result> &results) {
+    out << "{\n  \"iterations\": " << options.iterations
+        << ",\n  \"decode_us_per_tile\": " << options.decodeMicroseconds
+        << ",\n  \"results\": [";
+    for (size_t r = 0; r < results.size(); ++r) {
+        std::vector<double> ms = results[r].milliseconds;
+        std::sort(ms.begin(), ms.end());
+        double sum = 0.0;
+        for (double m : ms) { sum += m; }
+        const double median = medianMilliseconds(results[r]);
+        out << (r ? "," : "") << "\n    {\"name\": \"" << results[r].name << "\", \"parameters\": ";
+        writePairs(out, results[r].parameters);
+        out << ", \"min_ms\": " << ms.front() << ", \"median_ms\": " << median
+            << ", \"mean_ms\": " << sum / ms.size() << ", \"max_ms\": " << ms.back()
+            << ", \"counters\": ";
+        writePairs(out, results[r].counters);
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}//end writeJson
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseArguments(argc, argv, options)) { return 2; }
+    //Work in a new directory inside the one given, so that removing it afterwards
+    //never touches files that were there before
+    const fs::path parentDirectory = options.workDirectory.empty()
+        ? fs::temp_directory_path() : fs::path(options.workDirectory);
+    std::error_code ec;
+    fs::create_directories(parentDirectory, ec);
+    fs::path workDirectory;
+    for (int attempt = 0; !ec; ++attempt) {
+        workDirectory = parentDirectory / ("boxdrop-benchmark-" + std::to_string(attempt));
+        if (fs::create_directory(workDirectory, ec)) { break; }
+    }
+    if (ec) {
+        std::cerr << "Cannot create a directory in " << parentDirectory << ": " << ec.message() << std::endl;
+        return 1;
+    }
+
+    std::vector<Result> results;
+    benchmarkSessions(options, workDirectory, results);
+    benchmarkExports(options, workDirectory, results);
+    benchmarkParallelExports(options, workDirectory, results);
+    benchmarkPreview(options, results);
+    benchmarkStatistics(options, results);
+    benchmarkPlacement(options, results);
+
+    if (options.outputPath.empty()) {
+        writeJson(std::cout, options, results);
+    }
+    else {
+        std::ofstream out(options.outputPath);
+        writeJson(out, options, results);
+        if (!out) {
+            std::cerr << "Cannot write " << options.outputPath << std::endl;
+            return 1;
+        }
+    }
+    fs::remove_all(workDirectory, ec);
+    return 0;
+}//end main
@@ -0,0 +1,841 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Regression tests of the platform-independent parts of BoxDrop, run by ctest.
+//
+// Usage: BoxDropTests [--workdir DIR]
+//
+// Each test prints PASS or FAIL; the exit status is the number of failed tests.
+
+// System headers
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef BOXDROP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// Plugin headers
+#include "AnnotationJournal.h"
+#include "BoxPipeline.h"
+#include "ExportManifest.h"
+#include "JpegEncoder.h"
+#include "RunProfile.h"
+#include "SessionTransaction.h"
+#include "SpatialIndex.h"
+#include "TiffWriter.h"
+#include "TileCodec.h"
+
+namespace fs = std::filesystem;
+using namespace sedeen;
+using namespace sedeen::algorithm;
+
+namespace {
+
+///Failures of the test being run
+std::vector<std::string> g_failures;
+
+void check(bool condition, const std::string &what) {
+    if (!condition) { g_failures.push_back(what); }
+}//end check
+
+uint16_t read16(const std::vector<uint8_t> &buf, size_t at) {
+    return static_cast<uint16_t>(buf[at] | (buf[at + 1] << 8));
+}//end read16
+
+uint32_t read32(const std::vector<uint8_t> &buf, size_t at) {
+    return static_cast<uint32_t>(read16(buf, at)) | (static_cast<uint32_t>(read16(buf, at + 2)) << 16);
+}//end read32
+
+///Return the tags of the first directory of the little-endian classic TIFF at path
+std::vector<uint16_t> readDirectoryTags(const std::string &path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::vector<uint8_t> buf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::vector<uint16_t> tags;
+    if ((buf.size() < 8) || (buf[0] != 'I') || (read16(buf, 2) != 42)) { return tags; }
+    const size_t directory = read32(buf, 4);
+    if (directory + 2 > buf.size()) { return tags; }
+    const uint16_t count = read16(buf, directory);
+    for (uint16_t i = 0; i < count; ++i) {
+        const size_t entry = directory + 2 + static_cast<size_t>(i) * 12;
+        if (entry + 12 > buf.size()) { break; }
+        tags.push_back(read16(buf, entry));
+    }
+    return tags;
+}//end readDirectoryTags
+
+///The directory written by TiffWriter must list each tag once, in ascending order
+void testTiffDirectoryTags(const fs::path &workDirectory) {
+    const TileCodec::Compression schemes[] = { TileCodec::None, TileCodec::LZW,
+        TileCodec::JPEG, TileCodec::Deflate, TileCodec::PackBits };
+    const int tileSize = 64;
+    for (auto compression : schemes) {
+        if (!TileCodec::isAvailable(compression)) { continue; }
+        for (int channels : { 1, 3 }) {
+            const std::string label = std::string(TileCodec::name(compression))
+                + " x" + std::to_string(channels);
+            const std::string path = (workDirectory / ("tags_" + std::to_string(compression)
+                + "_" + std::to_string(channels) + ".tif")).string();
+            TiffWriter writer;
+            const int width = 100, height = 70;
+            if (!writer.open(path, width, height, tileSize, channels, TileCodec(compression))) {
+                check(false, label + ": open");
+                continue;
+            }
+            std::vector<uint8_t> tile(static_cast<size_t>(tileSize) * tileSize * channels);
+            for (size_t i = 0; i < tile.size(); ++i) { tile[i] = static_cast<uint8_t>(i * 7); }
+            for (int row = 0; row < writer.tilesDown(); ++row) {
+                for (int column = 0; column < writer.tilesAcross(); ++column) {
+                    writer.writeTile(column, row, tile.data());
+                }
+            }
+            check(writer.close(), label + ": close");
+
+            const std::vector<uint16_t> tags = readDirectoryTags(path);
+            check(tags.size() >= 10, label + ": directory has " + std::to_string(tags.size()) + " tags");
+            for (size_t i = 1; i < tags.size(); ++i) {
+                check(tags[i - 1] < tags[i], label + ": tag " + std::to_string(tags[i])
+                    + " follows " + std::to_string(tags[i - 1]));
+            }
+            fs::remove(path);
+        }
+    }
+}//end testTiffDirectoryTags
+
+///Decode TIFF LZW (codes most significant bit first, widened one code early) into out
+bool decodeLZW(const std::vector<uint8_t> &in, std::vector<uint8_t> &out) {
+    out.clear();
+    std::vector<std::vector<uint8_t>> table;
+    auto reset = [&]() {
+        table.assign(258, std::vector<uint8_t>());
+        for (int i = 0; i < 256; ++i) { table[i].assign(1, static_cast<uint8_t>(i)); }
+    };
+    reset();
+    int bits = 9;
+    size_t bitPosition = 0;
+    auto next = [&](int &code) {
+        if (bitPosition + bits > in.size() * 8) { return false; }
+        code = 0;
+        for (int b = 0; b < bits; ++b, ++bitPosition) {
+            code = (code << 1) | ((in[bitPosition / 8] >> (7 - bitPosition % 8)) & 1);
+        }
+        return true;
+    };
+    int code = 0;
+    int previous = -1;
+    while (next(code)) {
+        if (code == 257) { return true; }
+        if (code == 256) {
+            reset();
+            bits = 9;
+            previous = -1;
+            continue;
+        }
+        std::vector<uint8_t> entry;
+        if (code < static_cast<int>(table.size())) {
+            entry = table[code];
+        }
+        else if ((code == static_cast<int>(table.size())) && (previous >= 0)) {
+            entry = table[previous];
+            entry.push_back(table[previous][0]);
+        }
+        else {
+            return false;
+        }
+        out.insert(out.end(), entry.begin(), entry.end());
+        if (previous >= 0) {
+            std::vector<uint8_t> added = table[previous];
+            added.push_back(entry[0]);
+            table.push_back(added);
+            if ((static_cast<int>(table.size()) + 1 >= (1 << bits)) && (bits < 12)) { ++bits; }
+        }
+        previous = code;
+    }
+    return false;
+}//end decodeLZW
+
+///Decode PackBits into out
+bool decodePackBits(const std::vector<uint8_t> &in, std::vector<uint8_t> &out) {
+    out.clear();
+    for (size_t i = 0; i < in.size(); ) {
+        const int n = static_cast<int8_t>(in[i++]);
+        if (n >= 0) {
+            if (i + n + 1 > in.size()) { return false; }
+            out.insert(out.end(), in.begin() + i, in.begin() + i + n + 1);
+            i += n + 1;
+        }
+        else if (n != -128) {
+            if (i >= in.size()) { return false; }
+            out.insert(out.end(), static_cast<size_t>(1 - n), in[i++]);
+        }
+    }
+    return true;
+}//end decodePackBits
+
+///Decode a tile of width x height pixels compressed by a lossless TileCodec into out
+bool decodeLossless(TileCodec::Compression compression, const std::vector<uint8_t> &in,
+    int width, int height, int channels, std::vector<uint8_t> &out) {
+    const size_t rowBytes = static_cast<size_t>(width) * channels;
+    switch (compression) {
+    case TileCodec::None:
+        out = in;
+        break;
+    case TileCodec::PackBits:
+        if (!decodePackBits(in, out)) { return false; }
+        break;
+    case TileCodec::LZW:
+        if (!decodeLZW(in, out)) { return false; }
+        break;
+    case TileCodec::Deflate: {
+#ifdef BOXDROP_HAVE_ZLIB
+        uLongf length = static_cast<uLongf>(rowBytes * height);
+        out.resize(length);
+        if ((uncompress(out.data(), &length, in.data(), static_cast<uLong>(in.size())) != Z_OK)
+            || (length != out.size())) {
+            return false;
+        }
+        break;
+#else
+        return false;
+#endif
+    }
+    default:
+        return false;
+    }
+    if (out.size() != rowBytes * height) { return false; }
+    //Undo the horizontal differencing of TIFF Predictor 2
+    if (TileCodec(compression).usesPredictor()) {
+        for (int y = 0; y < height; ++y) {
+            uint8_t *row = out.data() + y * rowBytes;
+            for (size_t i = channels; i < rowBytes; ++i) {
+                row[i] = static_cast<uint8_t>(row[i] + row[i - channels]);
+            }
+        }
+    }
+    return true;
+}//end decodeLossless
+
+///Baseline JPEG decoder, enough to read back what JpegEncoder writes: one scan, 8-bit samples,
+///Huffman tables and restart intervals, greyscale or YCbCr with any sampling
+class JpegDecoder {
+public:
+    ///Decode the JPEG stream in into RGB or grey pixels; returns false if it is not understood
+    bool decode(const std::vector<uint8_t> &in, std::vector<uint8_t> &pixels, int &width, int &height, int &channels) {
+        m_in = &in;
+        size_t at = 2;
+        if ((in.size() < 4) || (in[0] != 0xFF) || (in[1] != 0xD8)) { return false; }
+        int restartInterval = 0;
+        while (at + 4 <= in.size()) {
+            if (in[at] != 0xFF) { return false; }
+            const int marker = in[at + 1];
+            const size_t length = (static_cast<size_t>(in[at + 2]) << 8) | in[at + 3];
+            const size_t body = at + 4;
+            if (body + length - 2 > in.size()) { return false; }
+            if (marker == 0xDB) {
+                for (size_t p = body; p < body + length - 2; p += 65) {
+                    for (int k = 0; k < 64; ++k) { m_quant[in[p] & 3][k] = in[p + 1 + k]; }
+                }
+            }
+            else if (marker == 0xC0) {
+                height = (in[body + 1] << 8) | in[body + 2];
+                width = (in[body + 3] << 8) | in[body + 4];
+                m_components.assign(in[body + 5], Component());
+                for (size_t c = 0; c < m_components.size(); ++c) {
+                    m_components[c].h = in[body + 7 + 3 * c] >> 4;
+                    m_components[c].v = in[body + 7 + 3 * c] & 15;
+                    m_components[c].quant = in[body + 8 + 3 * c] & 3;
+                }
+            }
+            else if (marker == 0xC4) {
+                for (size_t p = body; p < body + length - 2; ) {
+                    Huffman &table = (in[p] >> 4) ? m_ac[in[p] & 3] : m_dc[in[p] & 3];
+                    int total = 0;
+                    for (int l = 0; l < 16; ++l) { table.counts[l] = in[p + 1 + l]; total += in[p + 1 + l]; }
+                    table.symbols.assign(in.begin() + p + 17, in.begin() + p + 17 + total);
+                    p += 17 + total;
+                }
+            }
+            else if (marker == 0xDD) {
+                restartInterval = (in[body] << 8) | in[body + 1];
+            }
+            else if (marker == 0xDA) {
+                for (int c = 0; c < in[body]; ++c) {
+                    m_components[c].dcTable = in[body + 2 + 2 * c] >> 4;
+                    m_components[c].acTable = in[body + 2 + 2 * c] & 15;
+                }
+                m_position = body + length - 2;
+                return decodeScan(restartInterval, pixels, width, height, channels);
+            }
+            at = body + length - 2;
+        }
+        return false;
+    }
+
+private:
+    struct Component {
+        int h = 1, v = 1, quant = 0, dcTable = 0, acTable = 0, previousDC = 0;
+        int planeWidth = 0;
+        std::vector<float> plane;
+    };
+    struct Huffman {
+        int counts[16] = {};
+        std::vector<uint8_t> symbols;
+    };
+
+    int bit() {
+        if (m_bitCount == 0) {
+            if (m_position >= m_in->size()) { throw std::runtime_error("end of data"); }
+            m_byte = (*m_in)[m_position++];
+            //A zero byte is stuffed after every 0xFF of the data
+            if (m_byte == 0xFF) {
+                if ((m_position >= m_in->size()) || ((*m_in)[m_position] != 0)) { throw std::runtime_error("marker"); }
+                ++m_position;
+            }
+            m_bitCount = 8;
+        }
+        return (m_byte >> --m_bitCount) & 1;
+    }
+
+    int receive(int bits) {
+        int value = 0;
+        for (int b = 0; b < bits; ++b) { value = (value << 1) | bit(); }
+        return value;
+    }
+
+    ///Value of a coefficient of bits bits, as JPEG codes negative values
+    int extend(int value, int bits) {
+        return (bits == 0) ? 0 : ((value < (1 << (bits - 1))) ? value - (1 << bits) + 1 : value);
+    }
+
+    int decodeSymbol(const Huffman &table) {
+        int code = 0, first = 0, index = 0;
+        for (int l = 0; l < 16; ++l) {
+            code |= bit();
+            if (code - first < table.counts[l]) { return table.symbols[index + code - first]; }
+            index += table.counts[l];
+            first = (first + table.counts[l]) << 1;
+            code <<= 1;
+        }
+        throw std::runtime_error("bad Huffman code");
+    }
+
+    void decodeBlock(Component &component, float *out, int stride) {
+        static const int zigzag[64] = { 0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+            12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36,
+            29, 22, 15, 23, 30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+        float coefficients[64] = {};
+        const uint8_t *quant = m_quant[component.quant];
+        const int t = decodeSymbol(m_dc[component.dcTable]);
+        component.previousDC += extend(receive(t), t);
+        coefficients[0] = static_cast<float>(component.previousDC * quant[0]);
+        for (int k = 1; k < 64; ) {
+            const int rs = decodeSymbol(m_ac[component.acTable]);
+            const int run = rs >> 4, size = rs & 15;
+            if (size == 0) {
+                if (run != 15) { break; }
+                k += 16;
+                continue;
+            }
+            k += run;
+            if (k > 63) { throw std::runtime_error("coefficient past the block"); }
+            coefficients[zigzag[k]] = static_cast<float>(extend(receive(size), size) * quant[k]);
+            ++k;
+        }
+        //Naive inverse DCT
+        const double pi = 3.14159265358979323846;
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x) {
+                double sum = 0.0;
+                for (int v = 0; v < 8; ++v) {
+                    for (int u = 0; u < 8; ++u) {
+                        sum += (u ? 1.0 : std::sqrt(0.5)) * (v ? 1.0 : std::sqrt(0.5)) * coefficients[v * 8 + u]
+                            * std::cos((2 * x + 1) * u * pi / 16) * std::cos((2 * y + 1) * v * pi / 16);
+                    }
+                }
+                out[y * stride + x] = static_cast<float>(sum / 4 + 128.0);
+            }
+        }
+    }
+
+    bool decodeScan(int restartInterval, std::vector<uint8_t> &pixels, int width, int height, int &channels) {
+        int hMax = 1, vMax = 1;
+        for (auto &c : m_components) { hMax = std::max(hMax, c.h); vMax = std::max(vMax, c.v); }
+        const int mcusAcross = (width + 8 * hMax - 1) / (8 * hMax);
+        const int mcusDown = (height + 8 * vMax - 1) / (8 * vMax);
+        for (auto &c : m_components) {
+            c.planeWidth = mcusAcross * c.h * 8;
+            c.plane.assign(static_cast<size_t>(c.planeWidth) * mcusDown * c.v * 8, 0.0f);
+            c.previousDC = 0;
+        }
+        try {
+            for (int mcu = 0; mcu < mcusAcross * mcusDown; ++mcu) {
+                if ((restartInterval > 0) && (mcu > 0) && (mcu % restartInterval == 0)) {
+                    //Byte-aligned RSTn marker, after which the DC predictions start again
+                    m_bitCount = 0;
+                    if ((m_position + 2 > m_in->size()) || ((*m_in)[m_position] != 0xFF)
+                        || ((*m_in)[m_position + 1] != 0xD0 + (mcu / restartInterval - 1) % 8)) {
+                        return false;
+                    }
+                    m_position += 2;
+                    for (auto &c : m_components) { c.previousDC = 0; }
+                }
+                const int mx = mcu % mcusAcross, my = mcu / mcusAcross;
+                for (auto &c : m_components) {
+                    for (int v = 0; v < c.v; ++v) {
+                        for (int h = 0; h < c.h; ++h) {
+                            const size_t x = (static_cast<size_t>(mx) * c.h + h) * 8;
+                            const size_t y = (static_cast<size_t>(my) * c.v + v) * 8;
+                            decodeBlock(c, c.plane.data() + y * c.planeWidth + x, c.planeWidth);
+                        }
+                    }
+                }
+            }
+        }
+        catch (const std::exception &) {
+            return false;
+        }
+        channels = (m_components.size() == 3) ? 3 : 1;
+        pixels.resize(static_cast<size_t>(width) * height * channels);
+        auto clamp = [](double value) { return static_cast<uint8_t>(std::max(0.0, std::min(255.0, std::round(value)))); };
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                double sample[3] = {};
+                for (size_t c = 0; c < m_components.size() && c < 3; ++c) {
+                    const Component &component = m_components[c];
+                    sample[c] = component.plane[static_cast<size_t>(y * component.v / vMax) * component.planeWidth
+                        + x * component.h / hMax];
+                }
+                uint8_t *out = pixels.data() + (static_cast<size_t>(y) * width + x) * channels;
+                if (channels == 1) {
+                    out[0] = clamp(sample[0]);
+                    continue;
+                }
+                out[0] = clamp(sample[0] + 1.402 * (sample[2] - 128));
+                out[1] = clamp(sample[0] - 0.344136 * (sample[1] - 128) - 0.714136 * (sample[2] - 128));
+                out[2] = clamp(sample[0] + 1.772 * (sample[1] - 128));
+            }
+        }
+        return true;
+    }
+
+private:
+    const std::vector<uint8_t> *m_in = nullptr;
+    size_t m_position = 0;
+    int m_byte = 0;
+    int m_bitCount = 0;
+    uint8_t m_quant[4][64] = {};
+    Huffman m_dc[4], m_ac[4];
+    std::vector<Component> m_components;
+};
+
+///A tile with smooth gradients, flat areas and fine texture, so that every kind of run and code is used
+std::vector<uint8_t> testTile(int width, int height, int channels) {
+    std::vector<uint8_t> tile(static_cast<size_t>(width) * height * channels);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                uint8_t value = static_cast<uint8_t>(x * 2 + y + 40 * c);
+                if (y >= height / 2) { value = (x < width / 2) ? 200 : static_cast<uint8_t>((x * 37 + y * 11) % 7 + 120 + c); }
+                tile[(static_cast<size_t>(y) * width + x) * channels + c] = value;
+            }
+        }
+    }
+    return tile;
+}//end testTile
+
+///Mean absolute difference between two equally sized pixel buffers
+double meanError(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+    if (a.size() != b.size() || a.empty()) { return 1e9; }
+    double sum = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) { sum += std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i])); }
+    return sum / a.size();
+}//end meanError
+
+///Every lossless TileCodec gives back the exact tile; JPEG comes close
+void testCodecRoundTrip(const fs::path &) {
+    const TileCodec::Compression lossless[] = { TileCodec::None, TileCodec::LZW,
+        TileCodec::Deflate, TileCodec::PackBits };
+    //The larger tile fills the LZW table, so the encoder has to clear it and start again
+    for (int size : { 16, 64, 512 }) {
+        for (int channels : { 1, 3 }) {
+            const std::vector<uint8_t> tile = testTile(size, size, channels);
+            for (auto compression : lossless) {
+                if (!TileCodec::isAvailable(compression)) { continue; }
+                const std::string label = std::string(TileCodec::name(compression)) + " "
+                    + std::to_string(size) + " x" + std::to_string(channels);
+                std::vector<uint8_t> encoded, decoded;
+                check(TileCodec(compression).encode(tile.data(), size, size, channels, encoded), label + ": encode");
+                check(decodeLossless(compression, encoded, size, size, channels, decoded), label + ": decode");
+                check(decoded == tile, label + ": decoded tile differs");
+            }
+            std::vector<uint8_t> encoded, decoded;
+            check(TileCodec(TileCodec::JPEG, 90).encode(tile.data(), size, size, channels, encoded), "JPEG: encode");
+            int width = 0, height = 0, decodedChannels = 0;
+            JpegDecoder decoder;
+            const std::string label = "JPEG " + std::to_string(size) + " x" + std::to_string(channels);
+            check(decoder.decode(encoded, decoded, width, height, decodedChannels), label + ": decode");
+            check((width == size) && (height == size) && (decodedChannels == channels), label + ": size");
+            const double error = meanError(decoded, tile);
+            check(error < 4.0, label + ": mean error " + std::to_string(error));
+        }
+    }
+
+    //Strips encoded as restart segments and joined, as a JPEG export does
+    const int width = 200, height = 72, stripRows = 16;
+    const std::vector<uint8_t> image = testTile(width, height, 3);
+    const JpegEncoder encoder(90, 3);
+    std::vector<uint8_t> stream;
+    encoder.writeHeader(width, height, ((width + 15) / 16) * (stripRows / 16), stream);
+    for (int top = 0, segment = 0; top < height; top += stripRows, ++segment) {
+        if (segment > 0) { JpegEncoder::writeRestartMarker(segment - 1, stream); }
+        encoder.encodeSegment(image.data() + static_cast<size_t>(top) * width * 3, width,
+            std::min(stripRows, height - top), width, stream);
+    }
+    JpegEncoder::writeEnd(stream);
+    std::vector<uint8_t> decoded;
+    int decodedWidth = 0, decodedHeight = 0, channels = 0;
+    JpegDecoder decoder;
+    check(decoder.decode(stream, decoded, decodedWidth, decodedHeight, channels), "JPEG strips: decode");
+    check((decodedWidth == width) && (decodedHeight == height), "JPEG strips: size");
+    const double error = meanError(decoded, image);
+    check(error < 4.0, "JPEG strips: mean error " + std::to_string(error));
+}//end testCodecRoundTrip
+
+///Distance between the closest points of two boxes, as SpatialIndex::nearest measures it
+double boxGap(const BoxRect &a, const BoxRect &b) {
+    const double dx = std::max(0, std::max(b.x - a.right(), a.x - b.right()));
+    const double dy = std::max(0, std::max(b.y - a.bottom(), a.y - b.bottom()));
+    return std::sqrt(dx * dx + dy * dy);
+}//end boxGap
+
+///The packed Hilbert R-tree answers every query as a scan of all the boxes does, through
+///bulk loads, inserts that repack it and erasures that leave dead entries behind
+void testSpatialIndexQueries(const fs::path &) {
+    for (unsigned trial = 0; trial < 20; ++trial) {
+        std::mt19937 random(trial);
+        auto uniform = [&](int low, int high) { return std::uniform_int_distribution<int>(low, high)(random); };
+        //Small extents in some trials, so that boxes pile up on each other
+        const int extent = (trial % 2) ? 4000 : 60000;
+        auto randomBox = [&]() {
+            return BoxRect(uniform(0, extent), uniform(0, extent), uniform(1, 600), uniform(1, 600));
+        };
+        SpatialIndex index;
+        std::vector<std::pair<BoxRect, size_t>> boxes;
+        size_t nextId = 0;
+        const int bulk = uniform(0, 600);
+        for (int i = 0; i < bulk; ++i) {
+            boxes.push_back(std::make_pair(randomBox(), nextId++));
+            index.append(boxes.back().first, boxes.back().second);
+        }
+        if (trial % 3 != 0) { index.pack(); }
+        const int operations = uniform(300, 1500);
+        for (int i = 0; i < operations; ++i) {
+            const int what = uniform(0, 9);
+            if ((what < 3) && !boxes.empty()) {
+                const size_t victim = static_cast<size_t>(uniform(0, static_cast<int>(boxes.size()) - 1));
+                index.erase(boxes[victim].first, boxes[victim].second);
+                boxes.erase(boxes.begin() + victim);
+            }
+            else if (what < 4) {
+                boxes.push_back(std::make_pair(randomBox(), nextId++));
+                index.append(boxes.back().first, boxes.back().second);
+            }
+            else {
+                boxes.push_back(std::make_pair(randomBox(), nextId++));
+                index.insert(boxes.back().first, boxes.back().second);
+            }
+        }
+        const std::string label = "trial " + std::to_string(trial) + ": ";
+        check(index.size() == boxes.size(), label + "size");
+
+        for (int q = 0; q < 50; ++q) {
+            const BoxRect query = randomBox();
+            const size_t ignoreId = (q % 2 && !boxes.empty()) ? boxes[q % boxes.size()].second : SpatialIndex::npos;
+            std::vector<size_t> expectOverlapping, expectContaining, expectWithin;
+            int64_t largest = 0;
+            std::vector<std::pair<double, size_t>> gaps;
+            for (auto it = boxes.begin(); it != boxes.end(); ++it) {
+                const BoxRect &b = it->first;
+                if (boxesIntersect(b, query)) { expectOverlapping.push_back(it->second); }
+                if ((b.x <= query.x) && (b.y <= query.y) && (b.right() >= query.right()) && (b.bottom() >= query.bottom())) {
+                    expectContaining.push_back(it->second);
+                }
+                if ((b.x >= query.x) && (b.y >= query.y) && (b.right() <= query.right()) && (b.bottom() <= query.bottom())) {
+                    expectWithin.push_back(it->second);
+                }
+                if (it->second != ignoreId) {
+                    largest = std::max(largest, intersectionArea(query, b));
+                    gaps.push_back(std::make_pair(boxGap(query, b), it->second));
+                }
+            }
+            std::vector<size_t> ids;
+            auto same = [&](std::vector<size_t> expected, const char *what) {
+                std::sort(ids.begin(), ids.end());
+                std::sort(expected.begin(), expected.end());
+                check(ids == expected, label + what);
+                ids.clear();
+            };
+            index.overlapping(query, ids);
+            same(expectOverlapping, "overlapping");
+            index.containing(query, ids);
+            same(expectContaining, "containing");
+            index.within(query, ids);
+            same(expectWithin, "within");
+
+            const double fraction = static_cast<double>(largest) / query.area();
+            check(index.maxOverlapFraction(query, ignoreId) == fraction, label + "maxOverlapFraction");
+
+            //Boxes at equal distances may come in any order, so the distances are compared
+            const int count = uniform(1, 12);
+            std::sort(gaps.begin(), gaps.end());
+            const std::vector<SpatialIndex::Neighbour> found = index.nearest(query, count, ignoreId);
+            check(found.size() == std::min<size_t>(count, gaps.size()), label + "nearest count");
+            std::vector<size_t> foundIds;
+            for (size_t i = 0; (i < found.size()) && (i < gaps.size()); ++i) {
+                check(std::abs(found[i].distance - gaps[i].first) < 1e-9, label + "nearest distance");
+                check(std::abs(found[i].distance - boxGap(query, found[i].box)) < 1e-9, label + "nearest box");
+                foundIds.push_back(found[i].id);
+            }
+            std::sort(foundIds.begin(), foundIds.end());
+            check(std::unique(foundIds.begin(), foundIds.end()) == foundIds.end(), label + "nearest repeats a box");
+            check(std::find(foundIds.begin(), foundIds.end(), ignoreId) == foundIds.end(), label + "nearest ignoreId");
+        }
+    }
+}//end testSpatialIndexQueries
+
+///Drop boxes on the slide at slidePath as a batch run does, with the given description, and
+///save them to its session, through the journal if useJournal is set. Returns the session writes.
+int dropAndSave(const std::string &slidePath, BoxSpec spec, const std::string &description, bool useJournal) {
+    spec.description = description;
+    SessionTransaction session(slidePath);
+    session.load();
+    //A centred box is dropped on the most recent annotation and takes its name
+    BoxRegion region{ BoxRect(0, 0, 4000, 3000), AnnotationIndex::npos, "Random Box" };
+    if (!spec.randomSampling && !session.graphics().empty()) {
+        const AnnotationKey key = SessionTransaction::keyOf(session.graphics().back());
+        region = BoxRegion{ key.bounds, session.graphics().size() - 1, key.name };
+    }
+    AnnotationJournal journal;
+    journal.open(slidePath);
+    std::vector<JournalRecord> records;
+    dropBoxesOnRegions(session, spec, std::vector<BoxRegion>(1, region), nullptr,
+        useJournal ? &journal : nullptr, records);
+    bool saved = true;
+    if (useJournal) {
+        saved = journal.append(records) && journal.compactInto(session);
+    }
+    else {
+        saved = session.commit();
+    }
+    check(saved, "session of " + slidePath + " saved");
+    return session.writeCount();
+}//end dropAndSave
+
+///Running the same placement again with a new description rewrites the annotations in place
+void testRerunWithNewDescription(const fs::path &workDirectory) {
+    for (bool useJournal : { false, true }) {
+        for (bool random : { false, true }) {
+            const std::string label = std::string(random ? "random" : "centred")
+                + (useJournal ? ", journal" : ", session");
+            const std::string slidePath = (workDirectory / ("rerun_" + std::to_string(random)
+                + std::to_string(useJournal) + ".tif")).string();
+            BoxSpec spec;
+            spec.randomSampling = random;
+            spec.count = 2;
+            spec.seed = 7;
+            spec.boxSize = 256;
+            if (!random) {
+                //A placeholder drawn by the user, with no description
+                SessionTransaction session(slidePath);
+                session.load();
+                session.addGraphic(makeBoxGraphic(BoxRect(1000, 1000, 600, 400), "ROI", "", GraphicStyle(), nullptr));
+                session.commit();
+            }
+
+            check(dropAndSave(slidePath, spec, "A", useJournal) == 1, label + ": first run writes the session");
+            check(dropAndSave(slidePath, spec, "B", useJournal) == 1, label + ": new description writes the session");
+            check(dropAndSave(slidePath, spec, "B", useJournal) == 0, label + ": same description leaves the session");
+
+            SessionTransaction session(slidePath);
+            session.load();
+            const size_t expected = random ? 2 : 1;
+            check(session.graphics().size() == expected, label + ": " + std::to_string(session.graphics().size())
+                + " annotations, expected " + std::to_string(expected));
+            for (auto it = session.graphics().begin(); it != session.graphics().end(); ++it) {
+                check(std::string(it->getDescription()) == "B", label + ": " + it->getName()
+                    + " still described as \"" + it->getDescription() + "\"");
+            }
+            fs::remove(SessionTransaction::sessionFilePathFor(slidePath));
+            fs::remove(AnnotationJournal::journalFilePathFor(slidePath));
+        }
+    }
+}//end testRerunWithNewDescription
+
+///Append text to the file at path without a newline, as an interrupted write leaves it
+void appendFragment(const fs::path &path, const std::string &text) {
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    out << text;
+}//end appendFragment
+
+///Records appended after an interrupted append are kept whole
+void testJournalTornTail(const fs::path &workDirectory) {
+    const std::string slidePath = (workDirectory / "journal.tif").string();
+    AnnotationJournal journal;
+    journal.open(slidePath);
+    JournalRecord record;
+    record.box = BoxRect(100, 200, 256, 256);
+    record.name = "Box 1";
+    record.description = "first";
+    check(journal.append(std::vector<JournalRecord>(1, record)), "first record appended");
+    //Only the start of the x field of the next record reached the disk
+    appendFragment(journal.filePath(), "12");
+    record.box = BoxRect(300, 400, 256, 256);
+    record.name = "Box 2";
+    record.description = "second";
+    check(journal.append(std::vector<JournalRecord>(1, record)), "record appended after the fragment");
+
+    std::vector<JournalRecord> records;
+    journal.read(records);
+    check(records.size() == 2, std::to_string(records.size()) + " records read, expected 2");
+    if (records.size() == 2) {
+        check((records[1].name == "Box 2") && (records[1].box.x == 300), "second record read as written, x "
+            + std::to_string(records[1].box.x));
+    }
+    check(journal.recordCount() == 2, "journal counts 2 records");
+    journal.clear();
+}//end testJournalTornTail
+
+///Entries recorded after an interrupted write are found by the next run
+void testManifestTornTail(const fs::path &workDirectory) {
+    const fs::path first = workDirectory / "manifest_1.tif";
+    const fs::path second = workDirectory / "manifest_2.tif";
+    for (const fs::path &path : { first, second }) {
+        std::ofstream out(path, std::ios::binary);
+        out << path.filename().string();
+    }
+    {
+        ExportManifest manifest;
+        manifest.open(first.string());
+        check(manifest.record("key1", first.string(), ""), "first entry recorded");
+        appendFragment(ExportManifest::manifestFilePathFor(first.string()), "key");
+        check(manifest.record("key2", second.string(), ""), "entry recorded after the fragment");
+    }
+    //The next run reads the manifest afresh
+    ExportManifest manifest;
+    manifest.open(first.string());
+    ExportManifest::Entry entry;
+    check(manifest.find("key1", first.string(), entry), "first entry found");
+    check(manifest.find("key2", second.string(), entry), "entry recorded after the fragment found");
+    fs::remove(ExportManifest::manifestFilePathFor(first.string()));
+    fs::remove(first);
+    fs::remove(second);
+}//end testManifestTornTail
+
+///Rows are appended to a CSV timing log only under a header with the same columns
+void testTimingLogColumns(const fs::path &workDirectory) {
+    RunProfile profile;
+    profile.add(RunProfile::BoxesExported, 3);
+    auto lineCount = [](const fs::path &path) {
+        std::ifstream in(path);
+        int lines = 0;
+        for (std::string line; std::getline(in, line); ) { ++lines; }
+        return lines;
+    };
+
+    const fs::path current = workDirectory / "timings.csv";
+    check(profile.appendToLog(current.string(), "a.tif"), "new log written");
+    check(profile.appendToLog(current.string(), "b.tif"), "row appended to a log with the same columns");
+    check(lineCount(current) == 3, "new log has a header and two rows");
+
+    //A log of a version that had fewer counters
+    const fs::path older = workDirectory / "older.csv";
+    {
+        std::ofstream out(older);
+        out << "image,total_s,bytes_written\n" << "a.tif,1.0,100\n";
+    }
+    check(!profile.appendToLog(older.string(), "b.tif"), "row refused by a log with other columns");
+    check(lineCount(older) == 2, "log with other columns left unchanged");
+    fs::remove(current);
+    fs::remove(older);
+}//end testTimingLogColumns
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    fs::path workDirectory;
+    for (int i = 1; i < argc; ++i) {
+        if ((std::strcmp(argv[i], "--workdir") == 0) && (i + 1 < argc)) {
+            workDirectory = argv[++i];
+        }
+        else {
+            std::cerr << "Usage: BoxDropTests [--workdir DIR]" << std::endl;
+            return 1;
+        }
+    }
+    //Work in a directory of our own, so that nothing else in it is touched
+    const fs::path parent = workDirectory.empty() ? fs::temp_directory_path() : workDirectory;
+    std::error_code ec;
+    fs::path scratch;
+    for (int attempt = 0; ; ++attempt) {
+        scratch = parent / ("BoxDropTests_" + std::to_string(attempt));
+        if (fs::create_directories(scratch, ec)) { break; }
+        if (ec || (attempt > 1000)) {
+            std::cerr << "Cannot create a directory in " << parent.string() << std::endl;
+            return 1;
+        }
+    }
+
+    const std::vector<std::pair<std::string, std::function<void(const fs::path &)>>> tests{
+        { "TiffDirectoryTags", testTiffDirectoryTags },
+        { "CodecRoundTrip", testCodecRoundTrip },
+        { "SpatialIndexQueries", testSpatialIndexQueries },
+        { "RerunWithNewDescription", testRerunWithNewDescription },
+        { "TimingLogColumns", testTimingLogColumns },
+        { "JournalTornTail", testJournalTornTail },
+        { "ManifestTornTail", testManifestTornTail },
+    };
+    int failed = 0;
+    for (auto it = tests.begin(); it != tests.end(); ++it) {
+        g_failures.clear();
+        it->second(scratch);
+        std::cout << (g_failures.empty() ? "PASS " : "FAIL ") << it->first << std::endl;
+        for (auto f = g_failures.begin(); f != g_failures.end(); ++f) {
+            std::cout << "    " << *f << std::endl;
+        }
+        if (!g_failures.empty()) { ++failed; }
+    }
+    fs::remove_all(scratch, ec);
+    return failed;
+}//end main
@@ -0,0 +1,247 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#include "FileSlide.h"
+
+// System headers
+#include <algorithm>
+#include <cstring>
+
+namespace sedeen {
+namespace standalone {
+
+namespace {
+
+uint64_t readLE(const uint8_t *p, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i) { value = (value << 8) | p[i]; }
+    return value;
+}//end readLE
+
+///Size in bytes of one value of a TIFF field type, or 0 if the type is not used here
+int typeSize(int type) {
+    switch (type) {
+    case 1: case 2: case 6: case 7: return 1;
+    case 3: case 8: return 2;
+    case 4: case 9: case 11: return 4;
+    case 5: case 10: case 12: case 16: case 17: case 18: return 8;
+    default: return 0;
+    }
+}//end typeSize
+
+} // namespace
+
+std::shared_ptr<FileSlide> FileSlide::open(const std::string &path, std::string &error) {
+    std::shared_ptr<FileSlide> slide(new FileSlide());
+    slide->m_file.open(path, std::ios::binary);
+    if (!slide->m_file) {
+        error = "cannot open " + path;
+        return nullptr;
+    }
+    char magic[2] = { 0, 0 };
+    slide->m_file.read(magic, 2);
+    slide->m_file.seekg(0);
+    bool opened = false;
+    if ((magic[0] == 'I') && (magic[1] == 'I')) { opened = slide->openTiff(error); }
+    else if ((magic[0] == 'P') && (magic[1] == '6')) { opened = slide->openPpm(error); }
+    else { error = "unsupported file type (expected little-endian TIFF or binary PPM)"; }
+    return opened ? slide : nullptr;
+}//end open
+
+bool FileSlide::openTiff(std::string &error) {
+    uint8_t header[16];
+    m_file.read(reinterpret_cast<char *>(header), 16);
+    const int version = static_cast<int>(readLE(header + 2, 2));
+    const bool bigTiff = (version == 43);
+    if (!bigTiff && (version != 42)) {
+        error = "not a TIFF file";
+        return false;
+    }
+    const int offsetSize = bigTiff ? 8 : 4;
+    const uint64_t ifdOffset = bigTiff ? readLE(header + 8, 8) : readLE(header + 4, 4);
+    m_file.clear();
+    m_file.seekg(static_cast<std::streamoff>(ifdOffset));
+    uint8_t countBytes[8];
+    m_file.read(reinterpret_cast<char *>(countBytes), bigTiff ? 8 : 2);
+    const uint64_t entryCount = readLE(countBytes, bigTiff ? 8 : 2);
+    const int entrySize = bigTiff ? 20 : 12;
+    std::vector<uint8_t> entries(static_cast<size_t>(entryCount) * entrySize);
+    m_file.read(reinterpret_cast<char *>(entries.data()), entries.size());
+    if (!m_file) {
+        error = "truncated TIFF directory";
+        return false;
+    }
+
+    //Read the values of one field, following the offset if they do not fit in the entry
+    auto values = [&](const uint8_t *entry) {
+        const int type = static_cast<int>(readLE(entry + 2, 2));
+        const uint64_t count = readLE(entry + 4, offsetSize);
+        const int size = typeSize(type);
+        std::vector<uint64_t> result;
+        if (size == 0) { return result; }
+        std::vector<uint8_t> data(static_cast<size_t>(count) * size);
+        const uint8_t *valueField = entry + 4 + offsetSize;
+        if (data.size() <= static_cast<size_t>(offsetSize)) {
+            std::memcpy(data.data(), valueField, data.size());
+        }
+        else {
+            m_file.clear();
+            m_file.seekg(static_cast<std::streamoff>(readLE(valueField, offsetSize)));
+            m_file.read(reinterpret_cast<char *>(data.data()), data.size());
+        }
+        for (uint64_t i = 0; i < count; ++i) { result.push_back(readLE(data.data() + i * size, size)); }
+        return result;
+    };
+
+    int bitsPerSample = 8, compression = 1, planar = 1, rowsPerStrip = 0;
+    int tileWidth = 0, tileHeight = 0;
+    std::vector<uint64_t> offsets;
+    for (uint64_t e = 0; e < entryCount; ++e) {
+        const uint8_t *entry = entries.data() + e * entrySize;
+        const int tag = static_cast<int>(readLE(entry, 2));
+        std::vector<uint64_t> v = values(entry);
+        if (v.empty()) { continue; }
+        switch (tag) {
+        case 256: m_width = static_cast<int>(v[0]); break;
+        case 257: m_height = static_cast<int>(v[0]); break;
+        case 258: bitsPerSample = static_cast<int>(v[0]); break;
+        case 259: compression = static_cast<int>(v[0]); break;
+        case 273: case 324: offsets = v; break;
+        case 277: m_channels = static_cast<int>(v[0]); break;
+        case 278: rowsPerStrip = static_cast<int>(std::min<uint64_t>(v[0], INT32_MAX)); break;
+        case 284: planar = static_cast<int>(v[0]); break;
+        case 322: tileWidth = static_cast<int>(v[0]); break;
+        case 323: tileHeight = static_cast<int>(v[0]); break;
+        default: break;
+        }
+    }
+    if ((bitsPerSample != 8) || (compression != 1) || (planar != 1) || (m_channels < 1) || (m_channels > 4)) {
+        error = "only uncompressed, interleaved 8-bit TIFF images can be read";
+        return false;
+    }
+    if ((m_width <= 0) || (m_height <= 0)) {
+        error = "TIFF image has no size";
+        return false;
+    }
+    if ((tileWidth > 0) && (tileHeight > 0)) {
+        m_blockWidth = tileWidth;
+        m_blockHeight = tileHeight;
+    }
+    else {
+        m_blockWidth = m_width;
+        m_blockHeight = ((rowsPerStrip > 0) && (rowsPerStrip < m_height)) ? rowsPerStrip : m_height;
+    }
+    m_blocksAcross = (m_width + m_blockWidth - 1) / m_blockWidth;
+    const size_t blocks = static_cast<size_t>(m_blocksAcross) * ((m_height + m_blockHeight - 1) / m_blockHeight);
+    if (offsets.size() < blocks) {
+        error = "TIFF image is missing tile or strip offsets";
+        return false;
+    }
+    m_blockOffsets = offsets;
+    return true;
+}//end openTiff
+
+bool FileSlide::openPpm(std::string &error) {
+    //Header: "P6", width, height, maxval, separated by whitespace; comments start with '#'
+    std::string magic;
+    m_file >> magic;
+    int fields[3] = { 0, 0, 0 };
+    for (int i = 0; i < 3; ++i) {
+        m_file >> std::ws;
+        while (m_file.peek() == '#') {
+            std::string comment;
+            std::getline(m_file, comment);
+            m_file >> std::ws;
+        }
+        m_file >> fields[i];
+    }
+    m_file.get();
+    if (!m_file || (fields[0] <= 0) || (fields[1] <= 0) || (fields[2] != 255)) {
+        error = "only 8-bit binary PPM images can be read";
+        return false;
+    }
+    m_width = fields[0];
+    m_height = fields[1];
+    m_channels = 3;
+    //Treat each row as a block
+    m_blockWidth = m_width;
+    m_blockHeight = 1;
+    m_blocksAcross = 1;
+    const uint64_t start = static_cast<uint64_t>(m_file.tellg());
+    const uint64_t rowBytes = static_cast<uint64_t>(m_width) * 3;
+    m_blockOffsets.resize(m_height);
+    for (int y = 0; y < m_height; ++y) { m_blockOffsets[y] = start + y * rowBytes; }
+    return true;
+}//end openPpm
+
+image::RawImage FileSlide::decodeRegion(const Rect &region) {
+    if ((region.width() <= 0) || (region.height() <= 0)) { return image::RawImage(); }
+    //The part of the region outside the slide stays black
+    image::RawImage image(region.size(), 3);
+    const int x0 = std::max(0, region.x());
+    const int y0 = std::max(0, region.y());
+    const int x1 = std::min(m_width, region.x() + region.width());
+    const int y1 = std::min(m_height, region.y() + region.height());
+    if ((x1 <= x0) || (y1 <= y0)) { return image; }
+
+    const size_t blockRowBytes = static_cast<size_t>(m_blockWidth) * m_channels;
+    std::vector<uint8_t> block;
+    for (int by = y0 / m_blockHeight; by <= (y1 - 1) / m_blockHeight; ++by) {
+        for (int bx = x0 / m_blockWidth; bx <= (x1 - 1) / m_blockWidth; ++bx) {
+            const int blockX = bx * m_blockWidth;
+            const int blockY = by * m_blockHeight;
+            //Strips at the bottom of the image may be shorter than the others
+            const int rows = std::min(m_blockHeight, m_height - blockY);
+            block.resize(blockRowBytes * rows);
+            {
+                //Only the file is shared; readers convert their blocks in parallel
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_file.clear();
+                m_file.seekg(static_cast<std::streamoff>(m_blockOffsets[static_cast<size_t>(by) * m_blocksAcross + bx]));
+                m_file.read(reinterpret_cast<char *>(block.data()), block.size());
+                if (!m_file) { return image::RawImage(); }
+            }
+            const int cx0 = std::max(x0, blockX);
+            const int cx1 = std::min(x1, blockX + m_blockWidth);
+            const int cy0 = std::max(y0, blockY);
+            const int cy1 = std::min(y1, blockY + rows);
+            for (int y = cy0; y < cy1; ++y) {
+                const uint8_t *src = block.data() + (y - blockY) * blockRowBytes;
+                uint8_t *dst = image.row(y - region.y());
+                for (int x = cx0; x < cx1; ++x) {
+                    const uint8_t *s = src + static_cast<size_t>(x - blockX) * m_channels;
+                    uint8_t *d = dst + static_cast<size_t>(x - region.x()) * 3;
+                    //Greyscale is replicated, alpha dropped
+                    d[0] = s[0];
+                    d[1] = s[(m_channels >= 3) ? 1 : 0];
+                    d[2] = s[(m_channels >= 3) ? 2 : 0];
+                }
+            }
+        }
+    }
+    return image;
+}//end decodeRegion
+
+} // namespace standalone
+} // namespace sedeen
@@ -0,0 +1,76 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef BOXDROP_STANDALONE_FILESLIDE_H
+#define BOXDROP_STANDALONE_FILESLIDE_H
+
+// System headers
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "image/tile/Factory.h"
+
+namespace sedeen {
+namespace standalone {
+
+///A slide read from disk by the standalone build, in place of the SDK's image readers.
+///Reads uncompressed 8-bit little-endian TIFF or BigTIFF (tiled or in strips, first
+///image only, as written by TiffWriter) and binary PPM. Only the tiles or rows that a
+///region touches are read.
+class FileSlide : public image::tile::Factory {
+public:
+    ///Open the slide at path; returns nullptr (and sets error) if it cannot be read
+    static std::shared_ptr<FileSlide> open(const std::string &path, std::string &error);
+
+    Size imageSize() const override { return Size(m_width, m_height); }
+    image::RawImage decodeRegion(const Rect &region) override;
+
+private:
+    FileSlide() = default;
+
+    bool openTiff(std::string &error);
+    bool openPpm(std::string &error);
+
+private:
+    std::ifstream m_file;
+    ///Guards the read position of m_file
+    std::mutex m_mutex;
+    int m_width = 0;
+    int m_height = 0;
+    int m_channels = 3;
+    ///Size of the blocks the pixels are stored in: tiles, strips (full width), or single rows for PPM
+    int m_blockWidth = 0;
+    int m_blockHeight = 0;
+    int m_blocksAcross = 0;
+    std::vector<uint64_t> m_blockOffsets;
+};
+
+} // namespace standalone
+} // namespace sedeen
+
+#endif // ifndef BOXDROP_STANDALONE_FILESLIDE_H
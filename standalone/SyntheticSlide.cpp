@@ -0,0 +1,126 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#include "SyntheticSlide.h"
+
+// System headers
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace sedeen {
+namespace standalone {
+
+SyntheticSlide::SyntheticSlide(int width, int height, int decodeMicroseconds)
+    : m_width(width),
+    m_height(height),
+    m_decodeMicroseconds(decodeMicroseconds),
+    m_tilesDecoded(0)
+{
+}//end constructor
+
+void SyntheticSlide::pixel(int x, int y, uint8_t *rgb) const {
+    if ((x < 0) || (y < 0) || (x >= m_width) || (y >= m_height)) {
+        rgb[0] = rgb[1] = rgb[2] = 0;
+        return;
+    }
+    //Three pieces of tissue, as ellipses in normalized slide coordinates
+    static const double blobs[3][4] = {
+        { 0.30, 0.35, 0.22, 0.25 },
+        { 0.70, 0.40, 0.18, 0.30 },
+        { 0.50, 0.78, 0.30, 0.14 } };
+    const double u = static_cast<double>(x) / m_width;
+    const double v = static_cast<double>(y) / m_height;
+    for (int b = 0; b < 3; ++b) {
+        const double du = (u - blobs[b][0]) / blobs[b][2];
+        const double dv = (v - blobs[b][1]) / blobs[b][3];
+        if (du * du + dv * dv <= 1.0) {
+            //Eosin-like pink with haematoxylin-like texture from a cheap hash
+            const uint32_t h = static_cast<uint32_t>(x) * 2654435761u ^ static_cast<uint32_t>(y) * 40503u;
+            const int texture = static_cast<int>((h >> 24) & 0x3F);
+            rgb[0] = static_cast<uint8_t>(200 - texture);
+            rgb[1] = static_cast<uint8_t>(110 - texture);
+            rgb[2] = static_cast<uint8_t>(170 - texture / 2);
+            return;
+        }
+    }
+    rgb[0] = 242;
+    rgb[1] = 242;
+    rgb[2] = 240;
+}//end pixel
+
+image::RawImage SyntheticSlide::decodeRegion(const Rect &region) {
+    if ((region.width() <= 0) || (region.height() <= 0)) { return image::RawImage(); }
+    chargeTiles(region, 0);
+    image::RawImage image(region.size(), 3);
+    for (int y = 0; y < region.height(); ++y) {
+        uint8_t *row = image.row(y);
+        for (int x = 0; x < region.width(); ++x) {
+            pixel(region.x() + x, region.y() + y, row + static_cast<size_t>(x) * 3);
+        }
+    }
+    return image;
+}//end decodeRegion
+
+image::RawImage SyntheticSlide::decodeScaledRegion(const Rect &region, const Size &outputSize) {
+    if ((region.width() <= 0) || (region.height() <= 0)
+        || (outputSize.width() <= 0) || (outputSize.height() <= 0)) {
+        return image::RawImage();
+    }
+    //The finest level that is not finer than the output
+    int level = 0;
+    while ((region.width() >> (level + 1) >= outputSize.width())
+        && (region.height() >> (level + 1) >= outputSize.height())) {
+        ++level;
+    }
+    chargeTiles(region, level);
+    image::RawImage image(outputSize, 3);
+    for (int y = 0; y < outputSize.height(); ++y) {
+        uint8_t *row = image.row(y);
+        const int sy = region.y() + static_cast<int>(static_cast<int64_t>(y) * region.height() / outputSize.height());
+        for (int x = 0; x < outputSize.width(); ++x) {
+            const int sx = region.x() + static_cast<int>(static_cast<int64_t>(x) * region.width() / outputSize.width());
+            pixel(sx, sy, row + static_cast<size_t>(x) * 3);
+        }
+    }
+    return image;
+}//end decodeScaledRegion
+
+void SyntheticSlide::chargeTiles(const Rect &region, int level) {
+    //Charge the decode cost of every tile of the level the region touches
+    const int span = TileSize << level;
+    const int x0 = std::max(0, region.x()) / span;
+    const int y0 = std::max(0, region.y()) / span;
+    const int x1 = std::min(m_width, region.x() + region.width());
+    const int y1 = std::min(m_height, region.y() + region.height());
+    if ((x1 <= 0) || (y1 <= 0)) { return; }
+    const int64_t tiles = static_cast<int64_t>((x1 - 1) / span - x0 + 1) * ((y1 - 1) / span - y0 + 1);
+    m_tilesDecoded += tiles;
+    if (m_decodeMicroseconds > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(tiles * m_decodeMicroseconds));
+    }
+}//end chargeTiles
+
+} // namespace standalone
+} // namespace sedeen
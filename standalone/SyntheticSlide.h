@@ -0,0 +1,74 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef BOXDROP_STANDALONE_SYNTHETICSLIDE_H
+#define BOXDROP_STANDALONE_SYNTHETICSLIDE_H
+
+// System headers
+#include <atomic>
+#include <cstdint>
+
+#include "image/tile/Factory.h"
+
+namespace sedeen {
+namespace standalone {
+
+///A procedurally generated slide: white glass with a few elliptical pieces of tissue.
+///Pixels are produced in tiles of TileSize like a pyramidal slide reader with power-of-two
+///levels, with an optional
+///delay per tile so decode cost can be modelled. Any pixel can be recomputed from its
+///coordinates, so exports of the same region always match.
+class SyntheticSlide : public image::tile::Factory {
+public:
+    static const int TileSize = 256;
+
+    ///A slide of width x height pixels whose decoding costs decodeMicroseconds per tile
+    SyntheticSlide(int width, int height, int decodeMicroseconds = 0);
+
+    Size imageSize() const override { return Size(m_width, m_height); }
+    image::RawImage decodeRegion(const Rect &region) override;
+    ///Samples the slide at the output resolution, charging the tiles of the pyramid level
+    ///nearest to it, so that a coarse read costs what a real pyramid would
+    image::RawImage decodeScaledRegion(const Rect &region, const Size &outputSize) override;
+
+    ///RGB value of the pixel at (x,y) of the slide
+    void pixel(int x, int y, uint8_t *rgb) const;
+
+    ///Number of tiles decoded so far
+    int64_t tilesDecoded() const { return m_tilesDecoded; }
+
+private:
+    ///Count, and wait for, the tiles of level that region touches
+    void chargeTiles(const Rect &region, int level);
+
+private:
+    int m_width, m_height;
+    int m_decodeMicroseconds;
+    std::atomic<int64_t> m_tilesDecoded;
+};
+
+} // namespace standalone
+} // namespace sedeen
+
+#endif // ifndef BOXDROP_STANDALONE_SYNTHETICSLIDE_H
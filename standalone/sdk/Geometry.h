@@ -0,0 +1,75 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Stand-in for the Sedeen SDK header of the same name (annotation types only).
+
+#ifndef BOXDROP_STANDALONE_SDK_GEOMETRY_H
+#define BOXDROP_STANDALONE_SDK_GEOMETRY_H
+
+// System headers
+#include <string>
+#include <vector>
+
+#include "Global.h"
+
+namespace sedeen {
+
+///Drawing style of an annotation; the stand-in carries no attributes
+class GraphicStyle {
+};
+
+///Shape type of an annotation
+class Geometry {
+public:
+    Geometry() : m_type(0) {}
+    explicit Geometry(int type) : m_type(type) {}
+    int type() const { return m_type; }
+private:
+    int m_type;
+};
+
+///One annotation of a session: name, description, style and point lists
+class GraphicDescription {
+public:
+    const char *getName() const { return m_name.c_str(); }
+    void setName(const char *name) { m_name = name; }
+    const char *getDescription() const { return m_description.c_str(); }
+    void setDescription(const char *description) { m_description = description; }
+    const GraphicStyle &getStyle() const { return m_style; }
+    void setStyle(const GraphicStyle &style) { m_style = style; }
+    const Geometry &getGeometry() const { return m_geometry; }
+    void setGeometry(const Geometry &geometry) { m_geometry = geometry; }
+    const std::vector<std::vector<PointF>> &getPoints() const { return m_points; }
+    void setPoints(const std::vector<std::vector<PointF>> &points) { m_points = points; }
+private:
+    std::string m_name;
+    std::string m_description;
+    GraphicStyle m_style;
+    Geometry m_geometry;
+    std::vector<std::vector<PointF>> m_points;
+};
+
+} // namespace sedeen
+
+#endif // ifndef BOXDROP_STANDALONE_SDK_GEOMETRY_H
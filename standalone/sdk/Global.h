@@ -0,0 +1,86 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Stand-in for the Sedeen SDK header of the same name, used only to build the
+// plugin's helper modules and the benchmark on platforms without the SDK.
+// It provides just the members the plugin calls.
+
+#ifndef BOXDROP_STANDALONE_SDK_GLOBAL_H
+#define BOXDROP_STANDALONE_SDK_GLOBAL_H
+
+namespace sedeen {
+
+class Size {
+public:
+    Size() : m_width(0), m_height(0) {}
+    Size(int width, int height) : m_width(width), m_height(height) {}
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    void setWidth(int width) { m_width = width; }
+    void setHeight(int height) { m_height = height; }
+private:
+    int m_width, m_height;
+};
+
+class Point {
+public:
+    Point() : m_x(0), m_y(0) {}
+    Point(int x, int y) : m_x(x), m_y(y) {}
+    int getX() const { return m_x; }
+    int getY() const { return m_y; }
+    void setX(int x) { m_x = x; }
+    void setY(int y) { m_y = y; }
+private:
+    int m_x, m_y;
+};
+
+class PointF {
+public:
+    PointF() : m_x(0.0), m_y(0.0) {}
+    PointF(double x, double y) : m_x(x), m_y(y) {}
+    double getX() const { return m_x; }
+    double getY() const { return m_y; }
+    void setX(double x) { m_x = x; }
+    void setY(double y) { m_y = y; }
+private:
+    double m_x, m_y;
+};
+
+class Rect {
+public:
+    Rect() {}
+    Rect(const Point &origin, const Size &size) : m_origin(origin), m_size(size) {}
+    int x() const { return m_origin.getX(); }
+    int y() const { return m_origin.getY(); }
+    int width() const { return m_size.width(); }
+    int height() const { return m_size.height(); }
+    const Size &size() const { return m_size; }
+private:
+    Point m_origin;
+    Size m_size;
+};
+
+} // namespace sedeen
+
+#endif // ifndef BOXDROP_STANDALONE_SDK_GLOBAL_H
@@ -0,0 +1,81 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Stand-in for the Sedeen SDK header of the same name (8-bit pixel buffers only).
+
+#ifndef BOXDROP_STANDALONE_SDK_IMAGE_H
+#define BOXDROP_STANDALONE_SDK_IMAGE_H
+
+// System headers
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Global.h"
+
+namespace sedeen {
+namespace image {
+
+///Interleaved 8-bit image with a shared pixel buffer, like the SDK's RawImage
+class RawImage {
+public:
+    RawImage() : m_components(0) {}
+    RawImage(const Size &size, int components)
+        : m_size(size), m_components(components),
+        m_pixels(std::make_shared<std::vector<uint8_t>>(
+            static_cast<size_t>(size.width()) * size.height() * components, 0)) {}
+
+    int width() const { return m_size.width(); }
+    int height() const { return m_size.height(); }
+    const Size &size() const { return m_size; }
+    int components() const { return m_components; }
+    bool isNull() const { return !m_pixels; }
+
+    ///Value of component c of the pixel at (x,y)
+    uint8_t at(int x, int y, int c) const { return (*m_pixels)[index(x, y, c)]; }
+    void setValue(int x, int y, int c, uint8_t value) { (*m_pixels)[index(x, y, c)] = value; }
+
+    ///First byte of row y
+    uint8_t *row(int y) { return m_pixels->data() + index(0, y, 0); }
+    const uint8_t *row(int y) const { return m_pixels->data() + index(0, y, 0); }
+
+    ///Write the image as binary PPM (the stand-in ignores the extension)
+    bool save(const std::string &path) const;
+
+private:
+    size_t index(int x, int y, int c) const {
+        return (static_cast<size_t>(y) * m_size.width() + x) * m_components + c;
+    }
+
+private:
+    Size m_size;
+    int m_components;
+    std::shared_ptr<std::vector<uint8_t>> m_pixels;
+};
+
+} // namespace image
+} // namespace sedeen
+
+#endif // ifndef BOXDROP_STANDALONE_SDK_IMAGE_H
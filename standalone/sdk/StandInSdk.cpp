@@ -0,0 +1,188 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Implementation of the SDK stand-ins declared in Image.h, image/tile/Factory.h
+// and archive/Session.h.
+
+// System headers
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "Image.h"
+#include "archive/Session.h"
+#include "image/tile/Factory.h"
+
+namespace sedeen {
+
+namespace {
+
+///Percent-encode the characters that separate fields of the session file
+std::string escapeField(const std::string &text) {
+    std::string out;
+    for (char c : text) {
+        if ((c == '%') || (c == '\t') || (c == '\n') || (c == '\r')) {
+            static const char hex[] = "0123456789ABCDEF";
+            out += '%';
+            out += hex[(static_cast<unsigned char>(c) >> 4) & 0xF];
+            out += hex[static_cast<unsigned char>(c) & 0xF];
+        }
+        else {
+            out += c;
+        }
+    }
+    return out;
+}//end escapeField
+
+std::string unescapeField(const std::string &text) {
+    std::string out;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if ((text[i] == '%') && (i + 2 < text.size())) {
+            out += static_cast<char>(std::stoi(text.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        }
+        else {
+            out += text[i];
+        }
+    }
+    return out;
+}//end unescapeField
+
+} // namespace
+
+bool Session::loadFromFile() {
+    m_graphics.clear();
+    std::ifstream in(m_imagePath + ".session.xml");
+    if (!in) { return false; }
+    std::string line;
+    if (!std::getline(in, line) || (line != "BoxDropSession 1")) { return false; }
+    //Each line: name, description, geometry type, then point lists separated by '|'
+    //with points "x,y" separated by ';'
+    while (std::getline(in, line)) {
+        if (line.empty()) { continue; }
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, '\t')) { fields.push_back(field); }
+        if (fields.size() < 3) { return false; }
+        GraphicDescription graphic;
+        graphic.setName(unescapeField(fields[0]).c_str());
+        graphic.setDescription(unescapeField(fields[1]).c_str());
+        graphic.setGeometry(Geometry(std::stoi(fields[2])));
+        std::vector<std::vector<PointF>> points;
+        if (fields.size() > 3) {
+            std::stringstream lists(fields[3]);
+            std::string list;
+            while (std::getline(lists, list, '|')) {
+                std::vector<PointF> polygon;
+                std::stringstream coords(list);
+                std::string coord;
+                while (std::getline(coords, coord, ';')) {
+                    const size_t comma = coord.find(',');
+                    if (comma == std::string::npos) { return false; }
+                    polygon.emplace_back(std::stod(coord.substr(0, comma)), std::stod(coord.substr(comma + 1)));
+                }
+                points.push_back(polygon);
+            }
+        }
+        graphic.setPoints(points);
+        m_graphics.push_back(graphic);
+    }
+    return true;
+}//end loadFromFile
+
+bool Session::saveToFile() {
+    return saveToFile(m_imagePath + ".session.xml");
+}//end saveToFile
+
+bool Session::saveToFile(const std::string &path) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) { return false; }
+    out << "BoxDropSession 1\n";
+    for (auto it = m_graphics.begin(); it != m_graphics.end(); ++it) {
+        out << escapeField(it->getName()) << '\t' << escapeField(it->getDescription())
+            << '\t' << it->getGeometry().type() << '\t';
+        const auto &points = it->getPoints();
+        for (size_t l = 0; l < points.size(); ++l) {
+            if (l > 0) { out << '|'; }
+            for (size_t p = 0; p < points[l].size(); ++p) {
+                if (p > 0) { out << ';'; }
+                out << points[l][p].getX() << ',' << points[l][p].getY();
+            }
+        }
+        out << '\n';
+    }
+    out.flush();
+    return static_cast<bool>(out);
+}//end saveToFile
+
+namespace image {
+
+bool RawImage::save(const std::string &path) const {
+    if (isNull()) { return false; }
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) { return false; }
+    out << "P6\n" << width() << " " << height() << "\n255\n";
+    for (int y = 0; y < height(); ++y) {
+        for (int x = 0; x < width(); ++x) {
+            for (int c = 0; c < 3; ++c) {
+                out.put(static_cast<char>(at(x, y, std::min(c, m_components - 1))));
+            }
+        }
+    }
+    return static_cast<bool>(out);
+}//end save
+
+namespace tile {
+
+RawImage Factory::decodeScaledRegion(const Rect &region, const Size &outputSize) {
+    RawImage full = decodeRegion(region);
+    if ((outputSize.width() == region.width()) && (outputSize.height() == region.height())) {
+        return full;
+    }
+    if (full.isNull() || (outputSize.width() <= 0) || (outputSize.height() <= 0)) { return RawImage(); }
+    //Nearest-neighbour scaling
+    RawImage scaled(outputSize, full.components());
+    for (int y = 0; y < outputSize.height(); ++y) {
+        const int sy = static_cast<int>(static_cast<int64_t>(y) * full.height() / outputSize.height());
+        for (int x = 0; x < outputSize.width(); ++x) {
+            const int sx = static_cast<int>(static_cast<int64_t>(x) * full.width() / outputSize.width());
+            for (int c = 0; c < full.components(); ++c) {
+                scaled.setValue(x, y, c, full.at(sx, sy, c));
+            }
+        }
+    }
+    return scaled;
+}//end decodeScaledRegion
+
+RawImage Compositor::getImage(const Rect &region, const Size &outputSize) {
+    if ((outputSize.width() == region.width()) && (outputSize.height() == region.height())) {
+        return m_factory->decodeRegion(region);
+    }
+    return m_factory->decodeScaledRegion(region, outputSize);
+}//end getImage
+
+} // namespace tile
+} // namespace image
+} // namespace sedeen
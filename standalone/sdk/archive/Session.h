@@ -0,0 +1,64 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Stand-in for the Sedeen SDK header of the same name. The session of an image
+// is kept in a plain text file next to it, one annotation per line.
+
+#ifndef BOXDROP_STANDALONE_SDK_ARCHIVE_SESSION_H
+#define BOXDROP_STANDALONE_SDK_ARCHIVE_SESSION_H
+
+// System headers
+#include <string>
+#include <vector>
+
+#include "Geometry.h"
+
+namespace sedeen {
+
+class Session {
+public:
+    explicit Session(const std::string &imagePath) : m_imagePath(imagePath) {}
+
+    const std::string &imagePath() const { return m_imagePath; }
+
+    ///Read the session file of the image. Returns false if it does not exist or is malformed.
+    bool loadFromFile();
+
+    ///Write the session file of the image
+    bool saveToFile();
+
+    ///Write the session to path
+    bool saveToFile(const std::string &path);
+
+    const std::vector<GraphicDescription> &getGraphics() const { return m_graphics; }
+    void setGraphics(const std::vector<GraphicDescription> &graphics) { m_graphics = graphics; }
+
+private:
+    std::string m_imagePath;
+    std::vector<GraphicDescription> m_graphics;
+};
+
+} // namespace sedeen
+
+#endif // ifndef BOXDROP_STANDALONE_SDK_ARCHIVE_SESSION_H
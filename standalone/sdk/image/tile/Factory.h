@@ -0,0 +1,74 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+// Stand-in for the Sedeen SDK header of the same name. A Factory returns the
+// pixels of any region of a slide, at full resolution or scaled to an output
+// size as a pyramid level would be; the Compositor asks it for the output size.
+
+#ifndef BOXDROP_STANDALONE_SDK_IMAGE_TILE_FACTORY_H
+#define BOXDROP_STANDALONE_SDK_IMAGE_TILE_FACTORY_H
+
+// System headers
+#include <memory>
+
+#include "Global.h"
+#include "Image.h"
+
+namespace sedeen {
+namespace image {
+namespace tile {
+
+///Source of level-0 pixels of one slide
+class Factory {
+public:
+    virtual ~Factory() {}
+
+    ///Level-0 size of the slide
+    virtual Size imageSize() const = 0;
+
+    ///Return the pixels of region (which may extend past the slide; the outside is black)
+    virtual RawImage decodeRegion(const Rect &region) = 0;
+
+    ///Return the pixels of region scaled to outputSize. By default the region is decoded at
+    ///full resolution and scaled; a reader with a pyramid can read a coarser level instead.
+    virtual RawImage decodeScaledRegion(const Rect &region, const Size &outputSize);
+};
+
+///Compose a region of the slide into an image of the requested size
+class Compositor {
+public:
+    explicit Compositor(std::shared_ptr<Factory> factory) : m_factory(factory) {}
+
+    ///Read region from the factory at outputSize
+    RawImage getImage(const Rect &region, const Size &outputSize);
+
+private:
+    std::shared_ptr<Factory> m_factory;
+};
+
+} // namespace tile
+} // namespace image
+} // namespace sedeen
+
+#endif // ifndef BOXDROP_STANDALONE_SDK_IMAGE_TILE_FACTORY_H